@@ -0,0 +1,177 @@
+#include "bufferpool.h"
+
+#include <mutex>
+#include <new>
+
+namespace net {
+
+	namespace {
+
+		// Max bytes of free chunks of one class kept by a thread.
+		const int CACHE_SIZE = 128 * 1024;
+
+		// A free chunk links to the next one.
+		class Chunk {
+		public:
+			Chunk* next_;
+		};
+
+		class FreeList {
+		public:
+			FreeList() : head_(nullptr), size_(0) {
+			}
+
+			void push(Chunk* chunk) {
+				chunk->next_ = head_;
+				head_ = chunk;
+				++size_;
+			}
+
+			Chunk* pop() {
+				Chunk* chunk = head_;
+				head_ = chunk->next_;
+				--size_;
+				return chunk;
+			}
+
+			// Move the number of chunks to the other list.
+			void move(FreeList& list, int nbr) {
+				for (int i = 0; i < nbr; ++i) {
+					list.push(pop());
+				}
+			}
+
+			Chunk* head_;
+			int size_;
+		};
+
+		int getClass(int size) {
+			int index = 0;
+			while ((BufferPool::MIN_SIZE << index) < size) {
+				++index;
+			}
+			return index;
+		}
+
+		int getChunkSize(int index) {
+			return BufferPool::MIN_SIZE << index;
+		}
+
+		// The number of chunks kept by a thread's cache of the class.
+		int getCacheLimit(int index) {
+			int limit = CACHE_SIZE / getChunkSize(index);
+			return limit < 4 ? 4 : limit;
+		}
+
+		class Shared {
+		public:
+			std::mutex mutexes_[BufferPool::CLASSES];
+			FreeList lists_[BufferPool::CLASSES];
+			Counter reserved_;
+			Counter cacheMisses_;
+			Counter poolMisses_;
+			Counter oversized_;
+		};
+
+		// Never destroyed, i.e. chunks may be freed by the destructors of other statics.
+		Shared& getShared() {
+			static Shared* shared = new Shared();
+			return *shared;
+		}
+
+		class Cache {
+		public:
+			~Cache() {
+				Shared& shared = getShared();
+				for (int i = 0; i < BufferPool::CLASSES; ++i) {
+					std::lock_guard<std::mutex> lock(shared.mutexes_[i]);
+					lists_[i].move(shared.lists_[i], lists_[i].size_);
+				}
+			}
+
+			// Fill the empty list with a batch from the shared list or from a new slab.
+			void refill(int index) {
+				Shared& shared = getShared();
+				shared.cacheMisses_.add(1);
+				int batch = getCacheLimit(index) / 2;
+				{
+					std::lock_guard<std::mutex> lock(shared.mutexes_[index]);
+					FreeList& list = shared.lists_[index];
+					if (list.size_ > 0) {
+						list.move(lists_[index], list.size_ < batch ? list.size_ : batch);
+						return;
+					}
+				}
+				shared.poolMisses_.add(1);
+				int size = getChunkSize(index);
+				char* slab = static_cast<char*>(::operator new((size_t) size * batch));
+				shared.reserved_.add((long long) size * batch);
+				for (int i = 0; i < batch; ++i) {
+					lists_[index].push(reinterpret_cast<Chunk*>(slab + (size_t) size * i));
+				}
+			}
+
+			// Move half of the full list to the shared list.
+			void release(int index) {
+				Shared& shared = getShared();
+				std::lock_guard<std::mutex> lock(shared.mutexes_[index]);
+				lists_[index].move(shared.lists_[index], lists_[index].size_ / 2);
+			}
+
+			FreeList lists_[BufferPool::CLASSES];
+		};
+
+		thread_local Cache cache;
+
+	}
+
+	const int BufferPool::MAX_SIZE;
+
+	void* BufferPool::allocate(int size) {
+		if (size > MAX_SIZE) {
+			getShared().oversized_.add(1);
+			return ::operator new(size);
+		}
+		int index = getClass(size);
+		FreeList& list = cache.lists_[index];
+		if (list.size_ == 0) {
+			cache.refill(index);
+		}
+		return list.pop();
+	}
+
+	void BufferPool::deallocate(void* data, int size) {
+		if (size > MAX_SIZE) {
+			::operator delete(data);
+			return;
+		}
+		int index = getClass(size);
+		FreeList& list = cache.lists_[index];
+		list.push(static_cast<Chunk*>(data));
+		if (list.size_ > getCacheLimit(index)) {
+			cache.release(index);
+		}
+	}
+
+	int BufferPool::getCapacity(int size) {
+		return size > MAX_SIZE ? size : getChunkSize(getClass(size));
+	}
+
+	PoolStats BufferPool::getStats() {
+		Shared& shared = getShared();
+		PoolStats stats;
+		stats.reserved_ = shared.reserved_.get();
+		stats.cacheMisses_ = shared.cacheMisses_.get();
+		stats.poolMisses_ = shared.poolMisses_.get();
+		stats.oversized_ = shared.oversized_.get();
+		return stats;
+	}
+
+	void BufferPool::resetStats() {
+		Shared& shared = getShared();
+		shared.cacheMisses_.take();
+		shared.poolMisses_.take();
+		shared.oversized_.take();
+	}
+
+} // Namespace net.
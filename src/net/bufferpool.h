@@ -0,0 +1,40 @@
+#ifndef NET_BUFFERPOOL_H
+#define NET_BUFFERPOOL_H
+
+#include "stats.h"
+
+namespace net {
+
+	// Fixed-size chunks of memory in size classes, the powers of two from MIN_SIZE
+	// to MAX_SIZE. Each thread keeps a cache of free chunks per class, i.e. an
+	// allocation or a deallocation is a pointer swap without locks. A full cache
+	// moves half of its chunks to the shared free list of the class, an empty cache
+	// takes a batch from it or carves a new slab. Chunks freed by another thread,
+	// e.g. a payload created by the application and sent by a network thread, flow
+	// back through the shared lists. The memory is never returned to the heap.
+	// Shared by all networks, the packets and payloads may outlive a network.
+	class BufferPool {
+	public:
+		static const int MIN_SIZE = 64;
+		static const int CLASSES = 11;
+		static const int MAX_SIZE = MIN_SIZE << (CLASSES - 1);
+
+		// Return a chunk of at least the size, aligned as by operator new. Bigger
+		// sizes than MAX_SIZE are allocated from the heap. Thread safe.
+		static void* allocate(int size);
+
+		// The size must be the one used to allocate the chunk. Thread safe.
+		static void deallocate(void* data, int size);
+
+		// The size of the chunk allocated for the size, i.e. the usable size.
+		static int getCapacity(int size);
+
+		static PoolStats getStats();
+
+		// Set the miss counters to zero.
+		static void resetStats();
+	};
+
+} // Namespace net.
+
+#endif // NET_BUFFERPOOL_H
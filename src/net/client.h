@@ -2,12 +2,12 @@
 #define NET_CLIENT_H
 
 #include "packet.h"
+#include "message.h"
+#include "mpscqueue.h"
+#include "stats.h"
 
 #include <cassert>
-#include <queue>
-
-#include <vector>
-#include <array>
+#include <atomic>
 
 namespace net {
 
@@ -30,19 +30,34 @@ namespace net {
 			return id_;
 		}
 
-	protected:
-		Client(int id) : id_(id) {
+		// The stats of the connection to the client, or for a local client connected
+		// to a remote server, of the connection to the server. Thread safe.
+		ConnectionStats getStats() const {
+			ConnectionStats stats;
+			static_cast<TrafficStats&>(stats) = counters_.get();
+			stats.sendQueueSize_ = (int) sendQueueSize_.get();
+			stats.rtt_ = rtt_.get() / 1000.0;
+			return stats;
 		}
 
-		void receiveData(const std::array<char, 256>::const_iterator& begin, const std::array<char, 256>::const_iterator& end) {
-			receiveBuffer_.push_back(end - begin);
-			receiveBuffer_.insert(receiveBuffer_.end(), begin, end);
+		// Set the counters to zero, the gauges are kept. Thread safe.
+		void resetStats() {
+			counters_.reset();
+		}
+
+	protected:
+		Client(int id) : id_(id) {
 		}
 
-		std::vector<char> receiveBuffer_;		
+		// Packets received from other clients, pushed by the network threads.
+		MpscQueue<Message> receiveBuffer_;
 	
 	private:
-		int id_;
+		std::atomic<int> id_;
+		// Updated by the network thread owning the connection.
+		TrafficCounters counters_;
+		Counter sendQueueSize_;
+		Counter rtt_; // In microseconds.
 	};
 
 } // Namespace net.
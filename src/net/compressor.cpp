@@ -0,0 +1,280 @@
+#include "compressor.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+namespace net {
+
+	namespace {
+
+		typedef std::chrono::steady_clock Clock;
+
+		long long nanoseconds(Clock::time_point start) {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		}
+
+		// The data and the dictionary before it, seen as one sequence of bytes.
+		class Window {
+		public:
+			Window(const char* dictionary, int dictionarySize, const char* data)
+				: dictionary_(dictionary), dictionarySize_(dictionarySize), data_(data) {
+			}
+
+			char operator[](int position) const {
+				return position < dictionarySize_ ? dictionary_[position] : data_[position - dictionarySize_];
+			}
+
+			uint32_t read32(int position) const {
+				uint32_t value;
+				if (position >= dictionarySize_) {
+					std::memcpy(&value, data_ + position - dictionarySize_, sizeof(value));
+				} else if (position + 4 <= dictionarySize_) {
+					std::memcpy(&value, dictionary_ + position, sizeof(value));
+				} else {
+					char bytes[4] = {(*this)[position], (*this)[position + 1], (*this)[position + 2], (*this)[position + 3]};
+					std::memcpy(&value, bytes, sizeof(value));
+				}
+				return value;
+			}
+
+		private:
+			const char* dictionary_;
+			int dictionarySize_;
+			const char* data_;
+		};
+
+		inline int hash(uint32_t sequence, int bits) {
+			return (int) ((sequence * 2654435761u) >> (32 - bits));
+		}
+
+		void writeLength(std::vector<char>& destination, int length) {
+			while (length >= 255) {
+				destination.push_back((char) 255);
+				length -= 255;
+			}
+			destination.push_back((char) length);
+		}
+
+		bool readLength(const char* block, int size, int& index, int& length) {
+			unsigned char byte;
+			do {
+				if (index >= size) {
+					return false;
+				}
+				byte = block[index++];
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+
+	}
+
+	const int Compressor::MAX_OFFSET;
+
+	Compressor::Compressor(int threshold, const std::vector<char>& dictionary) : dictionary_(dictionary) {
+		threshold_ = threshold;
+		packets_ = 0;
+		compressed_ = 0;
+		inputBytes_ = 0;
+		outputBytes_ = 0;
+		compressTime_ = 0;
+		decompressTime_ = 0;
+		if (!dictionary_.empty()) {
+			// Only the end of a large dictionary can be reached by an offset.
+			dictionaryTable_.assign(1 << HASH_BITS, -1);
+			Window window(dictionary_.data(), dictionary_.size(), nullptr);
+			int start = std::max(0, (int) dictionary_.size() - MAX_OFFSET);
+			for (int position = start; position + MIN_MATCH <= (int) dictionary_.size(); ++position) {
+				dictionaryTable_[hash(window.read32(position), HASH_BITS)] = position;
+			}
+		}
+	}
+
+	void Compressor::compress(const char* data, int size, std::vector<char>& destination) const {
+		auto start = Clock::now();
+		int frameStart = destination.size();
+		destination.push_back(0);
+		bool compressed = false;
+		if (size >= threshold_ && size > 0) {
+			unsigned int value = size;
+			while (value >= 0x80) {
+				destination.push_back((char) (value | 0x80));
+				value >>= 7;
+			}
+			destination.push_back((char) value);
+			compressed = compressBlock(data, size, destination);
+			if (compressed) {
+				destination[frameStart] = (char) (COMPRESSED | (dictionary_.empty() ? 0 : DICTIONARY));
+			} else {
+				destination.resize(frameStart + 1);
+			}
+		}
+		if (!compressed) {
+			destination.insert(destination.end(), data, data + size);
+		}
+		++packets_;
+		if (compressed) {
+			++compressed_;
+		}
+		inputBytes_ += size;
+		outputBytes_ += destination.size() - frameStart;
+		compressTime_ += nanoseconds(start);
+	}
+
+	bool Compressor::decompress(const char* frame, int size, int maxSize, Packet& packet) const {
+		if (size < 1) {
+			return false;
+		}
+		unsigned char flags = frame[0];
+		if (flags == 0) {
+			if (size - 1 > maxSize) {
+				return false;
+			}
+			packet.clear();
+			packet.append(frame + 1, size - 1);
+			return true;
+		}
+		if ((flags & ~(COMPRESSED | DICTIONARY)) != 0 || (flags & DICTIONARY) != (dictionary_.empty() ? 0 : DICTIONARY)) {
+			// Not the same dictionary on both ends.
+			return false;
+		}
+		auto start = Clock::now();
+		unsigned int rawSize = 0;
+		int index = 1;
+		for (int i = 0;; ++i) {
+			if (i == 5 || index >= size) {
+				return false;
+			}
+			unsigned char byte = frame[index++];
+			rawSize |= (unsigned int) (byte & 0x7f) << (7 * i);
+			if ((byte & 0x80) == 0) {
+				break;
+			}
+		}
+		if (rawSize > (unsigned int) maxSize) {
+			return false;
+		}
+		packet.clear();
+		packet.resize(rawSize);
+		bool valid = decompressBlock(frame + index, size - index, packet.getData(), rawSize);
+		decompressTime_ += nanoseconds(start);
+		return valid;
+	}
+
+	CompressionStats Compressor::getStats() const {
+		CompressionStats stats;
+		stats.packets_ = packets_;
+		stats.compressed_ = compressed_;
+		stats.inputBytes_ = inputBytes_;
+		stats.outputBytes_ = outputBytes_;
+		stats.compressTime_ = compressTime_;
+		stats.decompressTime_ = decompressTime_;
+		return stats;
+	}
+
+	bool Compressor::compressBlock(const char* data, int size, std::vector<char>& destination) const {
+		// Never cleared, an old entry is only a candidate and is checked.
+		thread_local std::vector<int> table(1 << HASH_BITS, -1);
+
+		int dictionarySize = dictionary_.size();
+		Window window(dictionary_.data(), dictionarySize, data);
+		int blockStart = destination.size();
+		int end = dictionarySize + size;
+		int anchor = dictionarySize;
+		int position = dictionarySize;
+		while (position + MIN_MATCH <= end) {
+			uint32_t sequence = window.read32(position);
+			int h = hash(sequence, HASH_BITS);
+			int candidate = table[h];
+			table[h] = position;
+			int match = -1;
+			if (candidate >= dictionarySize && candidate < position && position - candidate <= MAX_OFFSET && window.read32(candidate) == sequence) {
+				match = candidate;
+			} else if (!dictionaryTable_.empty()) {
+				candidate = dictionaryTable_[h];
+				if (candidate >= 0 && position - candidate <= MAX_OFFSET && window.read32(candidate) == sequence) {
+					match = candidate;
+				}
+			}
+			if (match < 0) {
+				++position;
+				continue;
+			}
+			int length = MIN_MATCH;
+			while (position + length < end && window[match + length] == window[position + length]) {
+				++length;
+			}
+			int literals = position - anchor;
+			int matchLength = length - MIN_MATCH;
+			destination.push_back((char) ((literals < 15 ? literals : 15) << 4 | (matchLength < 15 ? matchLength : 15)));
+			if (literals >= 15) {
+				writeLength(destination, literals - 15);
+			}
+			destination.insert(destination.end(), data + anchor - dictionarySize, data + position - dictionarySize);
+			int offset = position - match;
+			destination.push_back((char) offset);
+			destination.push_back((char) (offset >> 8));
+			if (matchLength >= 15) {
+				writeLength(destination, matchLength - 15);
+			}
+			position += length;
+			anchor = position;
+			if ((int) destination.size() - blockStart >= size) {
+				return false;
+			}
+		}
+		// The last literals.
+		int literals = end - anchor;
+		destination.push_back((char) ((literals < 15 ? literals : 15) << 4));
+		if (literals >= 15) {
+			writeLength(destination, literals - 15);
+		}
+		destination.insert(destination.end(), data + anchor - dictionarySize, data + size);
+		return (int) destination.size() - blockStart < size;
+	}
+
+	bool Compressor::decompressBlock(const char* block, int size, char* destination, int destinationSize) const {
+		int dictionarySize = dictionary_.size();
+		int index = 0;
+		int position = 0;
+		while (index < size) {
+			unsigned char token = block[index++];
+			int literals = token >> 4;
+			if (literals == 15 && !readLength(block, size, index, literals)) {
+				return false;
+			}
+			if (literals > size - index || literals > destinationSize - position) {
+				return false;
+			}
+			std::memcpy(destination + position, block + index, literals);
+			index += literals;
+			position += literals;
+			if (index == size) {
+				// The last sequence.
+				break;
+			}
+			if (size - index < 2) {
+				return false;
+			}
+			int offset = (unsigned char) block[index] | (unsigned char) block[index + 1] << 8;
+			index += 2;
+			int length = token & 15;
+			if (length == 15 && !readLength(block, size, index, length)) {
+				return false;
+			}
+			length += MIN_MATCH;
+			if (offset == 0 || offset > position + dictionarySize || length > destinationSize - position) {
+				return false;
+			}
+			// Byte by byte, the match may overlap the bytes written.
+			for (int i = 0; i < length; ++i, ++position) {
+				int source = position - offset;
+				destination[position] = source < 0 ? dictionary_[dictionarySize + source] : destination[source];
+			}
+		}
+		return position == destinationSize;
+	}
+
+} // Namespace net.
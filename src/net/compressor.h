@@ -0,0 +1,86 @@
+#ifndef NET_COMPRESSOR_H
+#define NET_COMPRESSOR_H
+
+#include "packet.h"
+
+#include <vector>
+#include <atomic>
+
+namespace net {
+
+	// The counters of a compressor, times in nanoseconds.
+	class CompressionStats {
+	public:
+		CompressionStats() : packets_(0), compressed_(0), inputBytes_(0), outputBytes_(0), compressTime_(0), decompressTime_(0) {
+		}
+
+		// The size after compression divided by the size before, of all packets.
+		double getRatio() const {
+			return inputBytes_ == 0 ? 1.0 : (double) outputBytes_ / inputBytes_;
+		}
+
+		long long packets_; // Packets passed to compress().
+		long long compressed_; // Packets sent compressed.
+		long long inputBytes_;
+		long long outputBytes_;
+		long long compressTime_;
+		long long decompressTime_;
+	};
+
+	// A fast compressor in the LZ4 style, i.e. byte aligned literals and matches
+	// found through a hash table, no entropy coding. A dictionary holding data
+	// common to many packets can be used, the same on both ends. Thread safe.
+	//
+	// A frame, i.e. the data of a compressed package:
+	// 1: FLAGS, 0 if not compressed, else COMPRESSED and DICTIONARY if used
+	// If compressed:
+	// SIZE, the size before compression as a varint (LEB128)
+	// Followed by the sequences:
+	// 1: TOKEN, bits 4 -> 7 the literal length, bits 0 -> 3 the match length - 4,
+	// 15 means more length bytes follow, each adds 0 -> 255 until one is below 255
+	// The literals.
+	// 2: OFFSET, 16 bit little-endian, the distance back to the match. The last
+	// sequence has only literals.
+	class Compressor {
+	public:
+		enum Flags : unsigned char {
+			COMPRESSED = 1,
+			DICTIONARY = 2
+		};
+
+		// Packets smaller than the threshold in bytes are not compressed.
+		Compressor(int threshold = 0, const std::vector<char>& dictionary = std::vector<char>());
+
+		// Append the frame of the data to the destination, compressed if it is at
+		// least the threshold and gets smaller.
+		void compress(const char* data, int size, std::vector<char>& destination) const;
+
+		// Read the frame to the packet. Return false if the frame is invalid or
+		// the data is larger than maxSize.
+		bool decompress(const char* frame, int size, int maxSize, Packet& packet) const;
+
+		CompressionStats getStats() const;
+
+	private:
+		static const int MIN_MATCH = 4;
+		static const int HASH_BITS = 12;
+		static const int MAX_OFFSET = 0xffff;
+
+		// Write the block, return false if it does not get smaller than the data.
+		bool compressBlock(const char* data, int size, std::vector<char>& destination) const;
+		bool decompressBlock(const char* block, int size, char* destination, int destinationSize) const;
+
+		int threshold_;
+		std::vector<char> dictionary_;
+		std::vector<int> dictionaryTable_; // The latest dictionary position of each hash, -1 if none.
+		mutable std::atomic<long long> packets_;
+		mutable std::atomic<long long> compressed_;
+		mutable std::atomic<long long> inputBytes_;
+		mutable std::atomic<long long> outputBytes_;
+		mutable std::atomic<long long> compressTime_;
+		mutable std::atomic<long long> decompressTime_;
+	};
+
+} // Namespace net.
+
+#endif // NET_COMPRESSOR_H
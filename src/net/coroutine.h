@@ -0,0 +1,492 @@
+#ifndef NET_COROUTINE_H
+#define NET_COROUTINE_H
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutine.h requires C++20 coroutines, build with NETWORK_COROUTINES"
+#endif
+
+#include "network.h"
+#include "server.h"
+#include "local.h"
+
+#include <coroutine>
+#include <optional>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+
+namespace net {
+
+	// A coroutine started at once and destroyed when it returns, i.e. it runs
+	// until the first co_await and is then resumed by a Scheduler.
+	class Task {
+	public:
+		class promise_type {
+		public:
+			Task get_return_object() {
+				return Task();
+			}
+
+			std::suspend_never initial_suspend() noexcept {
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept {
+				return {};
+			}
+
+			void return_void() {
+			}
+
+			void unhandled_exception() {
+				std::terminate();
+			}
+		};
+	};
+
+	// Awaitable network operations, e.g.
+	//
+	// net::Task serve(net::Scheduler& scheduler, net::Server& server) {
+	//     while (true) {
+	//         std::shared_ptr<net::Client> client = co_await scheduler.accept();
+	//         echo(scheduler, server, client); // One coroutine per client.
+	//     }
+	// }
+	//
+	// The scheduler owns the event handlers of the network, see Network::onConnect(),
+	// with QUEUED dispatch, and must be created before a server is created or a
+	// connection is made. The coroutines are resumed by poll(), the scheduler and
+	// its coroutines are used by one thread. Sending never blocks, i.e. the send
+	// functions of Server and Local are called as usual.
+	//
+	// The scheduler may be destroyed before the network. The coroutines still
+	// waiting are then destroyed without being resumed, and the events dispatched
+	// afterwards are dropped.
+	class Scheduler {
+	public:
+		explicit Scheduler(Network& network) : network_(network), state_(std::make_shared<State>(this)),
+			connecting_(nullptr), waiter_(nullptr), disconnected_(false) {
+
+			// The handlers are not changed while the network threads may read them,
+			// they reach the scheduler through the shared state instead.
+			std::shared_ptr<State> state = state_;
+			network.setDispatch(Network::QUEUED, [state]() {
+				std::lock_guard<std::mutex> lock(state->mutex_);
+				state->notified_ = true;
+				state->condition_.notify_one();
+			});
+			network.onConnect([state](const std::shared_ptr<Client>& client) {
+				if (state->scheduler_ != nullptr) {
+					state->scheduler_->handleConnect(client);
+				}
+			});
+			network.onDisconnect([state](const std::shared_ptr<Client>& client) {
+				if (state->scheduler_ != nullptr) {
+					state->scheduler_->handleDisconnect(client);
+				}
+			});
+			network.onMessage([state](const std::shared_ptr<Client>& sender, const Packet& packet) {
+				if (state->scheduler_ != nullptr) {
+					state->scheduler_->handleMessage(sender, packet);
+				}
+			});
+		}
+
+		~Scheduler() {
+			// Called by the thread calling poll(), i.e. not during dispatchEvents().
+			state_->scheduler_ = nullptr;
+			std::vector<std::coroutine_handle<>> handles;
+			handles.swap(ready_);
+			if (connecting_ != nullptr) {
+				handles.push_back(connecting_->handle_);
+			}
+			if (waiter_ != nullptr) {
+				handles.push_back(waiter_->handle_);
+			}
+			for (AcceptAwaiter* awaiter : accepting_) {
+				handles.push_back(awaiter->handle_);
+			}
+			for (MessageAwaiter* awaiter : receiving_) {
+				handles.push_back(awaiter->handle_);
+			}
+			for (auto& pair : clients_) {
+				handles.push_back(pair.second->handle_);
+			}
+			// The awaiters are stored in the frames.
+			connecting_ = nullptr;
+			waiter_ = nullptr;
+			accepting_.clear();
+			receiving_.clear();
+			clients_.clear();
+			for (std::coroutine_handle<> handle : handles) {
+				handle.destroy();
+			}
+		}
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator=(const Scheduler&) = delete;
+
+		// Resume the coroutines whose operations are done, first waiting up to the
+		// timeout in milliseconds for an event. Must not be called by a coroutine.
+		// Return the number of coroutines resumed.
+		int poll(int timeout = 0) {
+			{
+				State& state = *state_;
+				std::unique_lock<std::mutex> lock(state.mutex_);
+				if (timeout > 0) {
+					state.condition_.wait_for(lock, std::chrono::milliseconds(timeout), [&]() {
+						return state.notified_;
+					});
+				}
+				state.notified_ = false;
+			}
+			network_.dispatchEvents();
+			prune();
+			// Resumed after the events are handled, a resumed coroutine may await again.
+			std::vector<std::coroutine_handle<>> ready;
+			ready.swap(ready_);
+			for (std::coroutine_handle<> handle : ready) {
+				handle.resume();
+			}
+			return ready.size();
+		}
+
+		class ConnectAwaiter;
+		class AcceptAwaiter;
+		class MessageAwaiter;
+		class ClientAwaiter;
+		class ServerAwaiter;
+
+		// Connect to the remote server. Resumed with the local client when the
+		// handshake is done, null if the connection fails.
+		ConnectAwaiter connect(int port, const std::string& ip);
+
+		// Resumed with the next remote client connected to the server.
+		AcceptAwaiter accept();
+
+		// Resumed with the next packet received by the server and its sender, in
+		// the order received. Packets awaited by receive(client) are not included.
+		MessageAwaiter receive();
+
+		// Resumed with the next packet from the client, empty when the client is
+		// disconnected, also if it was disconnected before the call. One coroutine
+		// at a time awaits each client.
+		ClientAwaiter receive(const std::shared_ptr<Client>& client);
+
+		// Resumed with the next packet received by the local client from the remote
+		// server, empty when the connection is lost.
+		ServerAwaiter receiveFromServer();
+
+		class ConnectAwaiter {
+		public:
+			bool await_ready() const {
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) {
+				handle_ = handle;
+				scheduler_.connecting_ = this;
+				if (!scheduler_.network_.connectToServer(port_, ip_)) {
+					// Resumed at once with null.
+					scheduler_.connecting_ = nullptr;
+					return false;
+				}
+				return true;
+			}
+
+			std::shared_ptr<Local> await_resume() {
+				return local_;
+			}
+
+		private:
+			friend class Scheduler;
+
+			ConnectAwaiter(Scheduler& scheduler, int port, const std::string& ip) : scheduler_(scheduler), port_(port), ip_(ip) {
+			}
+
+			Scheduler& scheduler_;
+			int port_;
+			std::string ip_;
+			std::coroutine_handle<> handle_;
+			std::shared_ptr<Local> local_;
+		};
+
+		class AcceptAwaiter {
+		public:
+			bool await_ready() {
+				if (scheduler_.connections_.empty()) {
+					return false;
+				}
+				client_ = scheduler_.connections_.front();
+				scheduler_.connections_.pop_front();
+				return true;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				handle_ = handle;
+				scheduler_.accepting_.push_back(this);
+			}
+
+			std::shared_ptr<Client> await_resume() {
+				return client_;
+			}
+
+		private:
+			friend class Scheduler;
+
+			explicit AcceptAwaiter(Scheduler& scheduler) : scheduler_(scheduler) {
+			}
+
+			Scheduler& scheduler_;
+			std::coroutine_handle<> handle_;
+			std::shared_ptr<Client> client_;
+		};
+
+		class MessageAwaiter {
+		public:
+			bool await_ready() {
+				// The disconnects are kept for receive(client).
+				std::deque<Event>& pending = scheduler_.pending_;
+				for (auto it = pending.begin(); it != pending.end(); ++it) {
+					if (it->type_ == Event::MESSAGE) {
+						message_ = std::move(it->message_);
+						pending.erase(it);
+						return true;
+					}
+				}
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				handle_ = handle;
+				scheduler_.receiving_.push_back(this);
+			}
+
+			Message await_resume() {
+				return std::move(message_);
+			}
+
+		private:
+			friend class Scheduler;
+
+			explicit MessageAwaiter(Scheduler& scheduler) : scheduler_(scheduler) {
+			}
+
+			Scheduler& scheduler_;
+			std::coroutine_handle<> handle_;
+			Message message_;
+		};
+
+		class ClientAwaiter {
+		public:
+			bool await_ready() {
+				std::deque<Event>& pending = scheduler_.pending_;
+				for (auto it = pending.begin(); it != pending.end(); ++it) {
+					if (it->message_.sender_ == client_) {
+						if (it->type_ == Event::MESSAGE) {
+							packet_ = std::move(it->message_.packet_);
+						}
+						pending.erase(it);
+						return true;
+					}
+				}
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				handle_ = handle;
+				assert(scheduler_.clients_.count(client_.get()) == 0);
+				scheduler_.clients_[client_.get()] = this;
+			}
+
+			std::optional<Packet> await_resume() {
+				return std::move(packet_);
+			}
+
+		private:
+			friend class Scheduler;
+
+			ClientAwaiter(Scheduler& scheduler, const std::shared_ptr<Client>& client) : scheduler_(scheduler), client_(client) {
+			}
+
+			Scheduler& scheduler_;
+			std::shared_ptr<Client> client_;
+			std::coroutine_handle<> handle_;
+			std::optional<Packet> packet_;
+		};
+
+		class ServerAwaiter {
+		public:
+			bool await_ready() {
+				if (scheduler_.serverPackets_.empty()) {
+					return scheduler_.disconnected_;
+				}
+				packet_ = std::move(scheduler_.serverPackets_.front());
+				scheduler_.serverPackets_.pop_front();
+				return true;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle) {
+				handle_ = handle;
+				assert(scheduler_.waiter_ == nullptr);
+				scheduler_.waiter_ = this;
+			}
+
+			std::optional<Packet> await_resume() {
+				return std::move(packet_);
+			}
+
+		private:
+			friend class Scheduler;
+
+			explicit ServerAwaiter(Scheduler& scheduler) : scheduler_(scheduler) {
+			}
+
+			Scheduler& scheduler_;
+			std::coroutine_handle<> handle_;
+			std::optional<Packet> packet_; // Empty when the connection is lost.
+		};
+
+	private:
+		// Shared with the handlers, the network may outlive the scheduler.
+		class State {
+		public:
+			explicit State(Scheduler* scheduler) : scheduler_(scheduler), notified_(false) {
+			}
+
+			Scheduler* scheduler_; // Null when destroyed.
+			std::mutex mutex_;
+			std::condition_variable condition_;
+			bool notified_; // An event is queued, set by the network threads.
+		};
+
+		// Remove the disconnects no coroutine can await, i.e. the client is only
+		// referenced by the event and, if not yet accepted, by connections_. A
+		// client not accepted is then never accepted.
+		void prune() {
+			pending_.erase(std::remove_if(pending_.begin(), pending_.end(), [&](const Event& event) {
+				if (event.type_ != Event::DISCONNECT) {
+					return false;
+				}
+				const std::shared_ptr<Client>& client = event.message_.sender_;
+				auto it = std::find(connections_.begin(), connections_.end(), client);
+				if (client.use_count() != (it == connections_.end() ? 1 : 2)) {
+					return false;
+				}
+				if (it != connections_.end()) {
+					connections_.erase(it);
+				}
+				return true;
+			}), pending_.end());
+		}
+
+		void handleConnect(const std::shared_ptr<Client>& client) {
+			if (client == network_.getLocal()) {
+				disconnected_ = false;
+				if (ConnectAwaiter* awaiter = std::exchange(connecting_, nullptr)) {
+					awaiter->local_ = network_.getLocal();
+					ready_.push_back(awaiter->handle_);
+				}
+			} else if (!accepting_.empty()) {
+				AcceptAwaiter* awaiter = accepting_.front();
+				accepting_.pop_front();
+				awaiter->client_ = client;
+				ready_.push_back(awaiter->handle_);
+			} else {
+				connections_.push_back(client);
+			}
+		}
+
+		void handleDisconnect(const std::shared_ptr<Client>& client) {
+			if (client == network_.getLocal()) {
+				// Resumed with null or an empty packet.
+				disconnected_ = true;
+				if (ConnectAwaiter* awaiter = std::exchange(connecting_, nullptr)) {
+					ready_.push_back(awaiter->handle_);
+				}
+				if (ServerAwaiter* awaiter = std::exchange(waiter_, nullptr)) {
+					ready_.push_back(awaiter->handle_);
+				}
+				return;
+			}
+			auto it = clients_.find(client.get());
+			if (it != clients_.end()) {
+				ready_.push_back(it->second->handle_);
+				clients_.erase(it);
+			} else {
+				pending_.push_back(Event(Event::DISCONNECT, Message(client, Packet())));
+			}
+		}
+
+		void handleMessage(const std::shared_ptr<Client>& sender, const Packet& packet) {
+			if (sender == nullptr) {
+				// From the remote server.
+				if (ServerAwaiter* awaiter = std::exchange(waiter_, nullptr)) {
+					awaiter->packet_ = packet;
+					ready_.push_back(awaiter->handle_);
+				} else {
+					serverPackets_.push_back(packet);
+				}
+				return;
+			}
+			auto it = clients_.find(sender.get());
+			if (it != clients_.end()) {
+				it->second->packet_ = packet;
+				ready_.push_back(it->second->handle_);
+				clients_.erase(it);
+			} else if (!receiving_.empty()) {
+				MessageAwaiter* awaiter = receiving_.front();
+				receiving_.pop_front();
+				awaiter->message_ = Message(sender, Packet(packet));
+				ready_.push_back(awaiter->handle_);
+			} else {
+				pending_.push_back(Event(Event::MESSAGE, Message(sender, Packet(packet))));
+			}
+		}
+
+		Network& network_;
+		std::shared_ptr<State> state_;
+		std::vector<std::coroutine_handle<>> ready_; // Resumed by poll().
+		ConnectAwaiter* connecting_;
+		std::deque<AcceptAwaiter*> accepting_;
+		std::deque<std::shared_ptr<Client>> connections_; // Not yet accepted.
+		std::deque<MessageAwaiter*> receiving_;
+		std::unordered_map<Client*, ClientAwaiter*> clients_; // Awaiting receive(client).
+		std::deque<Event> pending_; // Messages and disconnects from clients not awaited.
+		ServerAwaiter* waiter_; // Awaiting receiveFromServer().
+		std::deque<Packet> serverPackets_;
+		bool disconnected_; // From the remote server.
+	};
+
+	inline Scheduler::ConnectAwaiter Scheduler::connect(int port, const std::string& ip) {
+		return ConnectAwaiter(*this, port, ip);
+	}
+
+	inline Scheduler::AcceptAwaiter Scheduler::accept() {
+		return AcceptAwaiter(*this);
+	}
+
+	inline Scheduler::MessageAwaiter Scheduler::receive() {
+		return MessageAwaiter(*this);
+	}
+
+	inline Scheduler::ClientAwaiter Scheduler::receive(const std::shared_ptr<Client>& client) {
+		return ClientAwaiter(*this, client);
+	}
+
+	inline Scheduler::ServerAwaiter Scheduler::receiveFromServer() {
+		return ServerAwaiter(*this);
+	}
+
+} // Namespace net.
+
+#endif // NET_COROUTINE_H
@@ -0,0 +1,380 @@
+#include "datagramconnection.h"
+#include "package.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace net {
+
+	namespace {
+
+		// Entry asking the remote to answer, i.e. to learn that the datagrams arrive.
+		const int PING_KIND = 0;
+
+		// Bit of the kind set for a fragment.
+		const int FRAGMENT_KIND = 0x80;
+
+		const int CHANNEL_MASK = 0x1f;
+
+		const int SEQUENCE_MASK = 0xffff;
+
+		// The difference a - b of two 16 bit sequences, handles the wrap around.
+		int difference(int a, int b) {
+			return (int) (int16_t) (uint16_t) (a - b);
+		}
+
+		void write16(char* destination, int value) {
+			destination[0] = (char) value;
+			destination[1] = (char) (value >> 8);
+		}
+
+		int read16(const RingBuffer& buffer, int index) {
+			return (unsigned char) buffer[index] | (unsigned char) buffer[index + 1] << 8;
+		}
+
+		// The size of the package starting the data, 0 if the header is not yet
+		// complete and -1 if it is invalid.
+		int getPackageSize(const std::vector<char>& data) {
+			unsigned int size = 0;
+			for (int i = 0; i < PackageHeader::MAX_VARINT_SIZE; ++i) {
+				if (i >= (int) data.size()) {
+					return 0;
+				}
+				unsigned char byte = data[i];
+				size |= (unsigned int) (byte & 0x7f) << (7 * i);
+				if ((byte & 0x80) == 0) {
+					if (size < PackageHeader::ID_SIZE || size > (unsigned int) std::numeric_limits<int>::max() - PackageHeader::MAX_VARINT_SIZE) {
+						return -1;
+					}
+					return i + 1 + (int) size;
+				}
+			}
+			return -1;
+		}
+
+	}
+
+	const int DatagramConnection::MAX_MESSAGES;
+	const int DatagramConnection::MESSAGE_WINDOW;
+
+	DatagramConnection::DatagramConnection(int maxPackageSize) {
+		started_ = false;
+		maxPackageSize_ = maxPackageSize;
+		maxFragmentedSize_ = 0;
+		queuedSize_ = 0;
+		sequence_ = 0;
+		remoteSequence_ = -1;
+		receivedBits_ = 0;
+		ackPending_ = false;
+		ping_ = false;
+		rtt_ = INITIAL_RTT;
+		resends_ = 0;
+	}
+
+	bool DatagramConnection::push(const Payload& package, Delivery delivery, int channel) {
+		if (delivery == STREAM || channel < 0 || channel >= MAX_CHANNELS) {
+			return false;
+		}
+		bool fragmented = package.size() > maxPackageSize_;
+		if (fragmented && (delivery != RELIABLE_ORDERED || maxPackageSize_ <= PackageHeader::MAX_SIZE)) {
+			return false;
+		}
+		if (delivery == UNRELIABLE) {
+			unreliable_.push_back(package);
+		} else {
+			if (channels_.empty()) {
+				channels_.resize(2 * MAX_CHANNELS);
+			}
+			Channel& reliable = channels_[getIndex(delivery, channel)];
+			if (!fragmented) {
+				queue(reliable, Message(package, false));
+			} else {
+				// Each fragment is a package of its own, i.e. framed as any entry.
+				int fragmentSize = maxPackageSize_ - PackageHeader::MAX_SIZE;
+				for (int index = 0; index < package.size(); index += fragmentSize) {
+					queue(reliable, Message(createPackage(0, package.data() + index, std::min(fragmentSize, package.size() - index)), true));
+				}
+			}
+		}
+		return true;
+	}
+
+	void DatagramConnection::setMaxFragmentedSize(int size) {
+		maxFragmentedSize_ = size;
+	}
+
+	void DatagramConnection::dropUnreliable() {
+		unreliable_.clear();
+	}
+
+	void DatagramConnection::ping() {
+		ping_ = true;
+	}
+
+	void DatagramConnection::write(DatagramQueue& datagrams, Clock::time_point time) {
+		started_ = false;
+		auto delay = std::chrono::microseconds((long long) (std::max(2 * rtt_, (double) MIN_RESEND_DELAY) * 1000));
+		for (int i = 0; i < (int) channels_.size(); ++i) {
+			Channel& channel = channels_[i];
+			int kind = (i < MAX_CHANNELS ? RELIABLE : RELIABLE_ORDERED) | (i % MAX_CHANNELS) << 2;
+			// Only the window, i.e. the receiver never holds more packages.
+			int nbr = std::min((int) channel.messages_.size(), MESSAGE_WINDOW);
+			for (int j = 0; j < nbr; ++j) {
+				Message& message = channel.messages_[j];
+				if (!message.acked_ && (!message.sent_ || time - message.time_ >= delay)) {
+					if (message.sent_) {
+						++resends_;
+					}
+					message.sent_ = true;
+					message.time_ = time;
+					add(datagrams, time, message.fragment_ ? kind | FRAGMENT_KIND : kind, message.id_, message.package_);
+					// Acked together with the datagram.
+					sent_[(sequence_ + SEQUENCE_MASK) % SENT_WINDOW].messages_.push_back(std::make_pair(i, message.id_));
+				}
+			}
+		}
+		for (const Payload& package : unreliable_) {
+			add(datagrams, time, UNRELIABLE, 0, package);
+		}
+		unreliable_.clear();
+		if (ping_) {
+			if (!started_ || !datagrams.fits(1)) {
+				begin(datagrams, time);
+			}
+			char kind = PING_KIND;
+			datagrams.append(&kind, 1);
+			ping_ = false;
+		} else if (!started_ && ackPending_) {
+			// Only the acks.
+			begin(datagrams, time);
+		}
+	}
+
+	bool DatagramConnection::read(const RingBuffer& buffer, Clock::time_point time, const Receiver& receiver) {
+		if (buffer.size() < HEADER_SIZE) {
+			return false;
+		}
+		receiveSequence(read16(buffer, 0));
+		int ackSequence = read16(buffer, 2);
+		unsigned int bits = (unsigned int) read16(buffer, 4) | (unsigned int) read16(buffer, 6) << 16;
+		for (int i = 0; i < ACK_BITS; ++i) {
+			if (bits & (1u << i)) {
+				ack((ackSequence - i) & SEQUENCE_MASK, time);
+			}
+		}
+		int index = HEADER_SIZE;
+		while (index < buffer.size()) {
+			int kind = (unsigned char) buffer[index++];
+			if (kind == PING_KIND) {
+				ackPending_ = true;
+				continue;
+			}
+			Delivery delivery = (Delivery) (kind & 3);
+			int channel = (kind >> 2) & CHANNEL_MASK;
+			bool fragment = (kind & FRAGMENT_KIND) != 0;
+			if (delivery == STREAM || channel >= MAX_CHANNELS || (fragment && delivery != RELIABLE_ORDERED)) {
+				return false;
+			}
+			int id = 0;
+			if (delivery != UNRELIABLE) {
+				if (buffer.size() - index < 2) {
+					return false;
+				}
+				id = read16(buffer, index);
+				index += 2;
+				// Acked by the next datagram sent.
+				ackPending_ = true;
+			}
+			PackageHeader header;
+			if (header.read(buffer, index, buffer.size()) != PackageHeader::WHOLE) {
+				return false;
+			}
+			// A fragment is only the data.
+			int offset = fragment ? header.headerSize_ : 0;
+			if (!receive(buffer.data(index + offset), header.size() - offset, delivery, channel, id, fragment, receiver)) {
+				return false;
+			}
+			index += header.size();
+		}
+		return true;
+	}
+
+	bool DatagramConnection::hasUnacked() const {
+		for (const Channel& channel : channels_) {
+			if (!channel.messages_.empty()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int DatagramConnection::getQueuedSize() const {
+		return queuedSize_;
+	}
+
+	double DatagramConnection::getRtt() const {
+		return rtt_;
+	}
+
+	long long DatagramConnection::getResends() const {
+		return resends_;
+	}
+
+	void DatagramConnection::begin(DatagramQueue& datagrams, Clock::time_point time) {
+		if (sent_.empty()) {
+			sent_.resize(SENT_WINDOW);
+		}
+		Sent& sent = sent_[sequence_ % SENT_WINDOW];
+		sent.sequence_ = sequence_;
+		sent.time_ = time;
+		sent.acked_ = false;
+		sent.messages_.clear();
+
+		char header[HEADER_SIZE];
+		write16(header, sequence_);
+		write16(header + 2, remoteSequence_ < 0 ? 0 : remoteSequence_);
+		write16(header + 4, (int) (receivedBits_ & 0xffff));
+		write16(header + 6, (int) (receivedBits_ >> 16));
+		datagrams.begin();
+		datagrams.append(header, HEADER_SIZE);
+		sequence_ = (sequence_ + 1) & SEQUENCE_MASK;
+		started_ = true;
+		ackPending_ = false;
+	}
+
+	void DatagramConnection::add(DatagramQueue& datagrams, Clock::time_point time, int kind, int id, const Payload& package) {
+		int entryHeaderSize = (kind & 3) == UNRELIABLE ? 1 : ENTRY_HEADER_SIZE;
+		if (!started_ || !datagrams.fits(entryHeaderSize + package.size())) {
+			begin(datagrams, time);
+		}
+		char entryHeader[ENTRY_HEADER_SIZE];
+		entryHeader[0] = (char) kind;
+		write16(entryHeader + 1, id);
+		datagrams.append(entryHeader, entryHeaderSize);
+		datagrams.append(package.data(), package.size());
+	}
+
+	void DatagramConnection::receiveSequence(int sequence) {
+		if (remoteSequence_ < 0) {
+			remoteSequence_ = sequence;
+			receivedBits_ = 1;
+			return;
+		}
+		int diff = difference(sequence, remoteSequence_);
+		if (diff > 0) {
+			receivedBits_ = diff < ACK_BITS ? receivedBits_ << diff | 1 : 1;
+			remoteSequence_ = sequence;
+		} else if (-diff < ACK_BITS) {
+			receivedBits_ |= 1u << -diff;
+		}
+	}
+
+	void DatagramConnection::ack(int sequence, Clock::time_point time) {
+		if (sent_.empty()) {
+			return;
+		}
+		Sent& sent = sent_[sequence % SENT_WINDOW];
+		if (sent.sequence_ != sequence || sent.acked_) {
+			return;
+		}
+		sent.acked_ = true;
+		double sample = std::chrono::duration<double, std::milli>(time - sent.time_).count();
+		rtt_ += (sample - rtt_) * 0.1;
+		for (const auto& acked : sent.messages_) {
+			Channel& channel = channels_[acked.first];
+			int offset = channel.messages_.empty() ? -1 : difference(acked.second, channel.messages_.front().id_);
+			if (offset >= 0 && offset < (int) channel.messages_.size()) {
+				channel.messages_[offset].acked_ = true;
+			}
+			while (!channel.messages_.empty() && channel.messages_.front().acked_) {
+				queuedSize_ -= channel.messages_.front().package_.size();
+				channel.messages_.pop_front();
+			}
+			number(channel);
+		}
+	}
+
+	bool DatagramConnection::receive(const char* data, int size, Delivery delivery, int channel, int id, bool fragment, const Receiver& receiver) {
+		if (delivery == UNRELIABLE) {
+			return receiver(data, size, delivery, channel);
+		}
+		if (channels_.empty()) {
+			channels_.resize(2 * MAX_CHANNELS);
+		}
+		Channel& reliable = channels_[getIndex(delivery, channel)];
+		if (delivery == RELIABLE) {
+			// Duplicates are ignored.
+			if (reliable.received_.empty()) {
+				reliable.received_.assign(MESSAGE_WINDOW, -1);
+			}
+			int& received = reliable.received_[id % MESSAGE_WINDOW];
+			if (received != id) {
+				received = id;
+				return receiver(data, size, delivery, channel);
+			}
+			return true;
+		}
+		int offset = difference(id, reliable.expectedId_);
+		if (offset == 0) {
+			if (!deliver(reliable, data, size, channel, fragment, receiver)) {
+				return false;
+			}
+			reliable.expectedId_ = (reliable.expectedId_ + 1) & SEQUENCE_MASK;
+			// Release the packages waiting for this one.
+			auto it = reliable.pending_.find(reliable.expectedId_);
+			while (it != reliable.pending_.end()) {
+				if (!deliver(reliable, it->second.second.data(), it->second.second.size(), channel, it->second.first, receiver)) {
+					return false;
+				}
+				reliable.pending_.erase(it);
+				reliable.expectedId_ = (reliable.expectedId_ + 1) & SEQUENCE_MASK;
+				it = reliable.pending_.find(reliable.expectedId_);
+			}
+		} else if (offset > 0 && offset < MESSAGE_WINDOW && reliable.pending_.count(id) == 0) {
+			reliable.pending_[id] = std::make_pair(fragment, std::vector<char>(data, data + size));
+		}
+		// Else already received.
+		return true;
+	}
+
+	void DatagramConnection::queue(Channel& channel, const Message& message) {
+		channel.waiting_.push_back(message);
+		queuedSize_ += message.package_.size();
+		number(channel);
+	}
+
+	void DatagramConnection::number(Channel& channel) {
+		while (!channel.waiting_.empty() && (int) channel.messages_.size() < MAX_MESSAGES) {
+			channel.messages_.push_back(channel.waiting_.front());
+			channel.waiting_.pop_front();
+			channel.messages_.back().id_ = channel.nextId_;
+			channel.nextId_ = (channel.nextId_ + 1) & SEQUENCE_MASK;
+		}
+	}
+
+	bool DatagramConnection::deliver(Channel& reliable, const char* data, int size, int channel, bool fragment, const Receiver& receiver) {
+		std::vector<char>& fragments = reliable.fragments_;
+		if (!fragment) {
+			// Never between the fragments of another package.
+			return fragments.empty() && receiver(data, size, RELIABLE_ORDERED, channel);
+		}
+		fragments.insert(fragments.end(), data, data + size);
+		int packageSize = getPackageSize(fragments);
+		if (packageSize < 0 || packageSize > maxFragmentedSize_) {
+			return false;
+		}
+		if (packageSize == 0 || (int) fragments.size() < packageSize) {
+			// Waiting for the next fragment.
+			return true;
+		}
+		bool valid = (int) fragments.size() == packageSize && receiver(fragments.data(), packageSize, RELIABLE_ORDERED, channel);
+		fragments.clear();
+		return valid;
+	}
+
+	int DatagramConnection::getIndex(Delivery delivery, int channel) {
+		return (delivery == RELIABLE ? 0 : MAX_CHANNELS) + channel;
+	}
+
+} // Namespace net.
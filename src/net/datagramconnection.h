@@ -0,0 +1,198 @@
+#ifndef NET_DATAGRAMCONNECTION_H
+#define NET_DATAGRAMCONNECTION_H
+
+#include "delivery.h"
+#include "payload.h"
+#include "ringbuffer.h"
+#include "datagramqueue.h"
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <chrono>
+#include <functional>
+
+namespace net {
+
+	// The datagram state of one connection, i.e. acks and resends of the reliable
+	// packages. Each datagram has a sequence number and acks the latest datagram
+	// received together with a bitfield of the 32 before, i.e. the acks are sent
+	// with the data and a lost ack is covered by the next datagram. A reliable
+	// package is resent until a datagram holding it is acked.
+	//
+	// Each channel has its own message sequence, i.e. a lost package only delays
+	// the later packages on the same ordered channel. An ordered package too big
+	// for a datagram is split into fragments, each sent as a message of its own.
+	//
+	// Byte, after the id and token of the datagram:
+	// 1 -> 2: SEQUENCE, 16 bit little-endian
+	// 3 -> 4: ACK, the latest sequence received
+	// 5 -> 8: ACK_BITS, bit i acks sequence ACK - i, none if 0
+	// Followed by the entries:
+	// 1: KIND, bits 0 -> 1 the delivery, bits 2 -> 6 the channel, bit 7 set for
+	// a fragment, 0 for a ping
+	// 2 -> 3: MESSAGE_ID, only for reliable deliveries
+	// Followed by the package, see package.h. A ping has no package and is
+	// answered by the next datagram, as are reliable packages. The data of the
+	// fragments of a package, in order, is the whole package.
+	class DatagramConnection {
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		// The number of channels of each reliable delivery.
+		static const int MAX_CHANNELS = 8;
+
+		// The size of the header written after the id and token.
+		static const int HEADER_SIZE = 8;
+
+		// The max size of the entry header before a package.
+		static const int ENTRY_HEADER_SIZE = 3;
+
+		// The max number of reliable packages numbered on a channel and not yet
+		// acked, well below half the message ids, i.e. an ack is never ambiguous.
+		// Later packages wait for the earlier ones to be acked.
+		static const int MAX_MESSAGES = 8192;
+
+		// Called with each package received, i.e. function(data, size, delivery, channel).
+		// Return false if the package is invalid.
+		typedef std::function<bool(const char*, int, Delivery, int)> Receiver;
+
+		// Packages bigger than maxPackageSize are sent as fragments if ordered,
+		// else they must be sent as a stream.
+		DatagramConnection(int maxPackageSize = 0);
+
+		// Queue the package, the delivery must not be STREAM. An ordered package
+		// too big for a datagram is sent as fragments. Return false if the channel
+		// is invalid or any other package is too big for a datagram.
+		bool push(const Payload& package, Delivery delivery, int channel);
+
+		// The max size of a package received as fragments, a bigger one makes the
+		// datagram invalid. None are received by default.
+		void setMaxFragmentedSize(int size);
+
+		// Remove the queued unreliable packages.
+		void dropUnreliable();
+
+		// Make the next write send a datagram asking the remote to answer, i.e. to
+		// learn that the datagrams arrive.
+		void ping();
+
+		// Write the unreliable packages, the reliable packages not yet sent or due
+		// to be resent, and the acks to the datagrams.
+		void write(DatagramQueue& datagrams, Clock::time_point time);
+
+		// Read the datagram in the buffer, without the id and token. The receiver
+		// is called for each package ready, ordered packages are held until the
+		// earlier ones are received. Return false if the datagram or a package is
+		// invalid, i.e. the receiver returned false.
+		bool read(const RingBuffer& buffer, Clock::time_point time, const Receiver& receiver);
+
+		// Return true if any reliable package is waiting to be acked.
+		bool hasUnacked() const;
+
+		// The size in bytes of the reliable packages waiting to be acked.
+		int getQueuedSize() const;
+
+		// The smoothed round trip time in milliseconds.
+		double getRtt() const;
+
+		// The number of reliable packages sent again.
+		long long getResends() const;
+
+	private:
+		// The max number of reliable packages in flight on a channel.
+		static const int MESSAGE_WINDOW = 512;
+
+		// The number of sent datagrams remembered, older ones are never acked.
+		static const int SENT_WINDOW = 256;
+
+		static const int ACK_BITS = 32;
+
+		// The round trip time used before the first ack.
+		static const int INITIAL_RTT = 100;
+
+		// Min time in milliseconds before a package is resent.
+		static const int MIN_RESEND_DELAY = 10;
+
+		class Message {
+		public:
+			Message(const Payload& package, bool fragment) : id_(0), package_(package), fragment_(fragment), sent_(false), acked_(false) {
+			}
+
+			int id_;
+			Payload package_;
+			bool fragment_; // The package holds the data of a fragment.
+			Clock::time_point time_; // When last sent.
+			bool sent_;
+			bool acked_;
+		};
+
+		class Channel {
+		public:
+			Channel() : nextId_(0), expectedId_(0) {
+			}
+
+			// Send side.
+			std::deque<Message> messages_; // Not yet acked, the front is the oldest.
+			std::deque<Message> waiting_; // Not yet numbered, messages_ is full.
+			int nextId_;
+
+			// Receive side.
+			int expectedId_; // Ordered, the next id to be received.
+			std::map<int, std::pair<bool, std::vector<char>>> pending_; // Ordered, received too early, true for a fragment.
+			std::vector<char> fragments_; // Ordered, the package being assembled.
+			std::vector<int> received_; // Unordered, the id received in each slot.
+		};
+
+		class Sent {
+		public:
+			Sent() : sequence_(-1), acked_(false) {
+			}
+
+			int sequence_;
+			Clock::time_point time_;
+			bool acked_;
+			std::vector<std::pair<int, int>> messages_; // Channel index and message id.
+		};
+
+		// Start a new datagram with the sequence and acks.
+		void begin(DatagramQueue& datagrams, Clock::time_point time);
+
+		// Add the package to the datagrams, a new datagram is started when needed.
+		void add(DatagramQueue& datagrams, Clock::time_point time, int kind, int id, const Payload& package);
+
+		void receiveSequence(int sequence);
+		void ack(int sequence, Clock::time_point time);
+		bool receive(const char* data, int size, Delivery delivery, int channel, int id, bool fragment, const Receiver& receiver);
+
+		// Queue the message, numbered when the channel has room.
+		void queue(Channel& channel, const Message& message);
+		// Number the waiting messages while fewer than MAX_MESSAGES are not acked.
+		void number(Channel& channel);
+
+		// Call the receiver with the ordered package, or add the fragment to the
+		// package being assembled.
+		bool deliver(Channel& reliable, const char* data, int size, int channel, bool fragment, const Receiver& receiver);
+
+		// The index in channels_ of the reliable delivery's channel.
+		static int getIndex(Delivery delivery, int channel);
+
+		std::vector<Channel> channels_; // RELIABLE then RELIABLE_ORDERED channels.
+		std::vector<Payload> unreliable_;
+		std::vector<Sent> sent_; // Indexed by sequence % SENT_WINDOW.
+		bool started_; // A datagram is started by the current write.
+		int maxPackageSize_;
+		int maxFragmentedSize_;
+		int queuedSize_; // The reliable packages not yet acked.
+		int sequence_; // The next sequence to be sent.
+		int remoteSequence_; // The latest sequence received, -1 if none.
+		unsigned int receivedBits_;
+		bool ackPending_;
+		bool ping_;
+		double rtt_;
+		long long resends_;
+	};
+
+} // Namespace net.
+
+#endif // NET_DATAGRAMCONNECTION_H
@@ -0,0 +1,106 @@
+#ifndef NET_DATAGRAMQUEUE_H
+#define NET_DATAGRAMQUEUE_H
+
+#include "transport.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace net {
+
+	// Packages batched into datagrams waiting to be sent to one address. A
+	// package is added to the last datagram as long as it fits, i.e. many small
+	// packages are sent as one datagram.
+	class DatagramQueue {
+	public:
+		// The datagrams are at most maxSize bytes and each one starts with the header.
+		DatagramQueue(int maxSize = 0) {
+			maxSize_ = maxSize;
+			headerSize_ = 0;
+		}
+
+		void setHeader(const char* header, int size) {
+			headerSize_ = size;
+			std::copy(header, header + size, header_);
+		}
+
+		// Add the package. Return false if it does not fit in a datagram.
+		bool push(const char* data, int size) {
+			if (headerSize_ + size > maxSize_) {
+				return false;
+			}
+			if (!fits(size)) {
+				begin();
+			}
+			append(data, size);
+			return true;
+		}
+
+		// Start a new datagram, i.e. only the header.
+		void begin() {
+			data_.insert(data_.end(), header_, header_ + headerSize_);
+			sizes_.push_back(headerSize_);
+		}
+
+		// Return true if the size fits in the last datagram.
+		bool fits(int size) const {
+			return !sizes_.empty() && sizes_.back() + size <= maxSize_;
+		}
+
+		// Add the data to the last datagram, which must exist.
+		void append(const char* data, int size) {
+			data_.insert(data_.end(), data, data + size);
+			sizes_.back() += size;
+		}
+
+		// The max size of a datagram.
+		int getMaxSize() const {
+			return maxSize_;
+		}
+
+		// The number of datagrams.
+		int size() const {
+			return sizes_.size();
+		}
+
+		bool empty() const {
+			return sizes_.empty();
+		}
+
+		// The number of bytes of all datagrams.
+		int bytes() const {
+			return data_.size();
+		}
+
+		// Fill the datagrams with the queued ones, sent to the address. The data
+		// is valid until the queue is changed.
+		void fill(Datagram* datagrams, const Address& address) {
+			char* data = data_.data();
+			for (int size : sizes_) {
+				datagrams->address_ = address;
+				datagrams->data_ = data;
+				datagrams->size_ = size;
+				data += size;
+				++datagrams;
+			}
+		}
+
+		// Remove all datagrams, the memory is kept.
+		void clear() {
+			data_.clear();
+			sizes_.clear();
+		}
+
+	private:
+		static const int MAX_HEADER_SIZE = 16;
+
+		std::vector<char> data_;
+		std::vector<int> sizes_;
+		char header_[MAX_HEADER_SIZE];
+		int headerSize_;
+		int maxSize_;
+	};
+
+} // Namespace net.
+
+#endif // NET_DATAGRAMQUEUE_H
@@ -0,0 +1,36 @@
+#ifndef NET_DELIVERY_H
+#define NET_DELIVERY_H
+
+#include "payload.h"
+
+namespace net {
+
+	// How a packet is sent.
+	enum Delivery {
+		STREAM,				// Over tcp, reliable and ordered. All packets share one stream.
+		UNRELIABLE,			// As a datagram, may be lost, duplicated or arrive out of order.
+		RELIABLE,			// As a datagram, resent until acknowledged, may arrive out of order.
+		RELIABLE_ORDERED	// As a datagram, resent until acknowledged and received in the order sent on the channel.
+	};
+
+	// A package to be sent by a network thread, to one, a group or all clients.
+	class Outgoing {
+	public:
+		Outgoing() : receiverId_(0), delivery_(STREAM), channel_(0), x_(0), y_(0), group_(0) {
+		}
+
+		Outgoing(int receiverId, const Payload& payload, Delivery delivery, int channel)
+			: receiverId_(receiverId), payload_(payload), delivery_(delivery), channel_(channel), x_(0), y_(0), group_(0) {
+		}
+
+		int receiverId_;
+		Payload payload_;
+		Delivery delivery_;
+		int channel_;
+		float x_, y_; // The location, only of a package sent to an area.
+		int group_; // Only of a package sent to a group.
+	};
+
+} // Namespace net.
+
+#endif // NET_DELIVERY_H
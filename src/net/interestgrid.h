@@ -0,0 +1,171 @@
+#ifndef NET_INTERESTGRID_H
+#define NET_INTERESTGRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+namespace net {
+
+	// The area each client is interested in, a circle around its position. Each
+	// client is stored in the cells of a uniform grid overlapped by its area, i.e.
+	// a location is looked up in one cell and the cost scales with the number of
+	// clients near it, not with all clients. Moving within the same cells only
+	// updates the circle, else only the cells entered or left are changed. An
+	// area spanning more than MAX_CELLS cells per side, e.g. a huge or non-finite
+	// radius, is kept in one list checked by every query instead.
+	// Not thread safe.
+	class InterestGrid {
+	public:
+		static const int MAX_CELLS = 32;
+
+		InterestGrid(float cellSize = 64) {
+			cellSize_ = cellSize;
+		}
+
+		// Set the area of the client, a radius below 0 removes it.
+		void set(int id, float x, float y, float radius) {
+			if (radius < 0) {
+				remove(id);
+				return;
+			}
+			Area area;
+			area.x_ = x;
+			area.y_ = y;
+			area.radius_ = radius;
+			area.everywhere_ = !getCell(x - radius, area.minX_) || !getCell(y - radius, area.minY_)
+				|| !getCell(x + radius, area.maxX_) || !getCell(y + radius, area.maxY_)
+				|| area.maxX_ - area.minX_ >= MAX_CELLS || area.maxY_ - area.minY_ >= MAX_CELLS;
+			auto it = areas_.find(id);
+			if (it == areas_.end()) {
+				addCells(id, area, nullptr);
+				areas_[id] = area;
+				return;
+			}
+			Area& old = it->second;
+			// Only the cells changed when both areas are stored in cells.
+			bool cells = !old.everywhere_ && !area.everywhere_;
+			if (old.everywhere_ != area.everywhere_ || (cells && (area.minX_ != old.minX_
+				|| area.minY_ != old.minY_ || area.maxX_ != old.maxX_ || area.maxY_ != old.maxY_))) {
+
+				removeCells(id, old, cells ? &area : nullptr);
+				addCells(id, area, cells ? &old : nullptr);
+			}
+			old = area;
+		}
+
+		void remove(int id) {
+			auto it = areas_.find(id);
+			if (it != areas_.end()) {
+				removeCells(id, it->second, nullptr);
+				areas_.erase(it);
+			}
+		}
+
+		// Call the function, i.e. function(id), for each client whose area holds
+		// the location.
+		template <class Function>
+		void query(float x, float y, Function&& function) const {
+			int cellX, cellY;
+			if (getCell(x, cellX) && getCell(y, cellY)) {
+				auto cell = cells_.find(getKey(cellX, cellY));
+				if (cell != cells_.end()) {
+					for (int id : cell->second) {
+						check(id, x, y, function);
+					}
+				}
+			}
+			for (int id : everywhere_) {
+				check(id, x, y, function);
+			}
+		}
+
+		// The number of clients with an area.
+		int size() const {
+			return areas_.size();
+		}
+
+	private:
+		class Area {
+		public:
+			float x_, y_, radius_;
+			int minX_, minY_, maxX_, maxY_; // The cells overlapped.
+			bool everywhere_; // Not stored in the cells.
+
+			bool contains(int cellX, int cellY) const {
+				return cellX >= minX_ && cellX <= maxX_ && cellY >= minY_ && cellY <= maxY_;
+			}
+		};
+
+		// Return false if the cell is not finite or too far away to be stored.
+		bool getCell(float coordinate, int& cell) const {
+			float value = std::floor(coordinate / cellSize_);
+			if (!(std::abs(value) < (float) (1 << 30))) {
+				return false;
+			}
+			cell = (int) value;
+			return true;
+		}
+
+		template <class Function>
+		void check(int id, float x, float y, Function& function) const {
+			const Area& area = areas_.find(id)->second;
+			float dx = x - area.x_;
+			float dy = y - area.y_;
+			if (dx * dx + dy * dy <= area.radius_ * area.radius_) {
+				function(id);
+			}
+		}
+
+		static long long getKey(int cellX, int cellY) {
+			return (long long) ((unsigned long long) (unsigned int) cellX << 32 | (unsigned int) cellY);
+		}
+
+		// Add the client to the cells of the area, except the ones in the skipped area.
+		void addCells(int id, const Area& area, const Area* skipped) {
+			if (area.everywhere_) {
+				everywhere_.push_back(id);
+				return;
+			}
+			for (int x = area.minX_; x <= area.maxX_; ++x) {
+				for (int y = area.minY_; y <= area.maxY_; ++y) {
+					if (skipped == nullptr || !skipped->contains(x, y)) {
+						cells_[getKey(x, y)].push_back(id);
+					}
+				}
+			}
+		}
+
+		// Remove the client from the cells of the area, except the ones in the kept area.
+		void removeCells(int id, const Area& area, const Area* kept) {
+			if (area.everywhere_) {
+				*std::find(everywhere_.begin(), everywhere_.end(), id) = everywhere_.back();
+				everywhere_.pop_back();
+				return;
+			}
+			for (int x = area.minX_; x <= area.maxX_; ++x) {
+				for (int y = area.minY_; y <= area.maxY_; ++y) {
+					if (kept != nullptr && kept->contains(x, y)) {
+						continue;
+					}
+					auto cell = cells_.find(getKey(x, y));
+					std::vector<int>& ids = cell->second;
+					*std::find(ids.begin(), ids.end(), id) = ids.back();
+					ids.pop_back();
+					if (ids.empty()) {
+						cells_.erase(cell);
+					}
+				}
+			}
+		}
+
+		float cellSize_;
+		std::unordered_map<long long, std::vector<int>> cells_; // The ids of the clients interested in each cell.
+		std::unordered_map<int, Area> areas_; // Indexed by client id.
+		std::vector<int> everywhere_; // The ids of the clients not stored in the cells.
+	};
+
+} // Namespace net.
+
+#endif // NET_INTERESTGRID_H
@@ -9,35 +9,49 @@ namespace net {
 	}
 
 	bool Local::pullReceiveData(Packet& packet) {
-		std::lock_guard<std::mutex> lock(network_->mutex_);
-		if (receiveBuffer_.size() > 2) {
-			int size = receiveBuffer_[0];
-			int remoteId = receiveBuffer_[1];
-			packet = Packet(receiveBuffer_.data() + 2, size - 2);
-			receiveBuffer_.erase(receiveBuffer_.begin(), receiveBuffer_.begin() + size);
+		Message message;
+		if (receiveBuffer_.pop(message)) {
+			packet = std::move(message.packet_);
 			return true;
 		}
 		return false;
 	}
 
 	void Local::sendToAll(const Packet& packet) {
-		network_->sendToAll(getId(), packet);
+		network_->sendToAll(getId(), packet, STREAM, 0);
 	}
 
 	void Local::sendToServer(const Packet& packet) {
-		network_->sendToServer(getId(), packet);
+		network_->sendToServer(packet, STREAM, 0);
+	}
+
+	void Local::sendToAllUnreliable(const Packet& packet) {
+		network_->sendToAll(getId(), packet, UNRELIABLE, 0);
+	}
+
+	void Local::sendToServerUnreliable(const Packet& packet) {
+		network_->sendToServer(packet, UNRELIABLE, 0);
+	}
+
+	void Local::sendToAll(const Packet& packet, Delivery delivery, int channel) {
+		network_->sendToAll(getId(), packet, delivery, channel);
+	}
+
+	void Local::sendToServer(const Packet& packet, Delivery delivery, int channel) {
+		network_->sendToServer(packet, delivery, channel);
 	}
 
 	bool Local::pullReceiveDataFromServer(Packet& packet) {
-		std::lock_guard<std::mutex> lock(network_->mutex_);
-		if (serverReceiveBuffer_.size() > 2) {
-			int size = serverReceiveBuffer_[0];
-			int remoteId = serverReceiveBuffer_[1];
-			packet = Packet(serverReceiveBuffer_.data() + 2, size - 2);
-			serverReceiveBuffer_.erase(serverReceiveBuffer_.begin(), serverReceiveBuffer_.begin() + size);
+		Message message;
+		if (serverReceiveBuffer_.pop(message)) {
+			packet = std::move(message.packet_);
 			return true;
 		}
 		return false;
 	}
 
+	bool Local::pullSnapshot(Packet& packet) {
+		return snapshotBuffer_.pop(packet);
+	}
+
 } // Namespace net.
@@ -2,8 +2,10 @@
 #define NET_LOCAL_H
 
 #include "client.h"
-
-#include <vector>
+#include "payload.h"
+#include "message.h"
+#include "mpscqueue.h"
+#include "delivery.h"
 
 namespace net {
 
@@ -21,12 +23,52 @@ namespace net {
 
 		void sendToServer(const Packet& packet);
 
+		// Send the packet as a datagram, i.e. it may be lost or arrive out of order
+		// but is never delayed by lost packets. Packets too big for a datagram, and
+		// packets sent before the connection is made, are streamed but received
+		// with their delivery and channel.
+		void sendToAllUnreliable(const Packet& packet);
+
+		void sendToServerUnreliable(const Packet& packet);
+
+		// Send the packet with the delivery. Reliable datagrams on one channel are
+		// never delayed by lost datagrams on another channel, the channel must be
+		// in [0, DatagramConnection::MAX_CHANNELS).
+		void sendToAll(const Packet& packet, Delivery delivery, int channel = 0);
+
+		void sendToServer(const Packet& packet, Delivery delivery, int channel = 0);
+
 		bool pullReceiveDataFromServer(Packet& packet);
 
+		// Pull the next snapshot sent by the server, already reconstructed from
+		// the delta. Snapshots may be lost but are never pulled out of order.
+		bool pullSnapshot(Packet& packet);
+
+		// Call the function, i.e. function(packet), for each packet received from
+		// the other clients. The packet is not copied and is only valid during
+		// the call. Return the number of packets.
+		template <class Function>
+		int pullAll(Function&& function) {
+			return receiveBuffer_.popAll([&](Message& message) {
+				function(message.packet_);
+			});
+		}
+
+		// Same as pullAll but for the packets received from the server.
+		template <class Function>
+		int pullAllFromServer(Function&& function) {
+			return serverReceiveBuffer_.popAll([&](Message& message) {
+				function(message.packet_);
+			});
+		}
+
 	private:
 		Network* network_;
-		std::vector<char> sendBuffer_;
-		std::vector<char> serverReceiveBuffer_;
+		// Packages to be sent by the network thread.
+		MpscQueue<Payload> sendBuffer_;
+		MpscQueue<Outgoing> datagramSendBuffer_;
+		MpscQueue<Message> serverReceiveBuffer_;
+		MpscQueue<Packet> snapshotBuffer_;
 	};
 
 } // Namespace net.
@@ -0,0 +1,50 @@
+#ifndef NET_MESSAGE_H
+#define NET_MESSAGE_H
+
+#include "packet.h"
+#include "delivery.h"
+
+#include <memory>
+
+namespace net {
+
+	class Client;
+
+	// A received packet and the client which sent it.
+	class Message {
+	public:
+		Message() : delivery_(STREAM), channel_(0) {
+		}
+
+		Message(const std::shared_ptr<Client>& sender, Packet&& packet, Delivery delivery = STREAM, int channel = 0)
+			: sender_(sender), packet_(std::move(packet)), delivery_(delivery), channel_(channel) {
+		}
+
+		std::shared_ptr<Client> sender_;
+		Packet packet_;
+		Delivery delivery_; // How the packet was received.
+		int channel_;
+	};
+
+	// A client connected or disconnected, or a received message, see Network::onConnect().
+	class Event {
+	public:
+		enum Type {
+			CONNECT,
+			DISCONNECT,
+			MESSAGE
+		};
+
+		Event() : type_(MESSAGE) {
+		}
+
+		Event(Type type, Message&& message) : type_(type), message_(std::move(message)) {
+		}
+
+		Type type_;
+		Message message_; // The client, and the packet of a message.
+	};
+
+} // Namespace net.
+
+#endif // NET_MESSAGE_H
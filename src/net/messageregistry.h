@@ -0,0 +1,299 @@
+#ifndef NET_MESSAGEREGISTRY_H
+#define NET_MESSAGEREGISTRY_H
+
+#include "packet.h"
+#include "server.h"
+#include "local.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+// Declare the fields of a message in the order they are encoded, see
+// MessageRegistry. A field is a trivially copyable type, a std::string or a
+// std::vector of a trivially copyable type.
+#define NET_FIELDS(...) \
+	template <class Function> \
+	void fields(Function&& function) { \
+		function(__VA_ARGS__); \
+	} \
+	template <class Function> \
+	void fields(Function&& function) const { \
+		function(__VA_ARGS__); \
+	}
+
+namespace net {
+
+	// Write the fields of a message to the packet, see NET_FIELDS.
+	class FieldWriter {
+	public:
+		explicit FieldWriter(Packet& packet) : packet_(packet) {
+		}
+
+		template <class... Fields>
+		void operator()(const Fields&... fields) {
+			int expand[] = {0, (write(fields), 0)...};
+			(void) expand;
+		}
+
+	private:
+		template <class T>
+		void write(const T& value) {
+			packet_.write(value);
+		}
+
+		void write(const std::string& value) {
+			packet_.writeVarint(value.size());
+			packet_.write(value.data(), value.size());
+		}
+
+		template <class T>
+		void write(const std::vector<T>& values) {
+			packet_.writeVarint(values.size());
+			packet_.write(values.data(), values.size());
+		}
+
+		Packet& packet_;
+	};
+
+	// Read the fields of a message from the packet, a field not available marks
+	// the packet as failed.
+	class FieldReader {
+	public:
+		explicit FieldReader(Packet& packet) : packet_(packet) {
+		}
+
+		template <class... Fields>
+		void operator()(Fields&... fields) {
+			int expand[] = {0, (read(fields), 0)...};
+			(void) expand;
+		}
+
+	private:
+		template <class T>
+		void read(T& value) {
+			packet_.read(value);
+		}
+
+		void read(std::string& value) {
+			uint64_t size;
+			if (readSize(size, 1)) {
+				value.resize(size);
+				packet_.read(&value[0], size);
+			}
+		}
+
+		template <class T>
+		void read(std::vector<T>& values) {
+			uint64_t size;
+			if (readSize(size, sizeof(T))) {
+				values.resize(size);
+				packet_.read(values.data(), size);
+			}
+		}
+
+		// Read the number of elements. Fails, without allocating, if there is
+		// not enough data left for them.
+		bool readSize(uint64_t& size, int elementSize) {
+			if (!packet_.readVarint(size)) {
+				return false;
+			}
+			if (size > packet_.dataLeftToRead() / elementSize) {
+				packet_.fail();
+				return false;
+			}
+			return true;
+		}
+
+		Packet& packet_;
+	};
+
+	// The largest id of the messages.
+	template <class... Messages>
+	class MaxMessageId : public std::integral_constant<int, -1> {
+	};
+
+	template <class Message, class... Messages>
+	class MaxMessageId<Message, Messages...> : public std::integral_constant<int,
+		(Message::ID > MaxMessageId<Messages...>::value ? Message::ID : MaxMessageId<Messages...>::value)> {
+	};
+
+	// True if any of the messages has the id.
+	template <int Id, class... Messages>
+	class HasMessageId : public std::false_type {
+	};
+
+	template <int Id, class Message, class... Messages>
+	class HasMessageId<Id, Message, Messages...> : public std::integral_constant<bool,
+		Message::ID == Id || HasMessageId<Id, Messages...>::value> {
+	};
+
+	template <class... Messages>
+	class UniqueMessageIds : public std::true_type {
+	};
+
+	template <class Message, class... Messages>
+	class UniqueMessageIds<Message, Messages...> : public std::integral_constant<bool,
+		!HasMessageId<Message::ID, Messages...>::value && UniqueMessageIds<Messages...>::value> {
+	};
+
+	// The message with the id, void if none.
+	template <int Id, class... Messages>
+	class FindMessage {
+	public:
+		typedef void type;
+	};
+
+	template <int Id, class Message, class... Messages>
+	class FindMessage<Id, Message, Messages...> {
+	public:
+		typedef typename std::conditional<Message::ID == Id, Message, typename FindMessage<Id, Messages...>::type>::type type;
+	};
+
+	template <int... Indexes>
+	class IndexSequence {
+	};
+
+	template <int N, int... Indexes>
+	class MakeIndexSequence : public MakeIndexSequence<N - 1, N - 1, Indexes...> {
+	};
+
+	template <int... Indexes>
+	class MakeIndexSequence<0, Indexes...> {
+	public:
+		typedef IndexSequence<Indexes...> type;
+	};
+
+	// Decode the message and call handler(message, args...), if the handler takes
+	// the message. Return false if the data is invalid or the message not handled.
+	template <class Message, class Handler, class... Args>
+	class MessageDecoder {
+	public:
+		static bool decode(Packet& packet, Handler& handler, const Args&... args) {
+			Message message;
+			message.fields(FieldReader(packet));
+			return !packet.failed() && call(handler, message, 0, args...);
+		}
+
+	private:
+		template <class H>
+		static auto call(H& handler, const Message& message, int, const Args&... args) -> decltype(handler(message, args...), bool()) {
+			handler(message, args...);
+			return true;
+		}
+
+		template <class H>
+		static bool call(H&, const Message&, long, const Args&...) {
+			return false;
+		}
+	};
+
+	// No message has the id.
+	template <class Handler, class... Args>
+	class MessageDecoder<void, Handler, Args...> {
+	public:
+		static constexpr bool (*decode)(Packet&, Handler&, const Args&...) = nullptr;
+	};
+
+	template <class Handler, class... Args>
+	constexpr bool (*MessageDecoder<void, Handler, Args...>::decode)(Packet&, Handler&, const Args&...);
+
+	// Typed messages sent as packets. A message is a default constructible type
+	// with a compile-time id in [0, 255], e.g.
+	//
+	// struct Move {
+	//     static const int ID = 1;
+	//     float x, y;
+	//     NET_FIELDS(x, y)
+	// };
+	//
+	// typedef net::MessageRegistry<Move, Chat> Messages;
+	//
+	// A packet holds the id in the first byte followed by the fields, encoded by
+	// the Packet write functions. A received packet is decoded by the function
+	// at its id in a table built at compile time for each handler type, i.e. one
+	// indirect call without virtual calls or heap allocations, and handed to the
+	// handler's overload for the message type.
+	template <class... Messages>
+	class MessageRegistry {
+	public:
+		static_assert(UniqueMessageIds<Messages...>::value, "Two messages have the same id");
+		static_assert(MaxMessageId<Messages...>::value < 256, "A message id must be in [0, 255]");
+
+		// The size of the dispatch table, i.e. the largest id plus one.
+		static const int SIZE = MaxMessageId<Messages...>::value + 1;
+
+		// Append the message to the packet.
+		template <class Message>
+		static void encode(const Message& message, Packet& packet) {
+			static_assert(Message::ID >= 0 && HasMessageId<Message::ID, Messages...>::value
+				&& std::is_same<typename FindMessage<Message::ID, Messages...>::type, Message>::value, "The message is not registered");
+			packet.write((uint8_t) Message::ID);
+			message.fields(FieldWriter(packet));
+		}
+
+		template <class Message>
+		static Packet encode(const Message& message) {
+			Packet packet;
+			encode(message, packet);
+			return packet;
+		}
+
+		// Read the id and call handler(message, args...) with the decoded message.
+		// The handler has an overload for each message handled, the others are
+		// skipped. Return false if the id is unknown, the data is invalid or the
+		// message is not handled.
+		template <class Handler, class... Args>
+		static bool dispatch(Packet& packet, Handler& handler, const Args&... args) {
+			uint8_t id;
+			if (!packet.read(id) || id >= SIZE) {
+				return false;
+			}
+			auto decode = DispatchTable<typename MakeIndexSequence<SIZE>::type, Handler, Args...>::get()[id];
+			return decode != nullptr && decode(packet, handler, args...);
+		}
+
+		// Dispatch each packet received by the server, i.e. handler(message, sender).
+		// Return the number of packets.
+		template <class Handler>
+		static int pullAll(Server& server, Handler& handler) {
+			return server.pullAll([&](const std::shared_ptr<Client>& sender, Packet& packet) {
+				dispatch(packet, handler, sender);
+			});
+		}
+
+		// Dispatch each packet received by the local client from the server, i.e.
+		// handler(message). Return the number of packets.
+		template <class Handler>
+		static int pullAllFromServer(Local& local, Handler& handler) {
+			return local.pullAllFromServer([&](Packet& packet) {
+				dispatch(packet, handler);
+			});
+		}
+
+	private:
+		// The decode function of each id, null for the ids not used.
+		template <class Sequence, class Handler, class... Args>
+		class DispatchTable;
+
+		template <int... Ids, class Handler, class... Args>
+		class DispatchTable<IndexSequence<Ids...>, Handler, Args...> {
+		public:
+			typedef bool (*Decode)(Packet&, Handler&, const Args&...);
+
+			static const std::array<Decode, SIZE>& get() {
+				// Constant initialized, i.e. no guard on the first call.
+				static const std::array<Decode, SIZE> table = {{
+					MessageDecoder<typename FindMessage<Ids, Messages...>::type, Handler, Args...>::decode...
+				}};
+				return table;
+			}
+		};
+	};
+
+} // Namespace net.
+
+#endif // NET_MESSAGEREGISTRY_H
@@ -0,0 +1,96 @@
+#ifndef NET_MPSCQUEUE_H
+#define NET_MPSCQUEUE_H
+
+#include "bufferpool.h"
+
+#include <atomic>
+#include <new>
+
+namespace net {
+
+	// Unbounded lock-free queue with many producer threads and one consumer thread.
+	// Each value is stored in a node linked from the previous one (Vyukov's queue),
+	// a push is one atomic exchange. The nodes are chunks of the buffer pool, i.e.
+	// a node freed by the consumer is reused by the producers.
+	template <class T>
+	class MpscQueue {
+	public:
+		MpscQueue() {
+			Node* stub = createNode();
+			head_.store(stub, std::memory_order_relaxed);
+			tail_ = stub;
+		}
+
+		~MpscQueue() {
+			while (tail_ != nullptr) {
+				Node* next = tail_->next_.load(std::memory_order_relaxed);
+				destroyNode(tail_);
+				tail_ = next;
+			}
+		}
+
+		MpscQueue(const MpscQueue&) = delete;
+		MpscQueue& operator=(const MpscQueue&) = delete;
+
+		// Thread safe.
+		void push(T&& value) {
+			Node* node = createNode();
+			node->value_ = std::move(value);
+			Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+			previous->next_.store(node, std::memory_order_release);
+		}
+
+		// Called by the consumer thread. Return false if the queue is empty.
+		bool pop(T& value) {
+			Node* next = tail_->next_.load(std::memory_order_acquire);
+			if (next == nullptr) {
+				return false;
+			}
+			value = std::move(next->value_);
+			destroyNode(tail_);
+			tail_ = next;
+			return true;
+		}
+
+		// Called by the consumer thread. Call the function for each value in the
+		// queue without moving it out of the queue. The value is only valid during
+		// the call. Return the number of values.
+		template <class Function>
+		int popAll(Function&& function) {
+			int nbr = 0;
+			while (Node* next = tail_->next_.load(std::memory_order_acquire)) {
+				function(next->value_);
+				next->value_ = T(); // Else kept by the node until the next pop.
+				destroyNode(tail_);
+				tail_ = next;
+				++nbr;
+			}
+			return nbr;
+		}
+
+	private:
+		class Node {
+		public:
+			Node() : next_(nullptr) {
+			}
+
+			std::atomic<Node*> next_;
+			T value_;
+		};
+
+		static Node* createNode() {
+			return new (BufferPool::allocate(sizeof(Node))) Node();
+		}
+
+		static void destroyNode(Node* node) {
+			node->~Node();
+			BufferPool::deallocate(node, sizeof(Node));
+		}
+
+		std::atomic<Node*> head_; // Producers.
+		Node* tail_; // Consumer.
+	};
+
+} // Namespace net.
+
+#endif // NET_MPSCQUEUE_H
@@ -4,45 +4,160 @@
 #include "local.h"
 #include "server.h"
 #include "remote.h"
+#include "package.h"
+#include "bufferpool.h"
 
-#include <SDL_net.h>
+#ifdef NET_SDL_NET
+#include "sdltransport.h"
+#else
+#include "posixtransport.h"
+#endif
 
 #include <array>
+#include <algorithm>
+#include <map>
+#include <cstdio>
 
 namespace net {
 
-	Network::Network() {
+	namespace {
+
+		// The max number of sockets of a SDL_net socket set, i.e. the select() limit.
+		const int SDL_MAX_SOCKETS = 1024;
+
+		std::vector<std::unique_ptr<Transport>> createDefaultTransports(int maxSockets, int workers) {
+			std::vector<std::unique_ptr<Transport>> transports;
+#ifdef NET_SDL_NET
+			// SDL_net can not share a listen port between sockets.
+			transports.push_back(std::unique_ptr<Transport>(new SdlTransport(maxSockets)));
+#else
+			(void) maxSockets; // Epoll has no socket limit.
+			for (int i = 0; i < workers; ++i) {
+				transports.push_back(std::unique_ptr<Transport>(new PosixTransport(0, 0, true, workers > 1)));
+			}
+#endif
+			return transports;
+		}
+
+		std::vector<std::unique_ptr<Transport>> createTransports(std::unique_ptr<Transport> transport) {
+			std::vector<std::unique_ptr<Transport>> transports;
+			transports.push_back(std::move(transport));
+			return transports;
+		}
+
+		long long nanoseconds(std::chrono::steady_clock::duration duration) {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+		}
+
+	}
+
+	const int Network::ALL_ID;
+	const int Network::LOCAL_ID;
+	const int Network::HELLO_INTERVAL;
+	const int Network::RESEND_INTERVAL;
+	const int Network::SNAPSHOT_ID;
+	const int Network::AREA_ID;
+	const int Network::INTEREST_ID;
+	const int Network::GROUP_ID;
+	const int Network::MEMBER_ID;
+	const int Network::CHANNEL_ID;
+	const int Network::CHANNEL_HEADER_SIZE;
+	const int Network::WAIT_TIMEOUT;
+
+	Network::Network() : Network(1) {
+	}
+
+	Network::Network(int workers) : Network(createDefaultTransports(SDL_MAX_SOCKETS, workers)) {
+	}
+
+	Network::Network(std::unique_ptr<Transport> transport) : Network(createTransports(std::move(transport))) {
+	}
+
+	Network::Network(std::vector<std::unique_ptr<Transport>> transports) {
+		for (auto& transport : transports) {
+			workers_.push_back(std::unique_ptr<Worker>(new Worker(std::move(transport), workers_.size(), transports.size())));
+		}
 		server_ = nullptr;
 		local_ = nullptr;
-		listenSocket_ = nullptr;
-		socketSet_ = nullptr;
-		lastId_ = 0;
+		activeWorkers_ = 0;
+		listening_ = false;
+		connected_ = false;
+		token_ = 0;
+		datagramConnected_ = false;
+		latestSnapshot_ = 0;
+		snapshotSequence_ = 0;
+		compressor_ = nullptr;
+		std::fill(compressedChannels_, compressedChannels_ + RELIABLE_ORDERED + 1, 0);
+		interestCellSize_ = 64;
+		groupCount_ = 0;
+		port_ = 0;
+		maxPacketSize_ = DEFAULT_MAX_PACKET_SIZE;
+		highWatermark_ = DEFAULT_HIGH_WATERMARK;
+		lowWatermark_ = DEFAULT_LOW_WATERMARK;
+		slowClientPolicy_ = DISCONNECT;
+		active_ = false;
+		clientCount_ = 0;
+		tickRate_ = 0;
+		dispatch_ = IMMEDIATE;
+		statsInterval_ = 0;
 	}
 
 	Network::~Network() {
-		if (thread_.joinable()) {
-			mutex_.lock();
-			active_ = false;
-			mutex_.unlock();
-			thread_.join();
+		active_ = false;
+		for (int i = 0; i < activeWorkers_; ++i) {
+			workers_[i]->transport_->wakeUp();
+			workers_[i]->thread_.join();
+		}
+		// The transports close all sockets.
+	}
+
+	void Network::setMaxPacketSize(int size) {
+		maxPacketSize_ = size;
+	}
+
+	void Network::setSendQueueLimit(int highWatermark, int lowWatermark, SlowClientPolicy policy) {
+		highWatermark_ = highWatermark;
+		lowWatermark_ = lowWatermark;
+		slowClientPolicy_ = policy;
+	}
+
+	void Network::setCompression(int threshold, const std::vector<char>& dictionary) {
+		compressor_ = std::unique_ptr<Compressor>(new Compressor(threshold, dictionary));
+	}
+
+	void Network::setCompressed(Delivery delivery, int channel, bool compressed) {
+		if (channel < 0 || channel >= 32) {
+			fprintf(stderr, "Channel %d can not be compressed.\n", channel);
+			return;
 		}
-		if (socketSet_ != nullptr) {
-			SDLNet_FreeSocketSet(socketSet_);
+		if (compressed) {
+			compressedChannels_[delivery] |= 1u << channel;
+		} else {
+			compressedChannels_[delivery] &= ~(1u << channel);
 		}
 	}
 
+	CompressionStats Network::getCompressionStats() const {
+		return compressor_ ? compressor_->getStats() : CompressionStats();
+	}
+
 	std::shared_ptr<Local> Network::getLocal() {
 		return local_;
 	}
 
 	std::shared_ptr<Server> Network::createServer(int port) {
 		if (server_ == nullptr) {
-			lastId_ = 0;
 			server_ = std::make_shared<Server>(this);
-			local_ = std::make_shared<Local>(this, ++lastId_);
-			if (serverListen(port)) {
-				socketSet_ = SDLNet_AllocSocketSet(8);
-				thread_ = std::thread(&Network::serverRun, this);
+			local_ = std::make_shared<Local>(this, LOCAL_ID);
+			if (initEventLoop(workers_.size()) && serverListen(port)) {
+				active_ = true;
+				listening_ = true;
+				tickStart_ = std::chrono::steady_clock::now();
+				for (auto& worker : workers_) {
+					worker->interest_ = InterestGrid(interestCellSize_);
+					worker->thread_ = std::thread(&Network::serverRun, this, std::ref(*worker));
+					++activeWorkers_;
+				}
 			} else {
 				return nullptr;
 			}
@@ -53,259 +168,1265 @@ namespace net {
 	std::shared_ptr<Server> Network::createLocalServer() {
 		if (local_ == nullptr) {
 			server_ = std::make_shared<Server>(this);
-			local_ = std::make_shared<Local>(this, 1);
+			local_ = std::make_shared<Local>(this, LOCAL_ID);
 			return server_;
 		}
 		return nullptr;
 	}
 
 	std::shared_ptr<Client> Network::pullNewConnections() {
+		std::weak_ptr<Client> connection;
+		while (connections_.pop(connection)) {
+			if (std::shared_ptr<Client> client = connection.lock()) {
+				return client;
+			}
+		}
 		return nullptr;
 	}
 
-	void Network::connectToServer(int port, std::string ip) {
-		if (SDLNet_ResolveHost(&ip_, ip.c_str(), port) < 0) {
-			fprintf(stderr, "SDLNet_ResolveHost: %s\n", SDLNet_GetError());
-			return;
+	bool Network::connectToServer(int port, std::string ip) {
+		if (!initEventLoop(1)) {
+			return false;
 		}
+		ip_ = ip;
+		port_ = port;
 		local_ = std::make_shared<Local>(this, 0);
-		thread_ = std::thread(&Network::clientRun, this);
+		networkBuffer_.client_ = local_.get();
+		networkBuffer_.connection_.setMaxFragmentedSize(maxPacketSize_ + PackageHeader::MAX_SIZE);
+		active_ = true;
+		workers_[0]->thread_ = std::thread(&Network::clientRun, this);
+		activeWorkers_ = 1;
+		return true;
+	}
+
+	long long Network::getSendCalls() const {
+		return traffic_.sendCalls_.get();
+	}
+
+	long long Network::getSavedSendCalls() const {
+		return savedSendCalls_.get();
+	}
+
+	NetworkStats Network::getStats() const {
+		NetworkStats stats;
+		static_cast<TrafficStats&>(stats) = traffic_.get();
+		stats.savedSendCalls_ = savedSendCalls_.get();
+		stats.accepted_ = accepted_.get();
+		stats.disconnected_ = disconnected_.get();
+		stats.connections_ = clientCount_;
+		stats.sendQueueSize_ = sendQueueSize_.get();
+		for (auto& worker : workers_) {
+			stats.mailboxSize_ += worker->mailboxSize_.get();
+		}
+		stats.sendLatency_ = sendLatency_.get();
+		stats.ticks_ = ticks_.get();
+		stats.tickOverruns_ = tickOverruns_.get();
+		stats.tickJitter_ = tickJitter_.get();
+		stats.tickDuration_ = tickDuration_.get();
+		stats.pool_ = BufferPool::getStats();
+		return stats;
+	}
+
+	void Network::resetStats() {
+		traffic_.reset();
+		savedSendCalls_.take();
+		accepted_.take();
+		disconnected_.take();
+		sendLatency_.reset();
+		ticks_.take();
+		tickOverruns_.take();
+		tickJitter_.reset();
+		tickDuration_.reset();
+		BufferPool::resetStats();
+	}
+
+	void Network::setInterestCellSize(float size) {
+		interestCellSize_ = size;
+	}
+
+	void Network::setTickRate(int rate) {
+		tickRate_ = rate;
+	}
+
+	void Network::setDispatch(Dispatch dispatch, const std::function<void()>& notify) {
+		dispatch_ = dispatch;
+		notify_ = notify;
+	}
+
+	void Network::onConnect(const ConnectionHandler& handler) {
+		connectHandler_ = handler;
+	}
+
+	void Network::onDisconnect(const ConnectionHandler& handler) {
+		disconnectHandler_ = handler;
+	}
+
+	void Network::onMessage(Delivery delivery, int channel, const MessageHandler& handler) {
+		std::vector<MessageHandler>& handlers = channelHandlers_[delivery];
+		if ((int) handlers.size() <= channel) {
+			handlers.resize(channel + 1);
+		}
+		handlers[channel] = handler;
+	}
+
+	void Network::onMessage(const MessageHandler& handler) {
+		messageHandler_ = handler;
+	}
+
+	int Network::dispatchEvents() {
+		return events_.popAll([&](const Event& event) {
+			callHandler(event);
+		});
+	}
+
+	void Network::setStatsDump(int interval, const std::function<void(const std::string&)>& function) {
+		statsInterval_ = interval;
+		statsDump_ = function;
+		statsTime_ = std::chrono::steady_clock::now();
+	}
+
+	bool Network::initEventLoop(int workers) {
+		for (int i = 0; i < workers; ++i) {
+			if (!workers_[i]->transport_->init()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Network::waitForEvents(Worker& worker, int timeout) {
+		worker.transport_->wait(timeout);
+		// Any wakeUp() call after this point will wake up the thread again. The
+		// fence makes sure all data pushed before a skipped wakeup is seen.
+		worker.wakeupPending_.store(false);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	void Network::wakeUp(Worker& worker) {
+		// Only one wakeup is needed until the network thread has handled the data.
+		if (active_ && !worker.wakeupPending_.exchange(true)) {
+			worker.transport_->wakeUp();
+		}
+	}
+
+	void Network::post(Worker& worker, const Outgoing& outgoing) {
+		worker.mailboxSize_.add(1);
+		worker.mailbox_.push(Outgoing(outgoing));
+		if (tickRate_ == 0) {
+			wakeUp(worker);
+		}
+		// Else sent by the next tick.
+	}
+
+	void Network::handle(Event&& event) {
+		if (dispatch_ == IMMEDIATE) {
+			callHandler(event);
+		} else {
+			events_.push(std::move(event));
+			if (notify_) {
+				notify_();
+			}
+		}
+	}
+
+	void Network::callHandler(const Event& event) {
+		const Message& message = event.message_;
+		switch (event.type_) {
+			case Event::CONNECT:
+				if (connectHandler_) {
+					connectHandler_(message.sender_);
+				}
+				break;
+			case Event::DISCONNECT:
+				if (disconnectHandler_) {
+					disconnectHandler_(message.sender_);
+				}
+				break;
+			case Event::MESSAGE:
+				if (const MessageHandler* handler = getHandler(message)) {
+					(*handler)(message.sender_, message.packet_);
+				}
+				break;
+		}
+	}
+
+	const Network::MessageHandler* Network::getHandler(const Message& message) const {
+		const std::vector<MessageHandler>& handlers = channelHandlers_[message.delivery_];
+		if (message.channel_ < (int) handlers.size() && handlers[message.channel_]) {
+			return &handlers[message.channel_];
+		}
+		return messageHandler_ ? &messageHandler_ : nullptr;
+	}
+
+	void Network::receive(MpscQueue<Message>& queue, Message&& message) {
+		if (getHandler(message) == nullptr) {
+			queue.push(std::move(message));
+		} else {
+			handle(Event(Event::MESSAGE, std::move(message)));
+		}
+	}
+
+	void Network::count(Buffer& buffer, Counter TrafficCounters::* counter, long long value) {
+		(traffic_.*counter).add(value);
+		(buffer.client_->counters_.*counter).add(value);
+	}
+
+	void Network::updateQueueSize(Buffer& buffer) {
+		int size = buffer.sendBuffer_.size() + buffer.connection_.getQueuedSize();
+		if (size != buffer.queueSize_) {
+			sendQueueSize_.add(size - buffer.queueSize_);
+			buffer.client_->sendQueueSize_.set(size);
+			buffer.queueSize_ = size;
+		}
+	}
+
+	void Network::countDatagrams(Buffer& buffer, long long resends) {
+		const DatagramQueue& datagrams = buffer.datagrams_;
+		const DatagramConnection& connection = buffer.connection_;
+		if (!datagrams.empty()) {
+			count(buffer, &TrafficCounters::datagramsSent_, datagrams.size());
+			count(buffer, &TrafficCounters::bytesSent_, datagrams.bytes());
+		}
+		if (connection.getResends() != resends) {
+			count(buffer, &TrafficCounters::resends_, connection.getResends() - resends);
+		}
+		buffer.client_->rtt_.set((long long) (connection.getRtt() * 1000));
+	}
+
+	int Network::dumpStats() {
+		if (!statsDump_) {
+			return WAIT_TIMEOUT;
+		}
+		auto time = std::chrono::steady_clock::now();
+		auto next = statsTime_ + std::chrono::milliseconds(statsInterval_);
+		if (time >= next) {
+			statsDump_(getStats().toText());
+			statsTime_ = time;
+			return statsInterval_;
+		}
+		return (int) std::chrono::duration_cast<std::chrono::milliseconds>(next - time).count() + 1;
+	}
+
+	bool Network::flush(Worker& worker, Socket socket, Buffer& buffer) {
+		Transport& transport = *worker.transport_;
+		SendQueue& data = buffer.sendBuffer_;
+		if (data.empty() || (buffer.writeInterest_ && !transport.isWritable(socket))) {
+			// Nothing to send or the socket buffer is still full.
+			return true;
+		}
+		Segment segments[SEND_SEGMENTS];
+		while (int nbr = data.segments(segments, SEND_SEGMENTS)) {
+			int size = 0;
+			for (int i = 0; i < nbr; ++i) {
+				size += segments[i].size_;
+			}
+			int sizeSent = transport.send(socket, segments, nbr);
+			if (sizeSent < 0) {
+				return false;
+			}
+			count(buffer, &TrafficCounters::sendCalls_, 1);
+			count(buffer, &TrafficCounters::bytesSent_, sizeSent);
+			// Count the packages, whole or partial, covered by the call.
+			int sentNbr = 0;
+			for (int left = sizeSent; sentNbr < nbr && left > 0; ++sentNbr) {
+				left -= segments[sentNbr].size_;
+			}
+			if (sentNbr > 1) {
+				savedSendCalls_.add(sentNbr - 1);
+			}
+			auto time = std::chrono::steady_clock::now();
+			int packages = 0;
+			data.pop(sizeSent, [&](const Payload& payload) {
+				sendLatency_.record(nanoseconds(time - payload.getTime()));
+				++packages;
+			});
+			count(buffer, &TrafficCounters::packagesSent_, packages);
+			if (sizeSent < size) {
+				break;
+			}
+		}
+		// Wait for the socket to be writable if not all data was sent.
+		buffer.writeInterest_ = !data.empty();
+		transport.setWriteInterest(socket, buffer.writeInterest_);
+		return true;
+	}
+
+	int Network::receiveDatagrams(Worker& worker) {
+		if (worker.datagramData_.empty()) {
+			worker.datagramData_.resize(DATAGRAM_BATCH * MAX_DATAGRAM_SIZE);
+			worker.datagrams_.resize(DATAGRAM_BATCH);
+		}
+		for (int i = 0; i < DATAGRAM_BATCH; ++i) {
+			worker.datagrams_[i].data_ = worker.datagramData_.data() + i * MAX_DATAGRAM_SIZE;
+			worker.datagrams_[i].size_ = MAX_DATAGRAM_SIZE;
+		}
+		return worker.transport_->receiveDatagrams(worker.datagramSocket_, worker.datagrams_.data(), DATAGRAM_BATCH);
+	}
+
+	void Network::sendDatagrams(Worker& worker) {
+		int size = worker.datagrams_.size();
+		for (int index = 0; index < size;) {
+			int nbr = size - index < DATAGRAM_BATCH ? size - index : DATAGRAM_BATCH;
+			int sent = worker.transport_->sendDatagrams(worker.datagramSocket_, worker.datagrams_.data() + index, nbr);
+			if (sent <= 0) {
+				// Unreliable, the rest is dropped.
+				break;
+			}
+			index += sent;
+		}
+		worker.datagrams_.clear();
+	}
+
+	int Network::readDatagram(Worker& worker, const Datagram& datagram, int& token) {
+		if (datagram.size_ < DATAGRAM_HEADER_SIZE) {
+			return 0;
+		}
+		RingBuffer& buffer = worker.datagramBuffer_;
+		buffer.clear();
+		buffer.append(datagram.data_, datagram.size_);
+		int id = PackageHeader::readId(buffer, 0);
+		token = PackageHeader::readId(buffer, PackageHeader::ID_SIZE);
+		buffer.pop_front(DATAGRAM_HEADER_SIZE);
+		return id;
 	}
 
 	bool Network::serverListen(int port) {
-		// Resolving the host using NULL make network interface to listen.
-		if (SDLNet_ResolveHost(&ip_, NULL, port) < 0) {
-			fprintf(stderr, "SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+		for (auto& worker : workers_) {
+			worker->listenSocket_ = worker->transport_->listen(port);
+			// The first worker's datagram socket uses the same port.
+			worker->datagramSocket_ = worker->transport_->openDatagram(worker == workers_[0] ? port : 0);
+			if (worker->listenSocket_ == Transport::NO_SOCKET || worker->datagramSocket_ == Transport::NO_SOCKET) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Network::clientRun() {
+		Worker& worker = *workers_[0];
+		Transport& transport = *worker.transport_;
+		Socket socket = transport.connect(ip_, port_);
+		if (socket != Transport::NO_SOCKET) {
+			worker.datagramSocket_ = transport.openDatagram(0);
+			// The port is known from the handshake.
+			serverAddress_ = transport.getPeerAddress(socket);
+			while (active_) {
+				// Blocks until the server sends data or the local client has data to send.
+				int timeout = std::min(networkBuffer_.connection_.hasUnacked() ? RESEND_INTERVAL : WAIT_TIMEOUT, dumpStats());
+				waitForEvents(worker, connected_ && !datagramConnected_ ? std::min(timeout, (int) HELLO_INTERVAL) : timeout);
+				if (transport.isReadable(socket) && !clientReceiveData(socket)) {
+					// Connection to the server is lost.
+					break;
+				}
+				if (worker.datagramSocket_ != Transport::NO_SOCKET && transport.isReadable(worker.datagramSocket_) && !clientReceiveDatagrams()) {
+					// The server sent invalid data.
+					break;
+				}
+				if (!clientSendData(socket)) {
+					break;
+				}
+			}
+			transport.close(socket);
+		}
+		if (active_ && disconnectHandler_) {
+			handle(Event(Event::DISCONNECT, Message(local_, Packet())));
+		}
+	}
+
+	bool Network::clientReceiveData(Socket socket) {
+		std::array<char, RECEIVE_SIZE> data;
+		int receiveSize = workers_[0]->transport_->receive(socket, data.data(), data.size());
+		if (receiveSize < 0) {
 			return false;
 		}
+		count(networkBuffer_, &TrafficCounters::receiveCalls_, 1);
+		count(networkBuffer_, &TrafficCounters::bytesReceived_, receiveSize);
+		networkBuffer_.receive(data.data(), receiveSize);
 
-		// Open a connection with the IP provided (listen on the host's port).
-		listenSocket_ = SDLNet_TCP_Open(&ip_);
-		if (listenSocket_ == nullptr) {
-			fprintf(stderr, "SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+		RingBuffer& buffer = networkBuffer_.receiveBuffer_;
+		int index = 0;
+		if (!connected_) {
+			if (buffer.size() < HANDSHAKE_SIZE) {
+				return true;
+			}
+			// The handshake, i.e. the id and token assigned by the server, the
+			// datagram port in network byte order and the flags.
+			bool compression = (buffer[HANDSHAKE_SIZE - 1] & HANDSHAKE_COMPRESSION) != 0;
+			if (compression != (compressor_ != nullptr)) {
+				fprintf(stderr, "Compression is %s by the server.\n", compression ? "enabled" : "not enabled");
+				return false;
+			}
+			local_->id_ = PackageHeader::readId(buffer, 0);
+			token_ = PackageHeader::readId(buffer, PackageHeader::ID_SIZE);
+			char* port = (char*) &serverAddress_.port_;
+			port[0] = buffer[2 * PackageHeader::ID_SIZE];
+			port[1] = buffer[2 * PackageHeader::ID_SIZE + 1];
+			char header[DATAGRAM_HEADER_SIZE];
+			writeId(header, local_->id_);
+			writeId(header + PackageHeader::ID_SIZE, token_);
+			networkBuffer_.datagrams_.setHeader(header, DATAGRAM_HEADER_SIZE);
+			index = HANDSHAKE_SIZE;
+			connected_ = true;
+			if (connectHandler_) {
+				handle(Event(Event::CONNECT, Message(local_, Packet())));
+			}
+		}
+		index = clientHandlePackages(buffer, index, STREAM, 0);
+		if (index < 0) {
 			return false;
 		}
+		// Remove all whole packages.
+		networkBuffer_.removeFromReceiveBuffer(index);
 		return true;
 	}
 
-	void Network::clientRun() {
-		TCPsocket socket = SDLNet_TCP_Open(&ip_);
-		if (socket) {
-			SDLNet_TCP_AddSocket(socketSet_, socket);
-			char id;
-			SDLNet_TCP_Recv(socket, &id, 1);
-			mutex_.lock();
-			local_->id_ = id;
-			active_ = true;
-			mutex_.unlock();
-			while (active_) {
-				if (SDLNet_SocketReady(socket) != 0) {
-					std::array<char, 256> data;
-					int receiveSize = SDLNet_TCP_Recv(socket, data.data(), sizeof(data));
-					networkBuffer_.receive(data.data(), receiveSize);
-					if (networkBuffer_.sendBuffer_.size() > 1) {
-						unsigned int packageSize = networkBuffer_.sendBuffer_[0];
-						int receiverId = networkBuffer_.sendBuffer_[1];
-
-						// Whole package received?
-						if (packageSize < networkBuffer_.sendBuffer_.size()) {
-							// Set the correct id. So the remote client see the correct id.
-							// Data sent from the server?
-							if (receiverId == server_->SERVER_ID) {
-								// Insert the data to server buffer from the remote client.
-								mutex_.lock();
-								networkBuffer_.receiveBuffer_.insert(networkBuffer_.sendBuffer_.end(), networkBuffer_.sendBuffer_.data(), networkBuffer_.sendBuffer_.data() + packageSize);
-								mutex_.unlock();
-							} else { // Send through to all remote connections!
-								// Send to all remote clients.
-								for (auto& pair : clients_) {
-									// Ignore the sender of the data.
-									local_->receiveBuffer_.insert(local_->receiveBuffer_.end(), networkBuffer_.sendBuffer_.begin(), networkBuffer_.sendBuffer_.begin() + packageSize);
-								}
-							}
-							// Remove the data sent. I.e. the whole package.
-							networkBuffer_.removeFromSendBuffer(packageSize);
-						}
+	int Network::clientHandlePackages(const RingBuffer& buffer, int index, Delivery delivery, int channel) {
+		PackageHeader header;
+		PackageHeader::Status status;
+		while ((status = header.read(buffer, index, getMaxDataSize())) == PackageHeader::WHOLE) {
+			if (!hasValidSize(header)) {
+				return -1;
+			}
+			Packet packet;
+			if (header.id_ == CHANNEL_ID) {
+				// Streamed in place of a datagram, handled as sent. Never nested.
+				RingBuffer& package = workers_[0]->packageBuffer_;
+				Delivery packageDelivery;
+				int packageChannel;
+				if (delivery != STREAM || !readChannelPackage(buffer, index, header, package, packageDelivery, packageChannel)
+					|| clientHandlePackages(package, 0, packageDelivery, packageChannel) != package.size()) {
+
+					return -1;
+				}
+				index += header.size();
+				continue;
+			}
+			count(networkBuffer_, &TrafficCounters::packagesReceived_, 1);
+			if (header.id_ == SNAPSHOT_ID) {
+				copyPackageData(buffer, index, header, packet);
+				if (!clientReceiveSnapshot(packet)) {
+					return -1;
+				}
+			} else if (!readPacket(buffer, index, header, packet)) {
+				return -1;
+			} else if (header.id_ == Server::SERVER_ID) {
+				// Data sent from the server.
+				receive(local_->serverReceiveBuffer_, Message(nullptr, std::move(packet), delivery, channel));
+			} else {
+				// Data sent from another client.
+				local_->receiveBuffer_.push(Message(nullptr, std::move(packet)));
+			}
+			index += header.size();
+		}
+		return status == PackageHeader::INVALID ? -1 : index;
+	}
+
+	bool Network::clientReceiveDatagrams() {
+		Worker& worker = *workers_[0];
+		DatagramConnection::Receiver receiver = [&](const char* data, int size, Delivery delivery, int channel) {
+			worker.packageBuffer_.clear();
+			worker.packageBuffer_.append(data, size);
+			return clientHandlePackages(worker.packageBuffer_, 0, delivery, channel) == size;
+		};
+		auto time = std::chrono::steady_clock::now();
+		int nbr;
+		do {
+			nbr = receiveDatagrams(worker);
+			for (int i = 0; i < nbr; ++i) {
+				const Datagram& datagram = worker.datagrams_[i];
+				int token;
+				// Only datagrams from the server to this client.
+				if (connected_ && datagram.address_ == serverAddress_ && readDatagram(worker, datagram, token) == local_->id_ && token == token_) {
+					count(networkBuffer_, &TrafficCounters::datagramsReceived_, 1);
+					count(networkBuffer_, &TrafficCounters::bytesReceived_, datagram.size_);
+					datagramConnected_ = true;
+					if (!networkBuffer_.connection_.read(worker.datagramBuffer_, time, receiver)) {
+						worker.datagrams_.clear();
+						return false;
 					}
 				}
 			}
+		} while (nbr == DATAGRAM_BATCH);
+		worker.datagrams_.clear();
+		return true;
+	}
+
+	bool Network::clientSendData(Socket socket) {
+		Payload payload;
+		while (local_->sendBuffer_.pop(payload)) {
+			networkBuffer_.sendBuffer_.push(payload);
 		}
+		clientSendDatagrams();
+		bool valid = flush(*workers_[0], socket, networkBuffer_);
+		updateQueueSize(networkBuffer_);
+		return valid;
 	}
 
-	void Network::serverRun() {
-		active_ = true;
+	void Network::clientSendDatagrams() {
+		Worker& worker = *workers_[0];
+		DatagramQueue& datagrams = networkBuffer_.datagrams_;
+		DatagramConnection& connection = networkBuffer_.connection_;
+		Outgoing outgoing;
+		while (local_->datagramSendBuffer_.pop(outgoing)) {
+			// Unreliable packages are streamed until the handshake is done, reliable
+			// ones are held, i.e. an ordered channel never changes transport.
+			if ((!connected_ && outgoing.delivery_ == UNRELIABLE) || !connection.push(outgoing.payload_, outgoing.delivery_, outgoing.channel_)) {
+				networkBuffer_.sendBuffer_.push(createChannelPackage(outgoing.payload_, outgoing.delivery_, outgoing.channel_));
+			} else {
+				count(networkBuffer_, &TrafficCounters::packagesSent_, 1);
+				sendLatency_.record(nanoseconds(std::chrono::steady_clock::now() - outgoing.payload_.getTime()));
+			}
+		}
+		if (!connected_ || worker.datagramSocket_ == Transport::NO_SOCKET) {
+			return;
+		}
+		auto time = std::chrono::steady_clock::now();
+		if (!datagramConnected_ && time - helloTime_ >= std::chrono::milliseconds(HELLO_INTERVAL)) {
+			// Tell the server the address, until it answers.
+			connection.ping();
+			helloTime_ = time;
+		}
+		long long resends = connection.getResends();
+		connection.write(datagrams, time);
+		countDatagrams(networkBuffer_, resends);
+		if (!datagrams.empty()) {
+			worker.datagrams_.resize(datagrams.size());
+			datagrams.fill(worker.datagrams_.data(), serverAddress_);
+			sendDatagrams(worker);
+			datagrams.clear();
+		}
+	}
+
+	bool Network::clientReceiveSnapshot(const Packet& packet) {
+		if (packet.size() < SNAPSHOT_HEADER_SIZE) {
+			return false;
+		}
+		int sequence = readId(packet.getData());
+		int baseline = readId(packet.getData() + PackageHeader::ID_SIZE);
+		if (sequence <= latestSnapshot_) {
+			// A newer snapshot is already received.
+			return true;
+		}
+		if (receivedSnapshots_.empty()) {
+			receivedSnapshots_.resize(SNAPSHOT_HISTORY);
+		}
+		const Snapshot* base = nullptr;
+		if (baseline != 0) {
+			base = &receivedSnapshots_[baseline % SNAPSHOT_HISTORY];
+			if (base->sequence_ != baseline) {
+				// Can not be decoded, wait for the next one.
+				return true;
+			}
+		}
+		Packet snapshot;
+		if (!decodeDelta(packet.getData() + SNAPSHOT_HEADER_SIZE, packet.size() - SNAPSHOT_HEADER_SIZE,
+			base ? base->data() : nullptr, base ? base->size() : 0, maxPacketSize_, snapshot)) {
+
+			return false;
+		}
+		std::vector<char> data(snapshot.getData(), snapshot.getData() + snapshot.size());
+		receivedSnapshots_[sequence % SNAPSHOT_HISTORY] = Snapshot(sequence, Payload(data), 0);
+		latestSnapshot_ = sequence;
+		local_->snapshotBuffer_.push(std::move(snapshot));
+
+		// The server encodes the next snapshots against this one.
+		Packet ack;
+		ack.resize(PackageHeader::ID_SIZE);
+		writeId(ack.getData(), sequence);
+		Payload payload = net::createPackage(SNAPSHOT_ID, ack);
+		if (!datagramConnected_ || !networkBuffer_.connection_.push(payload, UNRELIABLE, 0)) {
+			networkBuffer_.sendBuffer_.push(payload);
+		}
+		return true;
+	}
+
+	void Network::serverRun(Worker& worker) {
 		while (active_) {
-			serverHandleNewConnection();
+			int timeout = worker.unacked_ ? RESEND_INTERVAL : WAIT_TIMEOUT;
+			if (tickRate_ > 0) {
+				// Rounded up, i.e. never woken up before the tick is due.
+				auto wait = getTickTime(worker.nextTick_) - std::chrono::steady_clock::now();
+				timeout = (int) std::max(0LL, (nanoseconds(wait) + 999999) / 1000000);
+			}
+			if (&worker == workers_[0].get()) {
+				timeout = std::min(timeout, dumpStats());
+			}
+			// Blocks until a new connection, received data or new data to be sent.
+			waitForEvents(worker, timeout);
+
+			if (worker.transport_->isReadable(worker.listenSocket_)) {
+				serverHandleNewConnection(worker);
+			}
 
 			// Receive data to all sockets.
-			serverReceiveData();
+			serverReceiveData(worker);
+			if (worker.transport_->isReadable(worker.datagramSocket_)) {
+				serverReceiveDatagrams(worker);
+			}
+
+			if (tickRate_ > 0) {
+				auto time = std::chrono::steady_clock::now();
+				if (time >= getTickTime(worker.nextTick_)) {
+					serverTick(worker, time);
+				} else {
+					// The rest of the data not sent by the last tick.
+					serverFlush(worker, true);
+				}
+				continue;
+			}
+
+			// Send data from the local client, the server and the other workers.
+			serverSendMailData(worker);
+
+			// Send the data queued for each client.
+			serverFlush(worker);
+			serverSendDatagrams(worker);
+		}
+		// Wake up the application waiting for a tick.
+		std::lock_guard<std::mutex> lock(tickMutex_);
+		tickCondition_.notify_all();
+	}
+
+	void Network::serverTick(Worker& worker, std::chrono::steady_clock::time_point time) {
+		auto period = std::chrono::nanoseconds(1000000000LL / tickRate_);
+		// The latest tick due, the ones before are skipped.
+		long long tick = (time - tickStart_) / period;
+		if (tick > worker.nextTick_) {
+			tickOverruns_.add(tick - worker.nextTick_);
+		}
+		tickJitter_.record(nanoseconds(time - getTickTime(tick)));
+		if (&worker == workers_[0].get()) {
+			ticks_.add(1);
+		}
 
-			// Send local data to everyone.
-			serverSendLocalData();
+		for (Message& message : worker.tickInput_) {
+			receive(server_->receiveBuffer_, std::move(message));
+		}
+		worker.tickInput_.clear();
+		if (&worker == workers_[0].get()) {
+			Message message;
+			while (localTickInput_.pop(message)) {
+				receive(server_->receiveBuffer_, std::move(message));
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(tickMutex_);
+			worker.tick_ = tick;
+		}
+		tickCondition_.notify_all();
 
-			// Send server data to everyone.
-			serverSendServerData();
+		// The output of the last tick, one write for each client.
+		serverSendMailData(worker);
+		serverFlush(worker);
+		serverSendDatagrams(worker);
+		worker.nextTick_ = tick + 1;
+		tickDuration_.record(nanoseconds(std::chrono::steady_clock::now() - time));
+	}
+
+	std::chrono::steady_clock::time_point Network::getTickTime(long long tick) const {
+		return tickStart_ + std::chrono::nanoseconds(tick * (1000000000LL / tickRate_));
+	}
+
+	long long Network::waitForTick(long long tick, int timeout) {
+		if (tickRate_ == 0 || !listening_) {
+			return 0;
 		}
+		long long done = 0;
+		std::unique_lock<std::mutex> lock(tickMutex_);
+		tickCondition_.wait_for(lock, std::chrono::milliseconds(timeout), [&]() {
+			// Done by all workers.
+			done = workers_[0]->tick_;
+			for (auto& worker : workers_) {
+				done = std::min(done, worker->tick_.load());
+			}
+			return done > tick || !active_;
+		});
+		return done > tick ? done : 0;
 	}
 
-	void Network::serverHandleNewConnection() {
+	void Network::serverHandleNewConnection(Worker& worker) {
 		// New connection?
-		if (TCPsocket socket = SDLNet_TCP_Accept(listenSocket_)) {
-			if (IPaddress* remoteIP_ = SDLNet_TCP_GetPeerAddress(socket)) {
-				SDLNet_TCP_AddSocket(socketSet_, socket);
-				// Todo! Fix correct id!
-				clients_[socket].client_ = std::make_shared<Remote>(++lastId_);
+		Socket socket;
+		while ((socket = worker.transport_->accept(worker.listenSocket_)) != Transport::NO_SOCKET) {
+			int id = worker.clients_.insert(Pair(socket));
+			if (id == 0) {
+				// Server is full.
+				worker.transport_->close(socket);
 			} else {
-				fprintf(stderr, "SDLNet_TCP_GetPeerAddress: %s\n", SDLNet_GetError());
+				++clientCount_;
+				accepted_.add(1);
+				Pair& pair = *worker.clients_.find(id);
+				pair.client_ = std::make_shared<Remote>(id);
+				pair.buffer_.client_ = pair.client_.get();
+				pair.buffer_.connection_.setMaxFragmentedSize(maxPacketSize_ + PackageHeader::MAX_SIZE);
+				do {
+					pair.token_ = (int) worker.random_();
+				} while (pair.token_ == 0);
+				char header[DATAGRAM_HEADER_SIZE];
+				writeId(header, id);
+				writeId(header + PackageHeader::ID_SIZE, pair.token_);
+				pair.buffer_.datagrams_.setHeader(header, DATAGRAM_HEADER_SIZE);
+
+				// Tell the client its id, token and the datagram port.
+				std::vector<char> data(header, header + DATAGRAM_HEADER_SIZE);
+				int port = worker.transport_->getPort(worker.datagramSocket_);
+				data.push_back((char) (port >> 8));
+				data.push_back((char) port);
+				data.push_back((char) (compressor_ ? HANDSHAKE_COMPRESSION : 0));
+				pair.buffer_.sendBuffer_.push(Payload(data));
+				if (connectHandler_) {
+					handle(Event(Event::CONNECT, Message(pair.client_, Packet())));
+				} else {
+					connections_.push(std::weak_ptr<Client>(pair.client_));
+				}
 			}
 		}
 	}
 
-	void Network::serverReceiveData() {
-		while (SDLNet_CheckSockets(socketSet_, 0) > 0) {
-			for (TCPsocket socket : sockets_) {
-				// Is ready to receive data?
-				if (SDLNet_SocketReady(socket) != 0) {
-					std::array<char, 256> data;
-					int receiveSize = SDLNet_TCP_Recv(socket, data.data(), sizeof(data));
-					Pair& remote = clients_[socket];
+	void Network::serverReceiveData(Worker& worker) {
+		// Backwards, a disconnected client is replaced by the last one.
+		for (int i = worker.clients_.size() - 1; i >= 0; --i) {
+			Pair& remote = worker.clients_[i];
+			// Is ready to receive data?
+			if (worker.transport_->isReadable(remote.socket_)) {
+				int id = worker.clients_.getId(i);
+				std::array<char, RECEIVE_SIZE> data;
+				int receiveSize = worker.transport_->receive(remote.socket_, data.data(), data.size());
+				if (receiveSize >= 0) {
+					count(remote.buffer_, &TrafficCounters::receiveCalls_, 1);
+					count(remote.buffer_, &TrafficCounters::bytesReceived_, receiveSize);
 					remote.buffer_.receive(data.data(), receiveSize);
-					if (remote.buffer_.sendBuffer_.size() > 1) {
-						unsigned int packageSize = remote.buffer_.sendBuffer_[0];
-						int receiverId = remote.buffer_.sendBuffer_[1];
-						
-						// Whole package received?
-						if (packageSize < remote.buffer_.sendBuffer_.size()) {
-							// Set the correct id. So the remote client see the correct id.
-							remote.buffer_.sendBuffer_[1] = remote.client_->id_;
-							// Data assign to the server?
-							if (receiverId == server_->SERVER_ID) {
-								// Insert the data to server buffer from the remote client.
-								mutex_.lock();
-								networkBuffer_.receiveBuffer_.insert(remote.buffer_.sendBuffer_.end(), remote.buffer_.sendBuffer_.data(), remote.buffer_.sendBuffer_.data() + packageSize);
-								mutex_.unlock();
-							} else { // Send through to all remote connections!
-								// Send to all remote clients.
-								for (auto& pair : clients_) {
-									// Ignore the sender of the data.
-									if (socket != pair.first) {
-										remote.buffer_.sendBuffer_[1] = remote.client_->id_;
-										remote.client_->receiveBuffer_.insert(local_->receiveBuffer_.end(), remote.buffer_.sendBuffer_.begin(), remote.buffer_.sendBuffer_.begin() + packageSize);
-										SDLNet_TCP_Send(pair.first, remote.buffer_.sendBuffer_.data(), packageSize);
-									}
-								}
-							}
-							// Remove the data sent. I.e. the whole package.
-							remote.buffer_.removeFromSendBuffer(packageSize);
+				}
+				if (receiveSize < 0 || !serverHandleReceivedData(worker, id, remote)) {
+					// The remote client is disconnected or sent invalid data.
+					serverDisconnect(worker, id);
+				}
+			}
+		}
+	}
+
+	bool Network::serverHandleReceivedData(Worker& worker, int id, Pair& remote) {
+		int size = serverHandlePackages(worker, id, remote, remote.buffer_.receiveBuffer_, STREAM, 0);
+		if (size < 0) {
+			return false;
+		}
+		// Remove all whole packages.
+		remote.buffer_.removeFromReceiveBuffer(size);
+		return true;
+	}
+
+	int Network::serverHandlePackages(Worker& worker, int id, Pair& remote, RingBuffer& buffer, Delivery delivery, int channel) {
+		int index = 0;
+		PackageHeader header;
+		PackageHeader::Status status;
+		while ((status = header.read(buffer, index, getMaxDataSize())) == PackageHeader::WHOLE) {
+			if (!hasValidSize(header)) {
+				return -1;
+			}
+			int packageSize = header.size();
+			if (header.id_ == CHANNEL_ID) {
+				// Streamed in place of a datagram, handled as sent. Never nested.
+				RingBuffer& package = worker.packageBuffer_;
+				Delivery packageDelivery;
+				int packageChannel;
+				if (delivery != STREAM || !readChannelPackage(buffer, index, header, package, packageDelivery, packageChannel)
+					|| serverHandlePackages(worker, id, remote, package, packageDelivery, packageChannel) != package.size()) {
+
+					return -1;
+				}
+				index += packageSize;
+				continue;
+			}
+			count(remote.buffer_, &TrafficCounters::packagesReceived_, 1);
+			int receiverId = header.id_;
+			// Set the correct id. So the receiver see the correct id.
+			header.writeId(buffer, index, id);
+			if (receiverId == SNAPSHOT_ID) {
+				// The client acks a snapshot.
+				if (header.dataSize_ == PackageHeader::ID_SIZE) {
+					int sequence = PackageHeader::readId(buffer, index + header.headerSize_);
+					if (sequence > remote.snapshotAck_ && sequence <= snapshotSequence_) {
+						remote.snapshotAck_ = sequence;
+					}
+				}
+			} else if (receiverId == Server::SERVER_ID) { // Data assign to the server?
+				// Insert the data to server buffer from the remote client.
+				Packet packet;
+				if (!readPacket(buffer, index, header, packet)) {
+					return -1;
+				}
+				if (tickRate_ > 0) {
+					worker.tickInput_.push_back(Message(remote.client_, std::move(packet), delivery, channel));
+				} else {
+					receive(server_->receiveBuffer_, Message(remote.client_, std::move(packet), delivery, channel));
+				}
+			} else { // Send through to all remote connections!
+				Packet packet;
+				if (!readPacket(buffer, index, header, packet)) {
+					return -1;
+				}
+				local_->receiveBuffer_.push(Message(remote.client_, std::move(packet)));
+				if (clientCount_ > 1) {
+					// Copied once, shared by all receivers, still compressed.
+					std::vector<char> data(packageSize);
+					buffer.copy(index, data.data(), packageSize);
+					Payload payload(std::move(data));
+					for (Pair& pair : worker.clients_) {
+						// Ignore the sender of the data.
+						if (&pair != &remote) {
+							queue(pair, payload, delivery, channel);
+						}
+					}
+					// The other workers send it to their clients.
+					for (auto& other : workers_) {
+						if (other.get() != &worker) {
+							post(*other, Outgoing(ALL_ID, payload, delivery, channel));
 						}
 					}
 				}
-				break;
 			}
+			index += packageSize;
 		}
+		return status == PackageHeader::INVALID ? -1 : index;
 	}
 
-	void Network::serverSendLocalData() {
-		unsigned int index = 0;
-		int sizeSent = 0;
-		mutex_.lock();
-		while (local_->sendBuffer_.size() > index) {
-			int size = local_->sendBuffer_[index];
+	void Network::serverReceiveDatagrams(Worker& worker) {
+		int id;
+		Pair* remote;
+		DatagramConnection::Receiver receiver = [&](const char* data, int size, Delivery delivery, int channel) {
+			worker.packageBuffer_.clear();
+			worker.packageBuffer_.append(data, size);
+			return serverHandlePackages(worker, id, *remote, worker.packageBuffer_, delivery, channel) == size;
+		};
+		auto time = std::chrono::steady_clock::now();
+		int nbr;
+		do {
+			nbr = receiveDatagrams(worker);
+			for (int i = 0; i < nbr; ++i) {
+				const Datagram& datagram = worker.datagrams_[i];
+				int token;
+				id = readDatagram(worker, datagram, token);
+				remote = worker.clients_.find(id);
+				if (remote == nullptr || remote->token_ != token) {
+					// Not from a connected client.
+					continue;
+				}
+				count(remote->buffer_, &TrafficCounters::datagramsReceived_, 1);
+				count(remote->buffer_, &TrafficCounters::bytesReceived_, datagram.size_);
+				// The address is learned from any valid datagram.
+				remote->address_ = datagram.address_;
+				remote->hasAddress_ = true;
+				if (!remote->buffer_.connection_.read(worker.datagramBuffer_, time, receiver)) {
+					// Invalid data, as on the stream.
+					serverDisconnect(worker, id);
+				}
+			}
+		} while (nbr == DATAGRAM_BATCH);
+		worker.datagrams_.clear();
+	}
 
-			// Data ready to be sent?
-			if (local_->sendBuffer_.size() - index >= size + 1) {
-				// Send to all clients.
-				for (auto& pair : clients_) {
-					// Byte 1: SIZE.
-					// Byte 2: SENDER_ID.
-					// Byte 3 -> SIZE-2: DATA.
-					SDLNet_TCP_Send(pair.first, &local_->id_, 1);
-					SDLNet_TCP_Send(pair.first, local_->sendBuffer_.data() + index, size + 1);
+	void Network::serverSendMailData(Worker& worker) {
+		Outgoing outgoing;
+		while (worker.mailbox_.pop(outgoing)) {
+			worker.mailboxSize_.add(-1);
+			if (outgoing.receiverId_ == SNAPSHOT_ID) {
+				serverSendSnapshot(worker, outgoing.payload_);
+			} else if (outgoing.receiverId_ == AREA_ID) {
+				worker.interest_.query(outgoing.x_, outgoing.y_, [&](int id) {
+					queue(*worker.clients_.find(id), outgoing.payload_, outgoing.delivery_, outgoing.channel_);
+				});
+			} else if (outgoing.receiverId_ == INTEREST_ID) {
+				Packet packet(outgoing.payload_.data(), outgoing.payload_.size());
+				int id;
+				float x, y, radius;
+				packet.read(id);
+				packet.read(x);
+				packet.read(y);
+				packet.read(radius);
+				// Ignored if the client is disconnected.
+				if (worker.clients_.find(id) != nullptr) {
+					worker.interest_.set(id, x, y, radius);
 				}
-				index = sizeSent;
-				sizeSent += size + 1;
-			} else {
-				// Abort the while loop.
-				break;
+			} else if (outgoing.receiverId_ == GROUP_ID) {
+				auto it = worker.groups_.find(outgoing.group_);
+				if (it != worker.groups_.end()) {
+					for (int id : it->second) {
+						queue(*worker.clients_.find(id), outgoing.payload_, outgoing.delivery_, outgoing.channel_);
+					}
+				}
+			} else if (outgoing.receiverId_ == MEMBER_ID) {
+				serverSetMember(worker, outgoing.payload_);
+			} else if (outgoing.receiverId_ == ALL_ID) {
+				for (Pair& pair : worker.clients_) {
+					queue(pair, outgoing.payload_, outgoing.delivery_, outgoing.channel_);
+				}
+			} else if (Pair* pair = worker.clients_.find(outgoing.receiverId_)) {
+				queue(*pair, outgoing.payload_, outgoing.delivery_, outgoing.channel_);
 			}
 		}
-		// Remove all data which was sent.
-		local_->sendBuffer_.erase(local_->sendBuffer_.begin(), local_->sendBuffer_.begin() + sizeSent);
-		mutex_.unlock();
 	}
 
-	void Network::serverSendServerData() {
-		int index = 0;
-		int sizeSent = 0;
-		mutex_.lock();
-		while (server_->sendBuffer_.size() > index) {
-			int size = server_->sendBuffer_[index];
-
-			// Data ready to be sent?
-			if (server_->sendBuffer_.size() - index >= size + 1) {
-				// Send package to all clients.
-				for (auto& pair : clients_) {
-					// Byte 1: SIZE.
-					// Byte 2: SENDER_ID.
-					// Byte 3 -> SIZE-3: DATA.
-					char id = 0;
-					SDLNet_TCP_Send(pair.first, &id, 1);
-					SDLNet_TCP_Send(pair.first, local_->sendBuffer_.data() + index, size + 1);
+	void Network::serverSetMember(Worker& worker, const Payload& payload) {
+		Packet packet(payload.data(), payload.size());
+		int group, id;
+		bool join;
+		packet.read(group);
+		packet.read(id);
+		packet.read(join);
+		if (id == ALL_ID) {
+			auto it = worker.groups_.find(group);
+			if (it != worker.groups_.end()) {
+				for (int member : it->second) {
+					std::vector<int>& groups = worker.clients_.find(member)->groups_;
+					groups.erase(std::find(groups.begin(), groups.end(), group));
 				}
-				index = sizeSent;
-				sizeSent += size + 1;
+				worker.groups_.erase(it);
+			}
+			return;
+		}
+		Pair* pair = worker.clients_.find(id);
+		if (pair == nullptr) {
+			// Disconnected.
+			return;
+		}
+		auto it = std::find(pair->groups_.begin(), pair->groups_.end(), group);
+		if (join && it == pair->groups_.end()) {
+			pair->groups_.push_back(group);
+			worker.groups_[group].push_back(id);
+		} else if (!join && it != pair->groups_.end()) {
+			pair->groups_.erase(it);
+			serverLeaveGroup(worker, group, id);
+		}
+	}
+
+	void Network::serverLeaveGroup(Worker& worker, int group, int id) {
+		auto it = worker.groups_.find(group);
+		std::vector<int>& members = it->second;
+		*std::find(members.begin(), members.end(), id) = members.back();
+		members.pop_back();
+		if (members.empty()) {
+			worker.groups_.erase(it);
+		}
+	}
+
+	void Network::queue(Pair& remote, const Payload& payload, Delivery delivery, int channel) {
+		if (delivery == STREAM) {
+			remote.buffer_.sendBuffer_.push(payload);
+		} else if (!remote.buffer_.connection_.push(payload, delivery, channel)) {
+			remote.buffer_.sendBuffer_.push(createChannelPackage(payload, delivery, channel));
+		} else {
+			// Written to the datagrams by the same iteration of the network thread.
+			count(remote.buffer_, &TrafficCounters::packagesSent_, 1);
+			sendLatency_.record(nanoseconds(std::chrono::steady_clock::now() - payload.getTime()));
+		}
+	}
+
+	void Network::serverFlush(Worker& worker, bool pendingOnly) {
+		for (int i = worker.clients_.size() - 1; i >= 0; --i) {
+			Pair& remote = worker.clients_[i];
+			if (pendingOnly && !remote.buffer_.writeInterest_) {
+				continue;
+			}
+			if (!flush(worker, remote.socket_, remote.buffer_) || !serverLimitSendQueue(remote)) {
+				serverDisconnect(worker, worker.clients_.getId(i));
 			} else {
-				// Abort the while loop.
-				break;
+				updateQueueSize(remote.buffer_);
+			}
+		}
+	}
+
+	void Network::serverSendDatagrams(Worker& worker) {
+		auto time = std::chrono::steady_clock::now();
+		worker.unacked_ = false;
+		for (Pair& pair : worker.clients_) {
+			DatagramConnection& connection = pair.buffer_.connection_;
+			if (!pair.hasAddress_) {
+				// Reliable packages wait for the address.
+				connection.dropUnreliable();
+				continue;
+			}
+			DatagramQueue& datagrams = pair.buffer_.datagrams_;
+			long long resends = connection.getResends();
+			connection.write(datagrams, time);
+			countDatagrams(pair.buffer_, resends);
+			if (!datagrams.empty()) {
+				int size = worker.datagrams_.size();
+				worker.datagrams_.resize(size + datagrams.size());
+				datagrams.fill(worker.datagrams_.data() + size, pair.address_);
+			}
+			worker.unacked_ = worker.unacked_ || connection.hasUnacked();
+		}
+		sendDatagrams(worker);
+		for (Pair& pair : worker.clients_) {
+			pair.buffer_.datagrams_.clear();
+		}
+	}
+
+	void Network::serverSendSnapshot(Worker& worker, const Payload& payload) {
+		if (worker.snapshots_.empty()) {
+			worker.snapshots_.resize(SNAPSHOT_HISTORY);
+		}
+		int sequence = readId(payload.data());
+		Snapshot& snapshot = worker.snapshots_[sequence % SNAPSHOT_HISTORY];
+		snapshot = Snapshot(sequence, payload, PackageHeader::ID_SIZE);
+		std::map<int, Payload> packages; // Indexed by the baseline.
+		for (Pair& pair : worker.clients_) {
+			int baseline = pair.snapshotAck_;
+			if (baseline != 0 && worker.snapshots_[baseline % SNAPSHOT_HISTORY].sequence_ != baseline) {
+				// Too old, the whole snapshot is sent.
+				baseline = 0;
+			}
+			Payload& package = packages[baseline];
+			if (package.size() == 0) {
+				std::vector<char>& data = worker.snapshotData_;
+				data.resize(SNAPSHOT_HEADER_SIZE);
+				writeId(data.data(), sequence);
+				writeId(data.data() + PackageHeader::ID_SIZE, baseline);
+				const Snapshot* base = baseline != 0 ? &worker.snapshots_[baseline % SNAPSHOT_HISTORY] : nullptr;
+				encodeDelta(snapshot.data(), snapshot.size(), base ? base->data() : nullptr, base ? base->size() : 0, data);
+				char header[PackageHeader::MAX_SIZE];
+				int headerSize = writePackageHeader(header, SNAPSHOT_ID, data.size());
+				package = Payload(header, headerSize, data.data(), data.size());
+			}
+			queue(pair, package, UNRELIABLE, 0);
+		}
+	}
+
+	bool Network::serverLimitSendQueue(Pair& remote) {
+		SendQueue& queue = remote.buffer_.sendBuffer_;
+		int reliable = remote.buffer_.connection_.getQueuedSize();
+		int size = queue.size() + reliable;
+		if (size > highWatermark_) {
+			remote.buffer_.lagging_ = true;
+			// Only the stream can be dropped, the reliable datagrams wait for acks.
+			if (slowClientPolicy_ == DISCONNECT || reliable > highWatermark_) {
+				server_->eventBuffer_.push(SlowClientEvent(remote.client_, SlowClientEvent::DISCONNECTED, size));
+				return false;
+			}
+			if (slowClientPolicy_ == DROP_OLDEST) {
+				server_->eventBuffer_.push(SlowClientEvent(remote.client_, SlowClientEvent::DROPPED, queue.dropOldest(std::max(0, lowWatermark_ - reliable))));
+			} else {
+				server_->eventBuffer_.push(SlowClientEvent(remote.client_, SlowClientEvent::DROPPED, queue.keepLatest()));
+			}
+		} else if (remote.buffer_.lagging_ && size <= lowWatermark_) {
+			remote.buffer_.lagging_ = false;
+			server_->eventBuffer_.push(SlowClientEvent(remote.client_, SlowClientEvent::RECOVERED, 0));
+		}
+		return true;
+	}
+
+	void Network::serverDisconnect(Worker& worker, int id) {
+		Pair& remote = *worker.clients_.find(id);
+		worker.transport_->close(remote.socket_);
+		worker.interest_.remove(id);
+		for (int group : remote.groups_) {
+			serverLeaveGroup(worker, group, id);
+		}
+		sendQueueSize_.add(-remote.buffer_.queueSize_);
+		std::shared_ptr<Client> client = remote.client_;
+		worker.clients_.erase(id);
+		--clientCount_;
+		disconnected_.add(1);
+		if (disconnectHandler_) {
+			handle(Event(Event::DISCONNECT, Message(client, Packet())));
+		}
+	}
+
+	Network::Worker& Network::getWorker(int id) {
+		return *workers_[(id & SlotMap<Pair>::INDEX_MASK) % workers_.size()];
+	}
+
+	Payload Network::createPackage(int id, const Packet& packet, Delivery delivery, int channel) const {
+		if (compressor_ == nullptr) {
+			return net::createPackage(id, packet);
+		}
+		// Compressed on the sending thread, once for all receivers.
+		thread_local std::vector<char> frame;
+		frame.clear();
+		if (channel >= 0 && channel < 32 && (compressedChannels_[delivery] & (1u << channel)) != 0) {
+			compressor_->compress(packet.getData(), packet.size(), frame);
+		} else {
+			frame.push_back(0);
+			frame.insert(frame.end(), packet.getData(), packet.getData() + packet.size());
+		}
+		return net::createPackage(id, frame.data(), frame.size());
+	}
+
+	bool Network::readPacket(const RingBuffer& buffer, int index, const PackageHeader& header, Packet& packet) const {
+		if (compressor_ == nullptr) {
+			copyPackageData(buffer, index, header, packet);
+			return true;
+		}
+		index += header.headerSize_;
+		if (buffer.contiguousSize(index) >= header.dataSize_) {
+			return compressor_->decompress(buffer.data(index), header.dataSize_, maxPacketSize_, packet);
+		}
+		Packet frame;
+		frame.resize(header.dataSize_);
+		buffer.copy(index, frame.getData(), header.dataSize_);
+		return compressor_->decompress(frame.getData(), frame.size(), maxPacketSize_, packet);
+	}
+
+	int Network::getMaxDataSize() const {
+		return maxPacketSize_ + CHANNEL_HEADER_SIZE + PackageHeader::MAX_SIZE;
+	}
+
+	bool Network::hasValidSize(const PackageHeader& header) const {
+		return header.id_ == CHANNEL_ID || header.dataSize_ <= maxPacketSize_;
+	}
+
+	Payload Network::createChannelPackage(const Payload& package, Delivery delivery, int channel) {
+		std::vector<char> data(CHANNEL_HEADER_SIZE + package.size());
+		data[0] = (char) delivery;
+		writeId(data.data() + 1, channel);
+		std::copy(package.data(), package.data() + package.size(), data.data() + CHANNEL_HEADER_SIZE);
+		return net::createPackage(CHANNEL_ID, data.data(), data.size());
+	}
+
+	bool Network::readChannelPackage(const RingBuffer& buffer, int index, const PackageHeader& header,
+		RingBuffer& destination, Delivery& delivery, int& channel) {
+
+		if (header.dataSize_ < CHANNEL_HEADER_SIZE) {
+			return false;
+		}
+		index += header.headerSize_;
+		delivery = (Delivery) buffer[index];
+		if (delivery != UNRELIABLE && delivery != RELIABLE && delivery != RELIABLE_ORDERED) {
+			return false;
+		}
+		channel = PackageHeader::readId(buffer, index + 1);
+		destination.clear();
+		destination.append(buffer, index + CHANNEL_HEADER_SIZE, header.dataSize_ - CHANNEL_HEADER_SIZE);
+		return true;
+	}
+
+	void Network::sendToServer(const Packet& packet, Delivery delivery, int channel) {
+		if (server_ != nullptr) {
+			Message message(local_, Packet(packet), delivery, channel);
+			if (tickRate_ > 0 && listening_) {
+				// Pulled with the input of the remote clients.
+				localTickInput_.push(std::move(message));
+			} else {
+				receive(server_->receiveBuffer_, std::move(message));
+			}
+		} else {
+			// Connected to a remote server.
+			Payload payload = createPackage(Server::SERVER_ID, packet, delivery, channel);
+			if (delivery == STREAM) {
+				local_->sendBuffer_.push(std::move(payload));
+			} else {
+				local_->datagramSendBuffer_.push(Outgoing(Server::SERVER_ID, payload, delivery, channel));
 			}
+			wakeUp(*workers_[0]);
 		}
-		if (sizeSent > 0) {
-			// Remove all data which was sent.
-			server_->sendBuffer_.erase(local_->sendBuffer_.begin(), local_->sendBuffer_.begin() + sizeSent);
+	}
+
+	void Network::sendToClient(int senderId, std::shared_ptr<Client> receiver, const Packet& packet, Delivery delivery, int channel) {
+		if (receiver == local_) {
+			local_->serverReceiveBuffer_.push(Message(nullptr, Packet(packet)));
+		} else if (listening_) {
+			// Only the worker owning the connection.
+			post(getWorker(receiver->id_), Outgoing(receiver->id_, createPackage(senderId, packet, delivery, channel), delivery, channel));
 		}
-		mutex_.unlock();
 	}
 
-	void Network::sendToServer(char senderId, Packet packet) {
-		std::lock_guard<std::mutex> lock(mutex_);
-		server_->receiveBuffer_.push_back(packet.size() + 2);
-		server_->receiveBuffer_.push_back(senderId);
-		server_->receiveBuffer_.insert(server_->receiveBuffer_.end(), packet.getData(), packet.getData() + packet.size());
+	void Network::sendSnapshot(const Packet& snapshot) {
+		local_->snapshotBuffer_.push(Packet(snapshot));
+		if (listening_) {
+			char sequence[PackageHeader::ID_SIZE];
+			writeId(sequence, ++snapshotSequence_);
+			// Encoded by each worker for its own clients.
+			Outgoing outgoing(SNAPSHOT_ID, Payload(sequence, sizeof(sequence), snapshot.getData(), snapshot.size()), UNRELIABLE, 0);
+			for (auto& worker : workers_) {
+				post(*worker, outgoing);
+			}
+		}
 	}
 
-	void Network::sendToClient(char senderId, std::shared_ptr<Client> receiver, Packet packet) {
-		std::lock_guard<std::mutex> lock(mutex_);
-		receiver->receiveBuffer_.insert(receiver->receiveBuffer_.end(), packet.getData(), packet.getData() + packet.size());
-		//receiver->sendBuffer_.insert(receiver->sendBuffer_.end(), data, data + size);
+	void Network::setInterest(std::shared_ptr<Client> client, float x, float y, float radius) {
+		if (listening_ && client != local_) {
+			Packet packet;
+			packet.write(client->getId()).write(x).write(y).write(radius);
+			post(getWorker(client->id_), Outgoing(INTEREST_ID, Payload(packet.getData(), packet.size()), STREAM, 0));
+		}
 	}
 
-	void Network::sendToAll(char senderId, Packet packet) {
-		for (auto& pair : clients_) {
-			std::shared_ptr<Client>& client = pair.second.client_;
-			if (client->id_ != senderId) {
-				server_->receiveBuffer_.push_back(packet.size() + 2);
-				server_->receiveBuffer_.push_back(senderId);
-				server_->receiveBuffer_.insert(server_->receiveBuffer_.end(), packet.getData(), packet.getData() + packet.size());
+	void Network::sendToArea(int senderId, const Packet& packet, float x, float y, Delivery delivery, int channel) {
+		if (listening_) {
+			Outgoing outgoing(AREA_ID, createPackage(senderId, packet, delivery, channel), delivery, channel);
+			outgoing.x_ = x;
+			outgoing.y_ = y;
+			for (auto& worker : workers_) {
+				post(*worker, outgoing);
 			}
 		}
-		if (local_->id_ != senderId) {
-			local_->serverReceiveBuffer_.push_back(packet.size() + 2);
-			local_->serverReceiveBuffer_.push_back(senderId);
-			local_->serverReceiveBuffer_.insert(local_->serverReceiveBuffer_.end(), packet.getData(), packet.getData() + packet.size());
+	}
+
+	int Network::createGroup() {
+		return ++groupCount_;
+	}
+
+	void Network::setMember(int group, std::shared_ptr<Client> client, bool join) {
+		if (client == nullptr || client == local_) {
+			std::lock_guard<std::mutex> lock(groupMutex_);
+			auto it = std::find(localGroups_.begin(), localGroups_.end(), group);
+			if (join && it == localGroups_.end()) {
+				localGroups_.push_back(group);
+			} else if (!join && it != localGroups_.end()) {
+				localGroups_.erase(it);
+			}
+		}
+		if (listening_ && client != local_) {
+			Packet packet;
+			packet.write(group).write(client ? client->getId() : ALL_ID).write(join);
+			Outgoing outgoing(MEMBER_ID, Payload(packet.getData(), packet.size()), STREAM, 0);
+			if (client) {
+				post(getWorker(client->id_), outgoing);
+			} else {
+				for (auto& worker : workers_) {
+					post(*worker, outgoing);
+				}
+			}
 		}
 	}
 
-	std::shared_ptr<Client> Network::getClient(char id) {
-		for (auto& pair : clients_) {
-			std::shared_ptr<Client>& remote = pair.second.client_;
-			if (id == remote->id_) {
-				return remote;
+	void Network::sendToGroup(int senderId, int group, const Packet& packet, Delivery delivery, int channel) {
+		{
+			std::lock_guard<std::mutex> lock(groupMutex_);
+			if (std::find(localGroups_.begin(), localGroups_.end(), group) != localGroups_.end()) {
+				local_->serverReceiveBuffer_.push(Message(nullptr, Packet(packet)));
 			}
 		}
-		if (id == local_->id_) {
-			return local_;
+		if (listening_) {
+			Outgoing outgoing(GROUP_ID, createPackage(senderId, packet, delivery, channel), delivery, channel);
+			outgoing.group_ = group;
+			for (auto& worker : workers_) {
+				post(*worker, outgoing);
+			}
+		}
+	}
+
+	void Network::sendToAll(int senderId, const Packet& packet, Delivery delivery, int channel) {
+		if (senderId == Server::SERVER_ID) {
+			local_->serverReceiveBuffer_.push(Message(nullptr, Packet(packet)));
+		}
+		if (listening_) {
+			// Serialized once, shared by all workers.
+			Outgoing outgoing(ALL_ID, createPackage(senderId, packet, delivery, channel), delivery, channel);
+			for (auto& worker : workers_) {
+				post(*worker, outgoing);
+			}
+		} else if (server_ == nullptr) {
+			// Sent through the network thread to the remote server, which sends it
+			// to all other clients.
+			Payload payload = createPackage(ALL_ID, packet, delivery, channel);
+			if (delivery == STREAM) {
+				local_->sendBuffer_.push(std::move(payload));
+			} else {
+				local_->datagramSendBuffer_.push(Outgoing(ALL_ID, payload, delivery, channel));
+			}
+			wakeUp(*workers_[0]);
 		}
-		return nullptr;
 	}
 
 } // Namespace net.
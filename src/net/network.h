@@ -2,15 +2,32 @@
 #define NET_NETWORK_H
 
 #include "packet.h"
-
-#include <SDL_net.h>
+#include "transport.h"
+#include "ringbuffer.h"
+#include "sendqueue.h"
+#include "payload.h"
+#include "message.h"
+#include "mpscqueue.h"
+#include "slotmap.h"
+#include "datagramqueue.h"
+#include "datagramconnection.h"
+#include "delivery.h"
+#include "snapshot.h"
+#include "compressor.h"
+#include "stats.h"
+#include "interestgrid.h"
 
 #include <string>
 #include <vector>
-#include <map>
 #include <thread>
-#include <mutex>
 #include <memory>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 
 namespace net {
 
@@ -18,6 +35,7 @@ namespace net {
 	class Server;
 	class Remote;
 	class Client;
+	class PackageHeader;
 
 	class Network {
 	public:
@@ -25,9 +43,71 @@ namespace net {
 		friend class Server;
 		friend class Remote;
 
+		// What to do with a remote client whose send queue exceeds the high watermark,
+		// i.e. a client not reading the data fast enough.
+		enum SlowClientPolicy {
+			DISCONNECT,		// Disconnect the client.
+			DROP_OLDEST,	// Remove the oldest packages until below the low watermark.
+			KEEP_LATEST		// Remove all queued packages except the latest.
+		};
+
+		// Where the event handlers are called, see onConnect().
+		enum Dispatch {
+			IMMEDIATE,	// By the thread receiving the event, i.e. at once by any network thread. Must not block.
+			QUEUED		// Queued without locks and called by dispatchEvents().
+		};
+
+		typedef std::function<void(const std::shared_ptr<Client>&)> ConnectionHandler;
+		typedef std::function<void(const std::shared_ptr<Client>&, const Packet&)> MessageHandler;
+
+		// Use the default transport, i.e. SDL_net if the library is built with
+		// NETWORK_SDL_NET, otherwise posix sockets.
 		Network();
+
+		// Use the default transport and the number of threads serving the remote
+		// clients of a server. Each thread accepts and owns its own connections.
+		// SDL_net can not share the listen port and always use one thread.
+		explicit Network(int workers);
+
+		// Use the transport provided for all socket calls.
+		Network(std::unique_ptr<Transport> transport);
+
+		// Use one server thread per transport. The transports must be able to
+		// listen on the same port, e.g. PosixTransport with reusePort. A client
+		// connecting to a server only uses the first transport.
+		Network(std::vector<std::unique_ptr<Transport>> transports);
+
 		~Network();
 
+		// Set the max size in bytes of a packet received from the network. A remote
+		// sending a bigger packet is disconnected. Must be called before a server is
+		// created or a connection is made.
+		void setMaxPacketSize(int size);
+
+		// Set the max number of bytes queued to be sent to a remote client and the
+		// policy applied when it is exceeded. A client is reported as recovered when
+		// its queue is back below the low watermark. The reliable datagrams not yet
+		// acked are counted but never dropped, i.e. a client with more of them than
+		// the high watermark is disconnected. Must be called before a server is
+		// created.
+		void setSendQueueLimit(int highWatermark, int lowWatermark, SlowClientPolicy policy);
+
+		// Enable compression, i.e. each packet is sent as a frame telling if it is
+		// compressed, see compressor.h. The server and the clients must agree, a
+		// client connecting with another setting is disconnected. Packets smaller
+		// than the threshold are sent as is. The dictionary, the same on both ends,
+		// holds data common to many packets. Must be called before a server is
+		// created or a connection is made.
+		void setCompression(int threshold, const std::vector<char>& dictionary = std::vector<char>());
+
+		// Opt in the channel of the delivery to compression, STREAM only has channel 0.
+		// Packets on the other channels are never compressed. Only the channels in
+		// [0, 32) can be compressed, others are ignored.
+		void setCompressed(Delivery delivery, int channel, bool compressed);
+
+		// The compression counters, all zero when compression is not enabled.
+		CompressionStats getCompressionStats() const;
+
 		// Get the local client which serve as the local receiver and sender.
 		// A call must have been made to create a server or connect to a server.
 		// Otherwise a nullptr is return.
@@ -40,74 +120,460 @@ namespace net {
 		// Create a "local" server, i.e. a server without internet and remote connections.
 		std::shared_ptr<Server> createLocalServer();
 
-		// Return the latest client connected. Return null when there are no more 
-		// clients to pull.
+		// Return the next remote client connected to the server, in the order
+		// connected. Clients already disconnected are skipped. Return null when
+		// there are no more clients to pull. Not used with an onConnect() handler.
 		std::shared_ptr<Client> pullNewConnections();
 
-		// Connect to a server with the port and ip provided.
-		void connectToServer(int port, std::string ip);
+		// Connect to a server with the port and ip provided. Return false if the
+		// transport fails to start, no event is raised then. A connection failing
+		// later raises a disconnect, see onDisconnect().
+		bool connectToServer(int port, std::string ip);
+
+		// The number of send calls made to the transport by the network thread.
+		long long getSendCalls() const;
+
+		// The number of send calls saved by sending all queued packages to a
+		// socket at once, i.e. the packages sent minus the send calls.
+		long long getSavedSendCalls() const;
+
+		// The counters, gauges and send latency of all connections. The stats of
+		// one connection are given by Client::getStats(). Thread safe.
+		NetworkStats getStats() const;
+
+		// Set the counters and the latency histogram to zero, the gauges are kept.
+		// The buffer pool counters are shared by all networks. Thread safe.
+		void resetStats();
+
+		// Set the size of the cells of the grid used to find the clients interested
+		// in a location, see Server::sendToArea(). About the typical interest radius
+		// is a good size. Must be called before a server is created.
+		void setInterestCellSize(float size);
+
+		// Run the server at the rate in ticks per second, 0 turns tick mode off. The
+		// packets received by the server are pulled in one batch per tick, see
+		// Server::waitForTick(), and the packets sent are written at the next tick,
+		// at once for each client. Must be called before a server is created. A
+		// local server has no ticks.
+		void setTickRate(int rate);
+
+		// Set where the event handlers are called. The notify function, if any, is
+		// called by the thread queuing an event, e.g. to schedule dispatchEvents()
+		// on an executor, and must not block. Must be called before a server is
+		// created or a connection is made.
+		void setDispatch(Dispatch dispatch, const std::function<void()>& notify = nullptr);
+
+		// Called when a remote client connects to the server, or when the local
+		// client is connected to a remote server. Must be called before a server
+		// is created or a connection is made, as must the other handlers.
+		void onConnect(const ConnectionHandler& handler);
+
+		// Called when a remote client is disconnected, or when the local client
+		// loses, or fails to make, the connection to the remote server.
+		void onDisconnect(const ConnectionHandler& handler);
+
+		// Called for each packet received on the channel of the delivery by the
+		// server, or by the local client from a remote server, instead of the packet
+		// being pulled. The sender is null for a packet from the server. The packet
+		// is only valid during the call.
+		void onMessage(Delivery delivery, int channel, const MessageHandler& handler);
+
+		// Called for the packets received on the channels without a handler.
+		void onMessage(const MessageHandler& handler);
+
+		// Call the handlers of the queued events in the order queued, see
+		// setDispatch(). Must not be called by two threads at once. Return the
+		// number of events.
+		int dispatchEvents();
+
+		// Call the function, i.e. function(text), with the stats in the Prometheus
+		// text format every interval milliseconds. Called by the first network
+		// thread, i.e. the function must not block. Must be called before a server
+		// is created or a connection is made.
+		void setStatsDump(int interval, const std::function<void(const std::string&)>& function);
 
 	private:
+		// Receiver id used by a remote client to send a package to all other clients.
+		static const int ALL_ID = -1;
+
+		// Id of the local client of a server. Remote clients get the id of their
+		// slot in the client table of the worker owning the connection, which is
+		// always greater.
+		static const int LOCAL_ID = 1;
+
+		// Id of the packages holding a snapshot, sent by the server, or the ack of
+		// a snapshot, sent by a client.
+		static const int SNAPSHOT_ID = -2;
+
+		// Receiver id of a package sent to the clients interested in its location.
+		static const int AREA_ID = -3;
+
+		// Receiver id of a mailbox entry setting the area of a client. The payload
+		// is the id of the client, the position and the radius, see Packet::write().
+		static const int INTEREST_ID = -4;
+
+		// Receiver id of a package sent to the members of a group.
+		static const int GROUP_ID = -5;
+
+		// Receiver id of a mailbox entry joining or leaving a group. The payload is
+		// the group, the id of the client, ALL_ID removes the group, and true if
+		// joining, see Packet::write().
+		static const int MEMBER_ID = -6;
+
+		// Id of a package streamed in place of its datagram channel, e.g. too big
+		// for a datagram. The data is the delivery, the channel and the package,
+		// i.e. it is received the same way as sent.
+		static const int CHANNEL_ID = -7;
+
+		// The delivery byte and the channel before the package of a CHANNEL_ID package.
+		static const int CHANNEL_HEADER_SIZE = 5;
+
+		// The number of snapshots kept as possible baselines.
+		static const int SNAPSHOT_HISTORY = 32;
+
+		// A snapshot package starts with its sequence and the sequence of the
+		// baseline, 0 if none. Followed by the delta, see snapshot.h.
+		static const int SNAPSHOT_HEADER_SIZE = 8;
+
+		static const int DEFAULT_MAX_PACKET_SIZE = 65536;
+
+		static const int DEFAULT_HIGH_WATERMARK = 4 * 1024 * 1024;
+		static const int DEFAULT_LOW_WATERMARK = 1024 * 1024;
+
+		// Max number of bytes read from a socket at once.
+		static const int RECEIVE_SIZE = 4096;
+
+		// Max number of queued packages sent by one transport call.
+		static const int SEND_SEGMENTS = 64;
+
+		// Max size of a datagram, small enough to not be fragmented over the internet.
+		static const int MAX_DATAGRAM_SIZE = 1200;
+
+		// Max number of datagrams sent or received by one transport call.
+		static const int DATAGRAM_BATCH = 32;
+
+		// Every datagram starts with the id and the token of the client.
+		static const int DATAGRAM_HEADER_SIZE = 8;
+
+		// Sent by the server when a client connects, the id and the token of the
+		// client, the port of the server's datagram socket and the flags.
+		static const int HANDSHAKE_SIZE = 11;
+
+		// Handshake flag, the packets are sent as compression frames.
+		static const int HANDSHAKE_COMPRESSION = 1;
+
+		// Time in milliseconds between the pings sent by a client until the server
+		// answers, i.e. until the server knows the client's address.
+		static const int HELLO_INTERVAL = 100;
+
+		// Max time in milliseconds the network thread blocks while reliable
+		// datagrams wait to be acked, i.e. how often resends are checked.
+		static const int RESEND_INTERVAL = 10;
+
+		// Max time in milliseconds the network thread blocks waiting for socket activity.
+		// The thread is woken up earlier by any socket activity or by a call to wakeUp().
+		static const int WAIT_TIMEOUT = 1000;
+
 		class Buffer {
 		public:
+			Buffer() : datagrams_(MAX_DATAGRAM_SIZE),
+				connection_(MAX_DATAGRAM_SIZE - DATAGRAM_HEADER_SIZE - DatagramConnection::HEADER_SIZE - DatagramConnection::ENTRY_HEADER_SIZE) {
+
+
+				writeInterest_ = false;
+				lagging_ = false;
+				client_ = nullptr;
+				queueSize_ = 0;
+			}
+
 			void receive(const char data[], int size) {
-				receiveBuffer_.insert(receiveBuffer_.end(), data, data + size);
-				sendBuffer_.insert(receiveBuffer_.end(), data, data + size);
+				receiveBuffer_.append(data, size);
 			}
-			void removeFromSendBuffer(int size) {
-				sendBuffer_.erase(sendBuffer_.begin(), sendBuffer_.begin() + size);
+			void removeFromReceiveBuffer(int size) {
+				receiveBuffer_.pop_front(size);
 			}
 
-			std::vector<char> receiveBuffer_;
-			std::vector<char> sendBuffer_;
+			RingBuffer receiveBuffer_;
+			SendQueue sendBuffer_;
+			DatagramQueue datagrams_; // Written by the connection, waiting to be sent.
+			DatagramConnection connection_;
+			bool writeInterest_; // Waiting for the socket to be writable.
+			bool lagging_; // Has exceeded the high watermark and not yet recovered.
+			Client* client_; // Holds the stats of the connection.
+			int queueSize_; // The send queue size last added to the stats.
 		};
 
 		class Pair {
 		public:
 			Pair() {
 				client_ = nullptr;
+				socket_ = Transport::NO_SOCKET;
+				token_ = 0;
+				hasAddress_ = false;
+				snapshotAck_ = 0;
 			}
 
-			Pair(const std::shared_ptr<Client>& client) : client_(client) {
+			Pair(Socket socket) : socket_(socket) {
+				token_ = 0;
+				hasAddress_ = false;
+				snapshotAck_ = 0;
 			}
 
 			std::shared_ptr<Client> client_;
+			Socket socket_;
 			Buffer buffer_;
+			int token_; // Secret sent in the handshake, proves the sender of a datagram.
+			Address address_; // The address of the client's datagram socket.
+			bool hasAddress_;
+			int snapshotAck_; // The latest snapshot acked by the client, 0 if none.
+			std::vector<int> groups_; // The groups joined.
 		};
 
+		// A network thread and the connections it owns. A client connecting to
+		// a server only uses the first worker. The slot indexes of the workers'
+		// client tables are interleaved, i.e. the owner is known from the client id.
+		class Worker {
+		public:
+			Worker(std::unique_ptr<Transport> transport, int index, int workers) : transport_(std::move(transport)),
+				clients_(workers, index), random_(std::random_device()()) {
+
+				listenSocket_ = Transport::NO_SOCKET;
+				datagramSocket_ = Transport::NO_SOCKET;
+				wakeupPending_ = false;
+				unacked_ = false;
+				tick_ = 0;
+				nextTick_ = 1;
+			}
+
+			std::unique_ptr<Transport> transport_;
+			Socket listenSocket_;
+			Socket datagramSocket_;
+			std::atomic<bool> wakeupPending_;
+			SlotMap<Pair> clients_; // Indexed by client id.
+			// Packages sent by the application or relayed by other workers.
+			MpscQueue<Outgoing> mailbox_;
+			std::thread thread_;
+			std::mt19937 random_;
+			std::vector<char> datagramData_; // Datagrams are received to here.
+			std::vector<Datagram> datagrams_;
+			RingBuffer datagramBuffer_; // The packages of a received datagram.
+			RingBuffer packageBuffer_; // A package received by a datagram connection.
+			bool unacked_; // Any client has reliable datagrams not yet acked.
+			std::vector<Snapshot> snapshots_; // Indexed by sequence % SNAPSHOT_HISTORY.
+			std::vector<char> snapshotData_;
+			InterestGrid interest_; // The areas of the worker's clients.
+			// The ids of the worker's clients in each group, indexed by group.
+			std::unordered_map<int, std::vector<int>> groups_;
+			Counter mailboxSize_;
+			// Tick mode.
+			std::atomic<long long> tick_; // The latest tick done.
+			long long nextTick_;
+			std::vector<Message> tickInput_; // Received by the server until the next tick.
+		};
+
+		// Init the transport event loop of the workers used.
+		bool initEventLoop(int workers);
+
+		// Block until any socket of the worker is ready, until wakeUp() is called
+		// or until the timeout in milliseconds expires.
+		void waitForEvents(Worker& worker, int timeout = WAIT_TIMEOUT);
+
+		// Wake up the network thread, i.e. there is new data to be sent. Thread safe.
+		void wakeUp(Worker& worker);
+
+		// Push the package to the mailbox of the worker and wake it up. Thread safe.
+		void post(Worker& worker, const Outgoing& outgoing);
+
+		// Add the value to the counter of the network and of the buffer's connection.
+		void count(Buffer& buffer, Counter TrafficCounters::* counter, long long value);
+
+		// Update the send queue gauges of the buffer's connection and of the network.
+		void updateQueueSize(Buffer& buffer);
+
+		// Count the datagrams written by the connection and its resends.
+		void countDatagrams(Buffer& buffer, long long resends);
+
+		// Call the handler of the event, or queue it in QUEUED dispatch.
+		void handle(Event&& event);
+
+		// Call the handler of the event, if any.
+		void callHandler(const Event& event);
+
+		// The handler of the message, null if it is to be pulled.
+		const MessageHandler* getHandler(const Message& message) const;
+
+		// Pass the message to its handler, or push it to the queue to be pulled.
+		void receive(MpscQueue<Message>& queue, Message&& message);
+
+		// Call the stats dump function if it is due. Return the time in milliseconds
+		// until the next dump.
+		int dumpStats();
+
+		// Send as much as possible of the buffer's send data, all queued packages
+		// are sent at once. The rest is sent when the socket becomes writable.
+		// Return false if the connection is lost.
+		bool flush(Worker& worker, Socket socket, Buffer& buffer);
+
+		// Receive datagrams to the worker's datagram data. Return the number of
+		// datagrams received, stored first in worker.datagrams_.
+		int receiveDatagrams(Worker& worker);
+
+		// Send all datagrams in worker.datagrams_, the ones not sent are dropped.
+		void sendDatagrams(Worker& worker);
+
+		// Copy the datagram, without the id and token, to worker.datagramBuffer_.
+		// Return the id of the client in the header, 0 if the datagram is invalid.
+		int readDatagram(Worker& worker, const Datagram& datagram, int& token);
+
 		void clientRun();
+		bool clientReceiveData(Socket socket);
+		// Handle the whole packages in the buffer from the index. Return the index
+		// after the last one handled, -1 if the data is invalid.
+		int clientHandlePackages(const RingBuffer& buffer, int index, Delivery delivery, int channel);
+		// Return false if the server sent invalid data.
+		bool clientReceiveDatagrams();
+		bool clientSendData(Socket socket);
+		void clientSendDatagrams();
+		// Reconstruct the snapshot from the delta, push it to the local client and
+		// ack it. Return false if the data is invalid.
+		bool clientReceiveSnapshot(const Packet& packet);
 
-		void serverRun();
+		void serverRun(Worker& worker);
+		// Publish the input received by the server and send the output, i.e. all
+		// done once per tick in tick mode.
+		void serverTick(Worker& worker, std::chrono::steady_clock::time_point time);
+		// Return the time when the tick is due.
+		std::chrono::steady_clock::time_point getTickTime(long long tick) const;
+		// Block until a tick after the tick is done by all workers or until the
+		// timeout in milliseconds expires. Return the tick, 0 on timeout.
+		long long waitForTick(long long tick, int timeout);
 		bool serverListen(int port);
-		void serverHandleNewConnection();
-		void serverReceiveData();
-		void serverSendLocalData();
-		void serverSendServerData();
+		void serverHandleNewConnection(Worker& worker);
+		void serverReceiveData(Worker& worker);
+		bool serverHandleReceivedData(Worker& worker, int id, Pair& remote);
+		// Handle the whole packages in the buffer. Relayed packages are sent the
+		// same way as received. Return the number of bytes handled, -1 if the data
+		// is invalid.
+		int serverHandlePackages(Worker& worker, int id, Pair& remote, RingBuffer& buffer, Delivery delivery, int channel);
+		void serverReceiveDatagrams(Worker& worker);
+		void serverSendDatagrams(Worker& worker);
+		// Queue the snapshot to each client, encoded against the latest snapshot
+		// the client acked. Clients sharing the baseline share the package.
+		void serverSendSnapshot(Worker& worker, const Payload& payload);
+		// Queue the package to the remote client, datagrams are only sent when the
+		// client's address is known. Ordered packages too big for a datagram are
+		// sent as fragments, other ones are streamed with the delivery and channel.
+		void queue(Pair& remote, const Payload& payload, Delivery delivery, int channel);
+		// Move the packages in the mailbox to the send queue of each receiving client.
+		void serverSendMailData(Worker& worker);
+		// Apply a MEMBER_ID mailbox entry.
+		void serverSetMember(Worker& worker, const Payload& payload);
+		// Remove the client from the member array of the group.
+		void serverLeaveGroup(Worker& worker, int group, int id);
+		// Send the data queued for each client. Only the clients waiting for the
+		// socket to be writable if pendingOnly is true.
+		void serverFlush(Worker& worker, bool pendingOnly = false);
+		// Apply the slow client policy if the send queue exceeds the high watermark.
+		// Return false if the client is to be disconnected.
+		bool serverLimitSendQueue(Pair& remote);
+		void serverDisconnect(Worker& worker, int id);
+
+		// Return the worker owning the connection to the remote client.
+		Worker& getWorker(int id);
 
-		// Must be a whole package.
-		void sendToServer(char senderId, Packet packet);
-		// Must be a whole package.
-		void sendToAll(char senderId, Packet packet);
-		// Must be a whole package.
-		void sendToClient(char senderId, std::shared_ptr<Client> receiver, Packet packet);
+		// Create the package of the packet, as a compression frame when enabled.
+		Payload createPackage(int id, const Packet& packet, Delivery delivery, int channel) const;
+		// Copy the data of the package to the packet, decompressed when needed.
+		// Return false if the data is invalid.
+		bool readPacket(const RingBuffer& buffer, int index, const PackageHeader& header, Packet& packet) const;
 
-		std::shared_ptr<Client> getClient(char id);
+		// The max data size of a package received, only a CHANNEL_ID package may
+		// be bigger than the max packet size, see hasValidSize().
+		int getMaxDataSize() const;
+		bool hasValidSize(const PackageHeader& header) const;
+		// Wrap the package as a CHANNEL_ID package.
+		static Payload createChannelPackage(const Payload& package, Delivery delivery, int channel);
+		// Copy the package wrapped by the CHANNEL_ID package at the index to the
+		// destination. Return false if the data is invalid.
+		static bool readChannelPackage(const RingBuffer& buffer, int index, const PackageHeader& header,
+			RingBuffer& destination, Delivery& delivery, int& channel);
+
+		// Packets too big for a datagram are streamed, unless ordered, see queue().
+		void sendToServer(const Packet& packet, Delivery delivery, int channel);
+		// The packet is serialized once and the same payload is queued to all clients.
+		void sendToAll(int senderId, const Packet& packet, Delivery delivery, int channel);
+		void sendToClient(int senderId, std::shared_ptr<Client> receiver, const Packet& packet, Delivery delivery, int channel);
+		void sendSnapshot(const Packet& snapshot);
+		void setInterest(std::shared_ptr<Client> client, float x, float y, float radius);
+		int createGroup();
+		// Join if true, else leave. A null client removes the group.
+		void setMember(int group, std::shared_ptr<Client> client, bool join);
+		// Serialized once and posted once to each worker, which queues it to its
+		// members in one pass.
+		void sendToGroup(int senderId, int group, const Packet& packet, Delivery delivery, int channel);
+		// Serialized once, each worker looks up its clients interested in the location.
+		void sendToArea(int senderId, const Packet& packet, float x, float y, Delivery delivery, int channel);
 
 		std::shared_ptr<Server> server_;
 		Buffer networkBuffer_;
 
 		std::shared_ptr<Local> local_;
 
-		std::vector<TCPsocket> sockets_;
-		TCPsocket listenSocket_;
-		SDLNet_SocketSet socketSet_;
-		IPaddress ip_;
-		bool active_;
-		int lastId_;
-
-		std::map<TCPsocket, Pair> clients_;
-		std::thread thread_;
-		std::mutex mutex_;
+		std::vector<std::unique_ptr<Worker>> workers_;
+		int activeWorkers_; // Number of workers with a running thread.
+		bool listening_;
+		bool connected_;
+		// The client's datagram state.
+		int token_;
+		Address serverAddress_;
+		bool datagramConnected_; // The server knows the datagram address.
+		std::chrono::steady_clock::time_point helloTime_;
+		// The client's snapshots, indexed by sequence % SNAPSHOT_HISTORY.
+		std::vector<Snapshot> receivedSnapshots_;
+		int latestSnapshot_;
+		std::atomic<int> snapshotSequence_; // The last snapshot sent by the server.
+		std::unique_ptr<Compressor> compressor_; // Null if compression is not enabled.
+		unsigned int compressedChannels_[RELIABLE_ORDERED + 1]; // Bit i is channel i, indexed by delivery.
+		float interestCellSize_;
+		std::atomic<int> groupCount_; // The latest group created.
+		std::vector<int> localGroups_; // The groups joined by the local client.
+		std::mutex groupMutex_; // Guards localGroups_.
+		std::string ip_;
+		int port_;
+		int maxPacketSize_;
+		int highWatermark_;
+		int lowWatermark_;
+		SlowClientPolicy slowClientPolicy_;
+		std::atomic<bool> active_;
+		std::atomic<int> clientCount_;
+		TrafficCounters traffic_;
+		Counter savedSendCalls_;
+		Counter accepted_;
+		Counter disconnected_;
+		Counter sendQueueSize_;
+		LatencyRecorder sendLatency_;
+		// Tick mode, off if the rate is 0.
+		int tickRate_;
+		std::chrono::steady_clock::time_point tickStart_; // The time of tick 0.
+		std::mutex tickMutex_;
+		std::condition_variable tickCondition_; // Notified when a worker is done with a tick.
+		Counter ticks_;
+		Counter tickOverruns_;
+		LatencyRecorder tickJitter_;
+		LatencyRecorder tickDuration_;
+		MpscQueue<Message> localTickInput_; // Sent by the local client until the next tick of the first worker.
+		// Event handlers, see onConnect().
+		Dispatch dispatch_;
+		std::function<void()> notify_;
+		ConnectionHandler connectHandler_;
+		ConnectionHandler disconnectHandler_;
+		MessageHandler messageHandler_;
+		std::vector<MessageHandler> channelHandlers_[RELIABLE_ORDERED + 1]; // Indexed by delivery and channel.
+		MpscQueue<Event> events_; // QUEUED dispatch.
+		MpscQueue<std::weak_ptr<Client>> connections_; // Pulled by pullNewConnections().
+		std::function<void(const std::string&)> statsDump_;
+		int statsInterval_;
+		std::chrono::steady_clock::time_point statsTime_; // The latest dump.
 	};
 
 } // Namespace net.
@@ -0,0 +1,143 @@
+#ifndef NET_PACKAGE_H
+#define NET_PACKAGE_H
+
+#include "packet.h"
+#include "payload.h"
+#include "ringbuffer.h"
+
+namespace net {
+
+	// A package is a packet with a header, the format used in all buffers and
+	// sent over the network.
+	// Byte:
+	// 1 -> N: SIZE, the size of CLIENT_ID and DATA as a varint (LEB128)
+	// N + 1 -> N + 4: CLIENT_ID, 32 bit little-endian
+	// N + 5 -> N + SIZE: DATA
+	class PackageHeader {
+	public:
+		// The max number of bytes of the size varint, i.e. 32 bits.
+		static const int MAX_VARINT_SIZE = 5;
+
+		// The number of bytes of the client id.
+		static const int ID_SIZE = 4;
+
+		// The max size of a header.
+		static const int MAX_SIZE = MAX_VARINT_SIZE + ID_SIZE;
+
+		enum Status {
+			WHOLE,
+			INCOMPLETE,
+			INVALID
+		};
+
+		PackageHeader() {
+			headerSize_ = 0;
+			dataSize_ = 0;
+			id_ = 0;
+		}
+
+		// Read the header of the package at the index. Return INVALID if the
+		// header is corrupt or the data is larger than maxDataSize.
+		Status read(const RingBuffer& buffer, int index, int maxDataSize) {
+			unsigned int size = 0;
+			for (int i = 0; i < MAX_VARINT_SIZE; ++i) {
+				if (index + i >= buffer.size()) {
+					return INCOMPLETE;
+				}
+				unsigned char byte = buffer[index + i];
+				size |= (unsigned int) (byte & 0x7f) << (7 * i);
+				if ((byte & 0x80) == 0) {
+					if (size < ID_SIZE || size - ID_SIZE > (unsigned int) maxDataSize) {
+						return INVALID;
+					}
+					headerSize_ = i + 1 + ID_SIZE;
+					dataSize_ = size - ID_SIZE;
+					if (buffer.size() - index < headerSize_ + dataSize_) {
+						return INCOMPLETE;
+					}
+					id_ = readId(buffer, index + i + 1);
+					return WHOLE;
+				}
+			}
+			return INVALID;
+		}
+
+		// The size of the whole package.
+		int size() const {
+			return headerSize_ + dataSize_;
+		}
+
+		// Replace the id of the package at the index.
+		void writeId(RingBuffer& buffer, int index, int id) const {
+			index += headerSize_ - ID_SIZE;
+			for (int i = 0; i < ID_SIZE; ++i) {
+				buffer[index + i] = (char) ((unsigned int) id >> (8 * i));
+			}
+		}
+
+		// Read an id stored at the index.
+		static int readId(const RingBuffer& buffer, int index) {
+			unsigned int id = 0;
+			for (int i = 0; i < ID_SIZE; ++i) {
+				id |= (unsigned int) (unsigned char) buffer[index + i] << (8 * i);
+			}
+			return (int) id;
+		}
+
+		int headerSize_; // Including the id.
+		int dataSize_;
+		int id_;
+	};
+
+	// Write the id to the destination, which must hold PackageHeader::ID_SIZE bytes.
+	inline void writeId(char* destination, int id) {
+		for (int i = 0; i < PackageHeader::ID_SIZE; ++i) {
+			destination[i] = (char) ((unsigned int) id >> (8 * i));
+		}
+	}
+
+	// Read an id stored at the source, which must hold PackageHeader::ID_SIZE bytes.
+	inline int readId(const char* source) {
+		unsigned int id = 0;
+		for (int i = 0; i < PackageHeader::ID_SIZE; ++i) {
+			id |= (unsigned int) (unsigned char) source[i] << (8 * i);
+		}
+		return (int) id;
+	}
+
+	// Write the header of a package with the data size to the destination, which
+	// must hold at least PackageHeader::MAX_SIZE bytes. Return the size of the header.
+	inline int writePackageHeader(char* destination, int id, int size) {
+		unsigned int value = size + PackageHeader::ID_SIZE;
+		int index = 0;
+		while (value >= 0x80) {
+			destination[index++] = (char) (value | 0x80);
+			value >>= 7;
+		}
+		destination[index++] = (char) value;
+		writeId(destination + index, id);
+		return index + PackageHeader::ID_SIZE;
+	}
+
+	// Create a payload holding the data as a package.
+	inline Payload createPackage(int id, const char* packageData, int size) {
+		char header[PackageHeader::MAX_SIZE];
+		int headerSize = writePackageHeader(header, id, size);
+		return Payload(header, headerSize, packageData, size);
+	}
+
+	// Create a payload holding the packet as a package.
+	inline Payload createPackage(int id, const Packet& packet) {
+		return createPackage(id, packet.getData(), packet.size());
+	}
+
+	// Copy the data of the package at the index to the packet.
+	inline void copyPackageData(const RingBuffer& buffer, int index, const PackageHeader& header, Packet& packet) {
+		packet.clear();
+		packet.resize(header.dataSize_);
+		buffer.copy(index + header.headerSize_, packet.getData(), header.dataSize_);
+	}
+
+} // Namespace net.
+
+#endif // NET_PACKAGE_H
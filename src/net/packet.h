@@ -1,35 +1,107 @@
 #ifndef MW_PACKET_H
 #define MW_PACKET_H
 
+#include "bufferpool.h"
+
 #include <array>
+#include <vector>
 #include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// The byte order of the host, the packet data is always little-endian.
+#if defined(_WIN32) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define NET_LITTLE_ENDIAN 1
+#else
+#define NET_LITTLE_ENDIAN 0
+#endif
 
 namespace net {
 
+	// The bytes of a value of type T are reversed when written or read, i.e.
+	// arithmetic types and enums on a big-endian host.
+	template <class T>
+	class SwapBytes {
+	public:
+		static const bool value = !NET_LITTLE_ENDIAN && sizeof(T) > 1 && (std::is_arithmetic<T>::value || std::is_enum<T>::value);
+	};
+
+	// The data of a packet is written to the back and read from the front. The
+	// typed write and read functions use little-endian byte order, a trivially
+	// copyable type is copied with one memcpy on a little-endian host. A read
+	// never passes the end of the data, it fails and marks the packet as failed.
 	class Packet {
 	public:
-		static const size_t MAX_SIZE = 128;
+		// Packets up to this size are stored inside the packet, bigger packets
+		// are stored in a chunk of the buffer pool.
+		static const int INLINE_SIZE = 128;
 
 		Packet() {
+			heap_ = nullptr;
+			heapSize_ = 0;
 			index_ = 0;
 			size_ = 0;
+			failed_ = false;
 		}
 
-		Packet(const char* data, int size) {
-			index_ = 0;
-			std::copy(data, data + size, data_.data());
-			size_ = size;
+		Packet(const char* data, int size) : Packet() {
+			append(data, size);
+		}
+
+		Packet(const Packet& packet) : Packet() {
+			*this = packet;
+		}
+
+		Packet(Packet&& packet) : Packet() {
+			*this = std::move(packet);
+		}
+
+		~Packet() {
+			if (heap_ != nullptr) {
+				BufferPool::deallocate(heap_, heapSize_);
+			}
+		}
+
+		// Only the data is copied, the memory already held is reused.
+		Packet& operator=(const Packet& packet) {
+			if (this != &packet) {
+				clear();
+				append(packet.getData(), packet.size_);
+				index_ = packet.index_;
+				failed_ = packet.failed_;
+			}
+			return *this;
+		}
+
+		// Takes the memory of a packet stored in the buffer pool.
+		Packet& operator=(Packet&& packet) {
+			if (this == &packet) {
+				return *this;
+			}
+			if (packet.heap_ == nullptr) {
+				clear();
+				append(packet.getData(), packet.size_);
+			} else {
+				std::swap(heap_, packet.heap_);
+				std::swap(heapSize_, packet.heapSize_);
+				size_ = packet.size_;
+			}
+			index_ = packet.index_;
+			failed_ = packet.failed_;
+			packet.clear();
+			return *this;
 		}
 
-		// Dangerous if the size of the packet is to big.
 		Packet& operator<<(const Packet& packet) {
-			std::copy(packet.data_.data(), packet.data_.data() + packet.size_, data_.data() + size_);
-			size_ += packet.size_;
+			append(packet.getData(), packet.size_);
 			return *this;
 		}
 
+		// The byte is unchanged if there is no data left to read.
 		Packet& operator>>(char& byte) {
-			byte = data_[index_++];
+			read(byte);
 			return *this;
 		}
 
@@ -39,29 +111,252 @@ namespace net {
 		}
 
 		const char* getData() const {
-			return data_.data();
+			return heap_ == nullptr ? inline_.data() : heap_;
+		}
+
+		char* getData() {
+			return heap_ == nullptr ? inline_.data() : heap_;
 		}
 
 		int size() const {
 			return size_;
 		}
 
+		// The number of bytes the packet can hold without allocating memory.
+		int capacity() const {
+			return heap_ == nullptr ? INLINE_SIZE : BufferPool::getCapacity(heapSize_);
+		}
+
 		inline void push_back(char byte) {
-			data_[size_++] = byte;
+			reserve(size_ + 1);
+			getData()[size_++] = byte;
+		}
+
+		void append(const char* data, int size) {
+			reserve(size_ + size);
+			std::copy(data, data + size, getData() + size_);
+			size_ += size;
+		}
+
+		// Change the size, new bytes are uninitialized.
+		void resize(int size) {
+			reserve(size);
+			size_ = size;
+		}
+
+		// Make the packet empty, the memory is kept.
+		void clear() {
+			index_ = 0;
+			size_ = 0;
+			failed_ = false;
+		}
+
+		void reserve(int size) {
+			if (size > capacity()) {
+				int heapSize = std::max(size, 2 * capacity());
+				char* heap = static_cast<char*>(BufferPool::allocate(heapSize));
+				std::copy(getData(), getData() + size_, heap);
+				if (heap_ != nullptr) {
+					BufferPool::deallocate(heap_, heapSize_);
+				}
+				heap_ = heap;
+				heapSize_ = heapSize;
+			}
 		}
 
 		char operator[](int index) const {
-			return data_[index];
+			return getData()[index];
 		}
 
 		unsigned int dataLeftToRead() const {
 			return size_ - index_;
 		}
 
+		// True if a read failed, i.e. there was not enough data left to read.
+		bool failed() const {
+			return failed_;
+		}
+
+		// Mark the packet as failed, e.g. when the data read is invalid.
+		void fail() {
+			failed_ = true;
+		}
+
+		// Write an arithmetic type, an enum or any trivially copyable type.
+		template <class T>
+		Packet& write(const T& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written");
+			reserve(size_ + sizeof(T));
+			char* destination = getData() + size_;
+			std::memcpy(destination, &value, sizeof(T));
+			if (SwapBytes<T>::value) {
+				std::reverse(destination, destination + sizeof(T));
+			}
+			size_ += sizeof(T);
+			return *this;
+		}
+
+		template <class T, std::size_t N>
+		Packet& write(const std::array<T, N>& values) {
+			return write(values.data(), N);
+		}
+
+		template <class T, std::size_t N>
+		Packet& write(const T (&values)[N]) {
+			return write(values, N);
+		}
+
+		// Write the values, with one memcpy if the bytes are not swapped.
+		template <class T>
+		Packet& write(const T* values, int nbr) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written");
+			if (SwapBytes<T>::value) {
+				for (int i = 0; i < nbr; ++i) {
+					write(values[i]);
+				}
+			} else {
+				append(reinterpret_cast<const char*>(values), nbr * sizeof(T));
+			}
+			return *this;
+		}
+
+		// Read a value written by write(). Return false, without changing the
+		// value, if there is not enough data left to read.
+		template <class T>
+		bool read(T& value) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read");
+			if (!canRead(sizeof(T))) {
+				return false;
+			}
+			const char* source = getData() + index_;
+			if (SwapBytes<T>::value) {
+				char bytes[sizeof(T)];
+				std::reverse_copy(source, source + sizeof(T), bytes);
+				std::memcpy(&value, bytes, sizeof(T));
+			} else {
+				std::memcpy(&value, source, sizeof(T));
+			}
+			index_ += sizeof(T);
+			return true;
+		}
+
+		template <class T, std::size_t N>
+		bool read(std::array<T, N>& values) {
+			return read(values.data(), N);
+		}
+
+		template <class T, std::size_t N>
+		bool read(T (&values)[N]) {
+			return read(values, N);
+		}
+
+		// Read the values, nothing is read if not all are available.
+		template <class T>
+		bool read(T* values, int nbr) {
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read");
+			if (nbr < 0 || !canRead((long long) nbr * sizeof(T))) {
+				return false;
+			}
+			if (SwapBytes<T>::value) {
+				for (int i = 0; i < nbr; ++i) {
+					read(values[i]);
+				}
+			} else {
+				std::memcpy(values, getData() + index_, nbr * sizeof(T));
+				index_ += nbr * sizeof(T);
+			}
+			return true;
+		}
+
+		// Write the value as a varint (LEB128), i.e. 7 bits per byte and values
+		// below 128 take one byte.
+		Packet& writeVarint(uint64_t value) {
+			while (value >= 0x80) {
+				push_back((char) (value | 0x80));
+				value >>= 7;
+			}
+			push_back((char) value);
+			return *this;
+		}
+
+		// Return false, without reading, if the varint is incomplete or too long.
+		bool readVarint(uint64_t& value) {
+			uint64_t result = 0;
+			for (int i = 0; i < MAX_VARINT_SIZE && index_ + i < size_; ++i) {
+				unsigned char byte = getData()[index_ + i];
+				result |= (uint64_t) (byte & 0x7f) << (7 * i);
+				if ((byte & 0x80) == 0) {
+					index_ += i + 1;
+					value = result;
+					return true;
+				}
+			}
+			failed_ = true;
+			return false;
+		}
+
+		// Write the value zig-zag encoded as a varint, i.e. small negative values
+		// take few bytes too.
+		Packet& writeSignedVarint(int64_t value) {
+			return writeVarint(((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+		}
+
+		bool readSignedVarint(int64_t& value) {
+			uint64_t zigzag;
+			if (!readVarint(zigzag)) {
+				return false;
+			}
+			value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+			return true;
+		}
+
+		// Write the value, clamped to [min, max], with the number of bits in [1, 32],
+		// i.e. with the precision (max - min) / (2^bits - 1). Takes (bits + 7) / 8 bytes.
+		Packet& writeQuantized(float value, float min, float max, int bits) {
+			double steps = bits >= 32 ? 4294967295.0 : (double) ((1ull << bits) - 1);
+			double normalized = (std::min(std::max(value, min), max) - (double) min) / ((double) max - min);
+			uint32_t quantized = (uint32_t) (normalized * steps + 0.5);
+			for (int i = 0; i < (bits + 7) / 8; ++i) {
+				push_back((char) (quantized >> (8 * i)));
+			}
+			return *this;
+		}
+
+		// Read a value written by writeQuantized() with the same interval and bits.
+		bool readQuantized(float& value, float min, float max, int bits) {
+			int bytes = (bits + 7) / 8;
+			if (!canRead(bytes)) {
+				return false;
+			}
+			uint32_t quantized = 0;
+			for (int i = 0; i < bytes; ++i) {
+				quantized |= (uint32_t) (unsigned char) getData()[index_ + i] << (8 * i);
+			}
+			index_ += bytes;
+			double steps = bits >= 32 ? 4294967295.0 : (double) ((1ull << bits) - 1);
+			value = (float) (min + quantized / steps * ((double) max - min));
+			return true;
+		}
+
 	private:
-		std::array<char, MAX_SIZE> data_;
+		// The max number of bytes of a 64 bit varint.
+		static const int MAX_VARINT_SIZE = 10;
+
+		// Return true if the size can be read, else mark the packet as failed.
+		bool canRead(long long size) {
+			if (size > size_ - index_) {
+				failed_ = true;
+				return false;
+			}
+			return true;
+		}
+
+		std::array<char, INLINE_SIZE> inline_;
+		char* heap_; // Null if stored inline.
+		int heapSize_; // The size the chunk was allocated with.
 		int index_;
 		int size_;
+		bool failed_;
 	};
 
 } // Namespace net.
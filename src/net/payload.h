@@ -0,0 +1,117 @@
+#ifndef NET_PAYLOAD_H
+#define NET_PAYLOAD_H
+
+#include "bufferpool.h"
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+namespace net {
+
+	// Immutable data shared by many send queues. Copying a payload only copies
+	// the reference, the data is freed when the last copy is destroyed. The data
+	// and the reference count are stored in one chunk of the buffer pool.
+	class Payload {
+	public:
+		Payload() : block_(nullptr) {
+		}
+
+		explicit Payload(const std::vector<char>& data) : Payload(data.data(), data.size(), nullptr, 0) {
+		}
+
+		Payload(const char* data, int size) : Payload(data, size, nullptr, 0) {
+		}
+
+		// The data is the first part followed by the second, e.g. a header and its data.
+		Payload(const char* first, int firstSize, const char* second, int secondSize) {
+			void* memory = BufferPool::allocate(sizeof(Block) + firstSize + secondSize);
+			block_ = new (memory) Block(firstSize + secondSize);
+			char* data = reinterpret_cast<char*>(block_ + 1);
+			if (firstSize > 0) {
+				std::memcpy(data, first, firstSize);
+			}
+			if (secondSize > 0) {
+				std::memcpy(data + firstSize, second, secondSize);
+			}
+		}
+
+		Payload(const Payload& payload) : block_(payload.block_) {
+			if (block_ != nullptr) {
+				block_->references_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		Payload(Payload&& payload) : block_(payload.block_) {
+			payload.block_ = nullptr;
+		}
+
+		~Payload() {
+			release();
+		}
+
+		Payload& operator=(const Payload& payload) {
+			if (payload.block_ != nullptr) {
+				payload.block_->references_.fetch_add(1, std::memory_order_relaxed);
+			}
+			release();
+			block_ = payload.block_;
+			return *this;
+		}
+
+		Payload& operator=(Payload&& payload) {
+			if (this != &payload) {
+				release();
+				block_ = payload.block_;
+				payload.block_ = nullptr;
+			}
+			return *this;
+		}
+
+		const char* data() const {
+			return block_ ? reinterpret_cast<const char*>(block_ + 1) : nullptr;
+		}
+
+		int size() const {
+			return block_ ? block_->size_ : 0;
+		}
+
+		// The number of payloads sharing the data.
+		long useCount() const {
+			return block_ ? block_->references_.load(std::memory_order_relaxed) : 0;
+		}
+
+		// When the payload was created, i.e. when the packet was sent by the application.
+		std::chrono::steady_clock::time_point getTime() const {
+			return block_ ? block_->time_ : std::chrono::steady_clock::time_point();
+		}
+
+	private:
+		// Followed by the data.
+		class Block {
+		public:
+			Block(int size) : references_(1), size_(size), time_(std::chrono::steady_clock::now()) {
+			}
+
+			std::atomic<int> references_;
+			int size_;
+			std::chrono::steady_clock::time_point time_;
+		};
+
+		void release() {
+			if (block_ != nullptr && block_->references_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				int size = block_->size_;
+				block_->~Block();
+				BufferPool::deallocate(block_, sizeof(Block) + size);
+			}
+			block_ = nullptr;
+		}
+
+		Block* block_;
+	};
+
+} // Namespace net.
+
+#endif // NET_PAYLOAD_H
@@ -0,0 +1,353 @@
+#include "posixtransport.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+
+namespace net {
+
+	namespace {
+
+		const int MAX_EVENTS = 64;
+
+		// Max number of segments sent by one call, well below IOV_MAX.
+		const int MAX_SEGMENTS = 64;
+
+		// Max number of datagrams sent or received by one call.
+		const int MAX_DATAGRAMS = 64;
+
+	}
+
+	PosixTransport::PosixTransport(int sendBufferSize, int receiveBufferSize, bool noDelay, bool reusePort) {
+		sendBufferSize_ = sendBufferSize;
+		receiveBufferSize_ = receiveBufferSize;
+		noDelay_ = noDelay;
+		reusePort_ = reusePort;
+		epoll_ = -1;
+		wakeupFd_ = -1;
+	}
+
+	PosixTransport::~PosixTransport() {
+		for (unsigned int socket = 0; socket < events_.size(); ++socket) {
+			if (events_[socket] & OPEN) {
+				::close(socket);
+			}
+		}
+		if (wakeupFd_ >= 0) {
+			::close(wakeupFd_);
+		}
+		if (epoll_ >= 0) {
+			::close(epoll_);
+		}
+	}
+
+	bool PosixTransport::init() {
+		epoll_ = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_ < 0) {
+			fprintf(stderr, "epoll_create1: %s\n", strerror(errno));
+			return false;
+		}
+		wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wakeupFd_ < 0) {
+			fprintf(stderr, "eventfd: %s\n", strerror(errno));
+			return false;
+		}
+		epoll_event event = epoll_event();
+		event.events = EPOLLIN;
+		event.data.fd = wakeupFd_;
+		return epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeupFd_, &event) == 0;
+	}
+
+	Socket PosixTransport::listen(int port) {
+		Socket socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (socket < 0) {
+			fprintf(stderr, "socket: %s\n", strerror(errno));
+			return NO_SOCKET;
+		}
+		int reuse = 1;
+		setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if (reusePort_ && setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+			fprintf(stderr, "SO_REUSEPORT: %s\n", strerror(errno));
+		}
+
+		sockaddr_in address = sockaddr_in();
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(socket, (sockaddr*) &address, sizeof(address)) < 0 || ::listen(socket, SOMAXCONN) < 0) {
+			fprintf(stderr, "listen: %s\n", strerror(errno));
+			::close(socket);
+			return NO_SOCKET;
+		}
+		return add(socket, false);
+	}
+
+	Socket PosixTransport::connect(const std::string& ip, int port) {
+		addrinfo hints = addrinfo();
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* result;
+		int error = getaddrinfo(ip.c_str(), std::to_string(port).c_str(), &hints, &result);
+		if (error != 0) {
+			fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(error));
+			return NO_SOCKET;
+		}
+		Socket socket = NO_SOCKET;
+		for (addrinfo* info = result; info != nullptr && socket == NO_SOCKET; info = info->ai_next) {
+			socket = ::socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+			if (socket >= 0 && ::connect(socket, info->ai_addr, info->ai_addrlen) < 0) {
+				::close(socket);
+				socket = NO_SOCKET;
+			}
+		}
+		freeaddrinfo(result);
+		if (socket == NO_SOCKET) {
+			fprintf(stderr, "connect: %s\n", strerror(errno));
+			return NO_SOCKET;
+		}
+		return add(socket, true);
+	}
+
+	Socket PosixTransport::accept(Socket listenSocket) {
+		Socket socket = accept4(listenSocket, nullptr, nullptr, SOCK_CLOEXEC);
+		if (socket < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				fprintf(stderr, "accept: %s\n", strerror(errno));
+			}
+			return NO_SOCKET;
+		}
+		return add(socket, true);
+	}
+
+	void PosixTransport::close(Socket socket) {
+		epoll_ctl(epoll_, EPOLL_CTL_DEL, socket, nullptr);
+		::close(socket);
+		events_[socket] = NONE;
+	}
+
+	int PosixTransport::receive(Socket socket, char* data, int size) {
+		ssize_t receiveSize = recv(socket, data, size, 0);
+		if (receiveSize < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		}
+		// Zero bytes means the connection is closed.
+		return receiveSize > 0 ? (int) receiveSize : -1;
+	}
+
+	int PosixTransport::send(Socket socket, const char* data, int size) {
+		ssize_t sizeSent = ::send(socket, data, size, MSG_NOSIGNAL);
+		if (sizeSent < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		}
+		return (int) sizeSent;
+	}
+
+	int PosixTransport::send(Socket socket, const Segment* segments, int nbr) {
+		iovec vectors[MAX_SEGMENTS];
+		nbr = nbr < MAX_SEGMENTS ? nbr : MAX_SEGMENTS;
+		for (int i = 0; i < nbr; ++i) {
+			vectors[i].iov_base = const_cast<char*>(segments[i].data_);
+			vectors[i].iov_len = segments[i].size_;
+		}
+		msghdr message = msghdr();
+		message.msg_iov = vectors;
+		message.msg_iovlen = nbr;
+		ssize_t sizeSent = sendmsg(socket, &message, MSG_NOSIGNAL);
+		if (sizeSent < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		}
+		return (int) sizeSent;
+	}
+
+	Socket PosixTransport::openDatagram(int port) {
+		Socket socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (socket < 0) {
+			fprintf(stderr, "socket: %s\n", strerror(errno));
+			return NO_SOCKET;
+		}
+		sockaddr_in address = sockaddr_in();
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(socket, (sockaddr*) &address, sizeof(address)) < 0) {
+			fprintf(stderr, "bind: %s\n", strerror(errno));
+			::close(socket);
+			return NO_SOCKET;
+		}
+		return add(socket, false);
+	}
+
+	int PosixTransport::getPort(Socket socket) {
+		sockaddr_in address = sockaddr_in();
+		socklen_t size = sizeof(address);
+		if (getsockname(socket, (sockaddr*) &address, &size) < 0 || address.sin_family != AF_INET) {
+			return 0;
+		}
+		return ntohs(address.sin_port);
+	}
+
+	Address PosixTransport::getPeerAddress(Socket socket) {
+		sockaddr_in address = sockaddr_in();
+		socklen_t size = sizeof(address);
+		Address peer;
+		if (getpeername(socket, (sockaddr*) &address, &size) == 0 && address.sin_family == AF_INET) {
+			peer.host_ = address.sin_addr.s_addr;
+			peer.port_ = address.sin_port;
+		}
+		return peer;
+	}
+
+	int PosixTransport::sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) {
+		mmsghdr messages[MAX_DATAGRAMS];
+		iovec vectors[MAX_DATAGRAMS];
+		sockaddr_in addresses[MAX_DATAGRAMS];
+		nbr = nbr < MAX_DATAGRAMS ? nbr : MAX_DATAGRAMS;
+		for (int i = 0; i < nbr; ++i) {
+			vectors[i].iov_base = datagrams[i].data_;
+			vectors[i].iov_len = datagrams[i].size_;
+			addresses[i] = sockaddr_in();
+			addresses[i].sin_family = AF_INET;
+			addresses[i].sin_addr.s_addr = datagrams[i].address_.host_;
+			addresses[i].sin_port = datagrams[i].address_.port_;
+			messages[i] = mmsghdr();
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		}
+		int sent = sendmmsg(socket, messages, nbr, 0);
+		if (sent < 0) {
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+		}
+		return sent;
+	}
+
+	int PosixTransport::receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) {
+		mmsghdr messages[MAX_DATAGRAMS];
+		iovec vectors[MAX_DATAGRAMS];
+		sockaddr_in addresses[MAX_DATAGRAMS];
+		nbr = nbr < MAX_DATAGRAMS ? nbr : MAX_DATAGRAMS;
+		for (int i = 0; i < nbr; ++i) {
+			vectors[i].iov_base = datagrams[i].data_;
+			vectors[i].iov_len = datagrams[i].size_;
+			messages[i] = mmsghdr();
+			messages[i].msg_hdr.msg_iov = &vectors[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		}
+		int received = recvmmsg(socket, messages, nbr, MSG_DONTWAIT, nullptr);
+		if (received < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				fprintf(stderr, "recvmmsg: %s\n", strerror(errno));
+			}
+			return 0;
+		}
+		for (int i = 0; i < received; ++i) {
+			datagrams[i].size_ = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? -1 : (int) messages[i].msg_len;
+			datagrams[i].address_.host_ = addresses[i].sin_addr.s_addr;
+			datagrams[i].address_.port_ = addresses[i].sin_port;
+		}
+		return received;
+	}
+
+	void PosixTransport::setWriteInterest(Socket socket, bool interest) {
+		bool current = (events_[socket] & WRITE_INTEREST) != 0;
+		if (current != interest) {
+			epoll_event event = epoll_event();
+			event.events = interest ? EPOLLIN | EPOLLOUT : EPOLLIN;
+			event.data.fd = socket;
+			epoll_ctl(epoll_, EPOLL_CTL_MOD, socket, &event);
+			events_[socket] ^= WRITE_INTEREST;
+		}
+	}
+
+	void PosixTransport::wait(int timeout) {
+		// Clear the events from the last call.
+		for (Socket socket : readySockets_) {
+			events_[socket] &= ~(READABLE | WRITABLE);
+		}
+		readySockets_.clear();
+
+		epoll_event events[MAX_EVENTS];
+		int nbr = epoll_wait(epoll_, events, MAX_EVENTS, timeout);
+		if (nbr < 0 && errno != EINTR) {
+			fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+		}
+		for (int i = 0; i < nbr; ++i) {
+			Socket socket = events[i].data.fd;
+			if (socket == wakeupFd_) {
+				uint64_t value;
+				// Reset the wakeup counter.
+				while (read(wakeupFd_, &value, sizeof(value)) > 0) {
+				}
+			} else {
+				// Errors and hang ups are reported when the socket is read.
+				if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+					events_[socket] |= READABLE;
+				}
+				if (events[i].events & EPOLLOUT) {
+					events_[socket] |= WRITABLE;
+				}
+				readySockets_.push_back(socket);
+			}
+		}
+	}
+
+	bool PosixTransport::isReadable(Socket socket) const {
+		return (events_[socket] & READABLE) != 0;
+	}
+
+	bool PosixTransport::isWritable(Socket socket) const {
+		return (events_[socket] & WRITABLE) != 0;
+	}
+
+	void PosixTransport::wakeUp() {
+		uint64_t value = 1;
+		if (write(wakeupFd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+			fprintf(stderr, "eventfd write: %s\n", strerror(errno));
+		}
+	}
+
+	Socket PosixTransport::add(Socket socket, bool stream) {
+		int flags = fcntl(socket, F_GETFL, 0);
+		fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+		if (stream) {
+			int noDelay = noDelay_ ? 1 : 0;
+			setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+			if (sendBufferSize_ > 0) {
+				setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &sendBufferSize_, sizeof(sendBufferSize_));
+			}
+			if (receiveBufferSize_ > 0) {
+				setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize_, sizeof(receiveBufferSize_));
+			}
+		}
+
+		epoll_event event = epoll_event();
+		event.events = EPOLLIN;
+		event.data.fd = socket;
+		if (epoll_ctl(epoll_, EPOLL_CTL_ADD, socket, &event) < 0) {
+			fprintf(stderr, "epoll_ctl: %s\n", strerror(errno));
+			::close(socket);
+			return NO_SOCKET;
+		}
+		if ((int) events_.size() <= socket) {
+			events_.resize(socket + 1, NONE);
+		}
+		events_[socket] = OPEN;
+		return socket;
+	}
+
+} // Namespace net.
@@ -0,0 +1,81 @@
+#ifndef NET_POSIXTRANSPORT_H
+#define NET_POSIXTRANSPORT_H
+
+#include "transport.h"
+
+#include <vector>
+
+namespace net {
+
+	// Transport using non-blocking posix sockets and epoll. The network thread
+	// is woken up through an eventfd.
+	class PosixTransport : public Transport {
+	public:
+		// The socket send and receive buffer sizes in bytes, 0 keeps the system default.
+		// Nagle's algorithm is disabled (TCP_NODELAY) when noDelay is true. Listen
+		// sockets use SO_REUSEPORT when reusePort is true, i.e. many transports can
+		// listen on the same port and the connections are spread between them.
+		PosixTransport(int sendBufferSize = 0, int receiveBufferSize = 0, bool noDelay = true, bool reusePort = false);
+		~PosixTransport();
+
+		bool init() override;
+
+		Socket listen(int port) override;
+
+		Socket connect(const std::string& ip, int port) override;
+
+		Socket accept(Socket listenSocket) override;
+
+		void close(Socket socket) override;
+
+		int receive(Socket socket, char* data, int size) override;
+
+		int send(Socket socket, const char* data, int size) override;
+
+		int send(Socket socket, const Segment* segments, int nbr) override;
+
+		Socket openDatagram(int port) override;
+
+		int getPort(Socket socket) override;
+
+		Address getPeerAddress(Socket socket) override;
+
+		int sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) override;
+
+		int receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) override;
+
+		void setWriteInterest(Socket socket, bool interest) override;
+
+		void wait(int timeout) override;
+
+		bool isReadable(Socket socket) const override;
+
+		bool isWritable(Socket socket) const override;
+
+		void wakeUp() override;
+
+	private:
+		enum Event : unsigned char {
+			NONE = 0,
+			READABLE = 1,
+			WRITABLE = 2,
+			WRITE_INTEREST = 4,
+			OPEN = 8
+		};
+
+		// Set the socket options and add the socket to the event loop.
+		Socket add(Socket socket, bool stream);
+
+		int sendBufferSize_;
+		int receiveBufferSize_;
+		bool noDelay_;
+		bool reusePort_;
+		int epoll_;
+		int wakeupFd_;
+		std::vector<unsigned char> events_; // Indexed by socket.
+		std::vector<Socket> readySockets_;
+	};
+
+} // Namespace net.
+
+#endif // NET_POSIXTRANSPORT_H
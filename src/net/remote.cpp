@@ -3,13 +3,12 @@
 namespace net {
 
 	bool Remote::pullReceiveData(Packet& packet) {
-		if (receiveBuffer_.size() > 2) {
-			int size = receiveBuffer_[0];
-			int remoteId = receiveBuffer_[1];
-			packet = Packet(receiveBuffer_.data(), size);
-			receiveBuffer_.erase(receiveBuffer_.begin(), receiveBuffer_.begin() + size);
+		Message message;
+		if (receiveBuffer_.pop(message)) {
+			packet = std::move(message.packet_);
+			return true;
 		}
-		return true;
+		return false;
 	}
 
 	Remote::Remote(int id) : Client(id) {
@@ -0,0 +1,129 @@
+#ifndef NET_RINGBUFFER_H
+#define NET_RINGBUFFER_H
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace net {
+
+	// A byte queue stored in a ring buffer. The capacity is a power of two and
+	// grows when needed, it never shrinks. I.e. when the capacity is reached no
+	// more memory is allocated and removing data from the front is O(1).
+	class RingBuffer {
+	public:
+		RingBuffer() {
+			head_ = 0;
+			size_ = 0;
+		}
+
+		int size() const {
+			return size_;
+		}
+
+		bool empty() const {
+			return size_ == 0;
+		}
+
+		int capacity() const {
+			return data_.size();
+		}
+
+		char operator[](int index) const {
+			return data_[(head_ + index) & (data_.size() - 1)];
+		}
+
+		char& operator[](int index) {
+			return data_[(head_ + index) & (data_.size() - 1)];
+		}
+
+		inline void push_back(char byte) {
+			reserve(size_ + 1);
+			data_[(head_ + size_) & (data_.size() - 1)] = byte;
+			++size_;
+		}
+
+		// Add the data to the back.
+		void append(const char* data, int size) {
+			reserve(size_ + size);
+			int tail = (head_ + size_) & (data_.size() - 1);
+			int first = std::min(size, (int) data_.size() - tail);
+			std::copy(data, data + first, data_.data() + tail);
+			std::copy(data + first, data + size, data_.data());
+			size_ += size;
+		}
+
+		// Add the data in the buffer, in the interval [index, index + size), to the back.
+		void append(const RingBuffer& buffer, int index, int size) {
+			while (size > 0) {
+				int contiguous = std::min(size, buffer.contiguousSize(index));
+				append(buffer.data(index), contiguous);
+				index += contiguous;
+				size -= contiguous;
+			}
+		}
+
+		// Copy the data in the interval [index, index + size) to the destination.
+		void copy(int index, char* destination, int size) const {
+			while (size > 0) {
+				int contiguous = std::min(size, contiguousSize(index));
+				std::copy(data(index), data(index) + contiguous, destination);
+				destination += contiguous;
+				index += contiguous;
+				size -= contiguous;
+			}
+		}
+
+		// Remove data from the front.
+		void pop_front(int size) {
+			assert(size <= size_);
+			size_ -= size;
+			// Start from the beginning when empty, keeps the data contiguous.
+			head_ = size_ == 0 ? 0 : (head_ + size) & (data_.size() - 1);
+		}
+
+		void clear() {
+			head_ = 0;
+			size_ = 0;
+		}
+
+		// Return a pointer to the data at the index. Only contiguousSize(index)
+		// bytes can be read from the pointer.
+		const char* data(int index = 0) const {
+			return data_.data() + ((head_ + index) & (data_.size() - 1));
+		}
+
+		// Return the number of bytes stored contiguous in memory from the index.
+		int contiguousSize(int index = 0) const {
+			if (size_ == index) {
+				return 0;
+			}
+			int start = (head_ + index) & (data_.size() - 1);
+			return std::min(size_ - index, (int) data_.size() - start);
+		}
+
+		// Make sure the buffer can hold the size without allocating memory.
+		void reserve(int size) {
+			if (size > (int) data_.size()) {
+				int capacity = data_.empty() ? MIN_CAPACITY : (int) data_.size();
+				while (capacity < size) {
+					capacity *= 2;
+				}
+				std::vector<char> data(capacity);
+				copy(0, data.data(), size_);
+				data_.swap(data);
+				head_ = 0;
+			}
+		}
+
+	private:
+		static const int MIN_CAPACITY = 64;
+
+		std::vector<char> data_;
+		int head_;
+		int size_;
+	};
+
+} // Namespace net.
+
+#endif // NET_RINGBUFFER_H
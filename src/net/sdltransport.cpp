@@ -0,0 +1,282 @@
+#include "sdltransport.h"
+
+#include <cstdio>
+#include <algorithm>
+
+namespace net {
+
+	SdlTransport::SdlTransport(int maxSockets) {
+		maxSockets_ = maxSockets;
+		initiated_ = false;
+		socketSet_ = nullptr;
+		wakeupSocket_ = nullptr;
+		wakeupPacket_ = nullptr;
+		receivePacket_ = nullptr;
+		datagramPacket_ = nullptr;
+	}
+
+	SdlTransport::~SdlTransport() {
+		for (TCPsocket socket : sockets_) {
+			if (socket != nullptr) {
+				SDLNet_TCP_Close(socket);
+			}
+		}
+		for (UDPsocket socket : datagramSockets_) {
+			if (socket != nullptr) {
+				SDLNet_UDP_Close(socket);
+			}
+		}
+		if (datagramPacket_ != nullptr) {
+			SDLNet_FreePacket(datagramPacket_);
+		}
+		if (wakeupSocket_ != nullptr) {
+			SDLNet_UDP_Close(wakeupSocket_);
+		}
+		if (wakeupPacket_ != nullptr) {
+			SDLNet_FreePacket(wakeupPacket_);
+		}
+		if (receivePacket_ != nullptr) {
+			SDLNet_FreePacket(receivePacket_);
+		}
+		if (socketSet_ != nullptr) {
+			SDLNet_FreeSocketSet(socketSet_);
+		}
+		if (initiated_) {
+			SDLNet_Quit();
+		}
+	}
+
+	bool SdlTransport::init() {
+		if (SDLNet_Init() < 0) {
+			fprintf(stderr, "SDLNet_Init: %s\n", SDLNet_GetError());
+			return false;
+		}
+		initiated_ = true;
+
+		// All sockets and the wakeup socket.
+		socketSet_ = SDLNet_AllocSocketSet(maxSockets_ + 1);
+		if (socketSet_ == nullptr) {
+			fprintf(stderr, "SDLNet_AllocSocketSet: %s\n", SDLNet_GetError());
+			return false;
+		}
+
+		// The wakeup socket is an udp socket on a random port, the network thread
+		// is woken up by sending a datagram to it.
+		wakeupSocket_ = SDLNet_UDP_Open(0);
+		if (wakeupSocket_ == nullptr) {
+			fprintf(stderr, "SDLNet_UDP_Open: %s\n", SDLNet_GetError());
+			return false;
+		}
+		IPaddress* address = SDLNet_UDP_GetPeerAddress(wakeupSocket_, -1);
+		wakeupPacket_ = SDLNet_AllocPacket(1);
+		receivePacket_ = SDLNet_AllocPacket(1);
+		if (address == nullptr || wakeupPacket_ == nullptr || receivePacket_ == nullptr
+			|| SDLNet_ResolveHost(&wakeupPacket_->address, "localhost", 0) < 0) {
+
+			fprintf(stderr, "Wakeup socket: %s\n", SDLNet_GetError());
+			return false;
+		}
+		wakeupPacket_->address.port = address->port;
+		wakeupPacket_->data[0] = 0;
+		wakeupPacket_->len = 1;
+		SDLNet_UDP_AddSocket(socketSet_, wakeupSocket_);
+		return true;
+	}
+
+	Socket SdlTransport::listen(int port) {
+		IPaddress ip;
+		// Resolving the host using NULL make network interface to listen.
+		if (SDLNet_ResolveHost(&ip, NULL, port) < 0) {
+			fprintf(stderr, "SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+			return NO_SOCKET;
+		}
+
+		// Open a connection with the IP provided (listen on the host's port).
+		TCPsocket socket = SDLNet_TCP_Open(&ip);
+		if (socket == nullptr) {
+			fprintf(stderr, "SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+			return NO_SOCKET;
+		}
+		return add(socket, nullptr);
+	}
+
+	Socket SdlTransport::connect(const std::string& ip, int port) {
+		IPaddress address;
+		if (SDLNet_ResolveHost(&address, ip.c_str(), port) < 0) {
+			fprintf(stderr, "SDLNet_ResolveHost: %s\n", SDLNet_GetError());
+			return NO_SOCKET;
+		}
+		TCPsocket socket = SDLNet_TCP_Open(&address);
+		if (socket == nullptr) {
+			fprintf(stderr, "SDLNet_TCP_Open: %s\n", SDLNet_GetError());
+			return NO_SOCKET;
+		}
+		return add(socket, nullptr);
+	}
+
+	Socket SdlTransport::accept(Socket listenSocket) {
+		if (TCPsocket socket = SDLNet_TCP_Accept(sockets_[listenSocket])) {
+			if (SDLNet_TCP_GetPeerAddress(socket) != nullptr) {
+				return add(socket, nullptr);
+			}
+			fprintf(stderr, "SDLNet_TCP_GetPeerAddress: %s\n", SDLNet_GetError());
+			SDLNet_TCP_Close(socket);
+		}
+		return NO_SOCKET;
+	}
+
+	void SdlTransport::close(Socket socket) {
+		if (datagramSockets_[socket] != nullptr) {
+			SDLNet_UDP_DelSocket(socketSet_, datagramSockets_[socket]);
+			SDLNet_UDP_Close(datagramSockets_[socket]);
+			datagramSockets_[socket] = nullptr;
+		} else {
+			SDLNet_TCP_DelSocket(socketSet_, sockets_[socket]);
+			SDLNet_TCP_Close(sockets_[socket]);
+			sockets_[socket] = nullptr;
+		}
+	}
+
+	int SdlTransport::receive(Socket socket, char* data, int size) {
+		int receiveSize = SDLNet_TCP_Recv(sockets_[socket], data, size);
+		return receiveSize > 0 ? receiveSize : -1;
+	}
+
+	int SdlTransport::send(Socket socket, const char* data, int size) {
+		int sizeSent = SDLNet_TCP_Send(sockets_[socket], data, size);
+		return sizeSent == size ? size : -1;
+	}
+
+	int SdlTransport::send(Socket socket, const Segment* segments, int nbr) {
+		// SDL_net has no gather write, copy the segments to one buffer instead.
+		sendBuffer_.clear();
+		for (int i = 0; i < nbr; ++i) {
+			sendBuffer_.insert(sendBuffer_.end(), segments[i].data_, segments[i].data_ + segments[i].size_);
+		}
+		return send(socket, sendBuffer_.data(), sendBuffer_.size());
+	}
+
+	Socket SdlTransport::openDatagram(int port) {
+		if (datagramPacket_ == nullptr) {
+			datagramPacket_ = SDLNet_AllocPacket(MAX_DATAGRAM_SIZE);
+			if (datagramPacket_ == nullptr) {
+				fprintf(stderr, "SDLNet_AllocPacket: %s\n", SDLNet_GetError());
+				return NO_SOCKET;
+			}
+		}
+		UDPsocket socket = SDLNet_UDP_Open(port);
+		if (socket == nullptr) {
+			fprintf(stderr, "SDLNet_UDP_Open: %s\n", SDLNet_GetError());
+			return NO_SOCKET;
+		}
+		return add(nullptr, socket);
+	}
+
+	int SdlTransport::getPort(Socket socket) {
+		IPaddress* address = nullptr;
+		if (datagramSockets_[socket] != nullptr) {
+			address = SDLNet_UDP_GetPeerAddress(datagramSockets_[socket], -1);
+		}
+		// The port is in network byte order.
+		return address == nullptr ? 0 : ((address->port & 0xff) << 8) | (address->port >> 8);
+	}
+
+	Address SdlTransport::getPeerAddress(Socket socket) {
+		Address peer;
+		if (IPaddress* address = SDLNet_TCP_GetPeerAddress(sockets_[socket])) {
+			peer.host_ = address->host;
+			peer.port_ = address->port;
+		}
+		return peer;
+	}
+
+	int SdlTransport::sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) {
+		// SDL_net sends one datagram per call.
+		for (int i = 0; i < nbr; ++i) {
+			if (datagrams[i].size_ > datagramPacket_->maxlen) {
+				continue;
+			}
+			std::copy(datagrams[i].data_, datagrams[i].data_ + datagrams[i].size_, datagramPacket_->data);
+			datagramPacket_->len = datagrams[i].size_;
+			datagramPacket_->address.host = datagrams[i].address_.host_;
+			datagramPacket_->address.port = datagrams[i].address_.port_;
+			if (SDLNet_UDP_Send(datagramSockets_[socket], -1, datagramPacket_) == 0) {
+				return i;
+			}
+		}
+		return nbr;
+	}
+
+	int SdlTransport::receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) {
+		for (int i = 0; i < nbr; ++i) {
+			if (SDLNet_UDP_Recv(datagramSockets_[socket], datagramPacket_) <= 0) {
+				return i;
+			}
+			int size = datagramPacket_->len;
+			if (size > datagrams[i].size_) {
+				datagrams[i].size_ = -1;
+			} else {
+				std::copy(datagramPacket_->data, datagramPacket_->data + size, datagrams[i].data_);
+				datagrams[i].size_ = size;
+			}
+			datagrams[i].address_.host_ = datagramPacket_->address.host;
+			datagrams[i].address_.port_ = datagramPacket_->address.port;
+		}
+		return nbr;
+	}
+
+	void SdlTransport::setWriteInterest(Socket, bool) {
+		// Sockets are blocking, all data is always sent.
+	}
+
+	void SdlTransport::wait(int timeout) {
+		if (SDLNet_CheckSockets(socketSet_, timeout) < 0) {
+			fprintf(stderr, "SDLNet_CheckSockets: %s\n", SDLNet_GetError());
+		}
+		if (SDLNet_SocketReady(wakeupSocket_) != 0) {
+			// Empty the wakeup socket.
+			while (SDLNet_UDP_Recv(wakeupSocket_, receivePacket_) > 0) {
+			}
+		}
+	}
+
+	bool SdlTransport::isReadable(Socket socket) const {
+		if (datagramSockets_[socket] != nullptr) {
+			return SDLNet_SocketReady(datagramSockets_[socket]) != 0;
+		}
+		return SDLNet_SocketReady(sockets_[socket]) != 0;
+	}
+
+	bool SdlTransport::isWritable(Socket) const {
+		return true;
+	}
+
+	void SdlTransport::wakeUp() {
+		SDLNet_UDP_Send(wakeupSocket_, -1, wakeupPacket_);
+	}
+
+	Socket SdlTransport::add(TCPsocket socket, UDPsocket datagramSocket) {
+		int result = socket != nullptr ? SDLNet_TCP_AddSocket(socketSet_, socket) : SDLNet_UDP_AddSocket(socketSet_, datagramSocket);
+		if (result < 0) {
+			// Socket set is full.
+			if (socket != nullptr) {
+				SDLNet_TCP_Close(socket);
+			} else {
+				SDLNet_UDP_Close(datagramSocket);
+			}
+			return NO_SOCKET;
+		}
+		// Reuse a free handle.
+		for (unsigned int i = 0; i < sockets_.size(); ++i) {
+			if (sockets_[i] == nullptr && datagramSockets_[i] == nullptr) {
+				sockets_[i] = socket;
+				datagramSockets_[i] = datagramSocket;
+				return i;
+			}
+		}
+		sockets_.push_back(socket);
+		datagramSockets_.push_back(datagramSocket);
+		return sockets_.size() - 1;
+	}
+
+} // Namespace net.
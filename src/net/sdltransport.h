@@ -0,0 +1,78 @@
+#ifndef NET_SDLTRANSPORT_H
+#define NET_SDLTRANSPORT_H
+
+#include "transport.h"
+
+#include <SDL_net.h>
+
+#include <vector>
+
+namespace net {
+
+	// Transport using SDL_net. All socket calls are blocking, i.e. send() always
+	// sends all data and every socket is always writable.
+	class SdlTransport : public Transport {
+	public:
+		// The max number of sockets, including listen sockets, open at the same time.
+		SdlTransport(int maxSockets);
+		~SdlTransport();
+
+		bool init() override;
+
+		Socket listen(int port) override;
+
+		Socket connect(const std::string& ip, int port) override;
+
+		Socket accept(Socket listenSocket) override;
+
+		void close(Socket socket) override;
+
+		int receive(Socket socket, char* data, int size) override;
+
+		int send(Socket socket, const char* data, int size) override;
+
+		int send(Socket socket, const Segment* segments, int nbr) override;
+
+		Socket openDatagram(int port) override;
+
+		int getPort(Socket socket) override;
+
+		Address getPeerAddress(Socket socket) override;
+
+		int sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) override;
+
+		int receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) override;
+
+		void setWriteInterest(Socket socket, bool interest) override;
+
+		void wait(int timeout) override;
+
+		bool isReadable(Socket socket) const override;
+
+		bool isWritable(Socket socket) const override;
+
+		void wakeUp() override;
+
+	private:
+		// Max size of a datagram sent or received.
+		static const int MAX_DATAGRAM_SIZE = 65507;
+
+		// Add the socket to the socket set. Return the socket handle.
+		Socket add(TCPsocket socket, UDPsocket datagramSocket);
+
+		// Indexed by socket handle, a handle is either a tcp or an udp socket.
+		std::vector<TCPsocket> sockets_;
+		std::vector<UDPsocket> datagramSockets_;
+		int maxSockets_;
+		bool initiated_;
+		SDLNet_SocketSet socketSet_;
+		UDPsocket wakeupSocket_;
+		UDPpacket* wakeupPacket_;
+		UDPpacket* receivePacket_;
+		UDPpacket* datagramPacket_;
+		std::vector<char> sendBuffer_; // Segments are copied here to be sent at once.
+	};
+
+} // Namespace net.
+
+#endif // NET_SDLTRANSPORT_H
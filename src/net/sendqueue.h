@@ -0,0 +1,124 @@
+#ifndef NET_SENDQUEUE_H
+#define NET_SENDQUEUE_H
+
+#include "payload.h"
+#include "transport.h"
+
+#include <deque>
+
+namespace net {
+
+	// The data waiting to be sent on a connection. Only a reference to each
+	// payload and the offset of the first byte not yet sent is stored, i.e. the
+	// same payload can be queued to many connections without copying the data.
+	class SendQueue {
+	public:
+		SendQueue() {
+			size_ = 0;
+			offset_ = 0;
+		}
+
+		void push(const Payload& payload) {
+			if (payload.size() > 0) {
+				payloads_.push_back(payload);
+				size_ += payload.size();
+			}
+		}
+
+		// The number of bytes not yet sent.
+		int size() const {
+			return size_;
+		}
+
+		bool empty() const {
+			return size_ == 0;
+		}
+
+		// Return a pointer to the first byte not yet sent. Only contiguousSize()
+		// bytes can be read from the pointer.
+		const char* data() const {
+			return payloads_.front().data() + offset_;
+		}
+
+		int contiguousSize() const {
+			return size_ == 0 ? 0 : payloads_.front().size() - offset_;
+		}
+
+		// Fill the segments with the data not yet sent, one segment per payload.
+		// Return the number of segments filled, at most max.
+		int segments(Segment* segments, int max) const {
+			int nbr = 0;
+			int offset = offset_;
+			for (auto it = payloads_.begin(); it != payloads_.end() && nbr < max; ++it) {
+				segments[nbr].data_ = it->data() + offset;
+				segments[nbr].size_ = it->size() - offset;
+				offset = 0;
+				++nbr;
+			}
+			return nbr;
+		}
+
+		// Remove the sent bytes. A payload is released when all of it is sent.
+		void pop(int size) {
+			pop(size, [](const Payload&) {});
+		}
+
+		// Same as pop(size) and call the function, i.e. function(payload), with
+		// each payload released.
+		template <class Function>
+		void pop(int size, Function&& function) {
+			size_ -= size;
+			offset_ += size;
+			while (!payloads_.empty() && offset_ >= payloads_.front().size()) {
+				offset_ -= payloads_.front().size();
+				function(payloads_.front());
+				payloads_.pop_front();
+			}
+		}
+
+		// Remove whole payloads not yet partially sent, oldest first, until at
+		// most size bytes are left. Return the number of bytes removed.
+		int dropOldest(int size) {
+			auto first = payloads_.begin() + (offset_ > 0 ? 1 : 0);
+			auto last = first;
+			int dropped = 0;
+			while (last != payloads_.end() && size_ - dropped > size) {
+				dropped += last->size();
+				++last;
+			}
+			payloads_.erase(first, last);
+			size_ -= dropped;
+			return dropped;
+		}
+
+		// Remove all payloads not yet partially sent except the newest one.
+		// Return the number of bytes removed.
+		int keepLatest() {
+			auto first = payloads_.begin() + (offset_ > 0 ? 1 : 0);
+			if (payloads_.end() - first < 2) {
+				return 0;
+			}
+			int dropped = 0;
+			for (auto it = first; it != payloads_.end() - 1; ++it) {
+				dropped += it->size();
+			}
+			payloads_.erase(first, payloads_.end() - 1);
+			size_ -= dropped;
+			return dropped;
+		}
+
+		void clear() {
+			payloads_.clear();
+			size_ = 0;
+			offset_ = 0;
+		}
+
+	private:
+		std::deque<Payload> payloads_;
+		int size_;
+		int offset_;
+	};
+
+} // Namespace net.
+
+#endif // NET_SENDQUEUE_H
@@ -5,36 +5,110 @@
 namespace net {
 
 	// SERVER ID = 0;
-	// Protocol.
+	// Protocol, all data is sent as packages, see package.h.
 	// Byte:
-	// 1: PACKAGE_SIZE
-	// 2: CLIENT_ID
-	// 3 -> PACKAGE_SIZE: DATA
+	// 1 -> N: SIZE (varint)
+	// N + 1 -> N + 4: CLIENT_ID
+	// N + 5 -> N + SIZE: DATA
+	//
+	// When a remote client connects the server sends four bytes, the id of the client.
+	// Packages sent from a remote client use CLIENT_ID as the receiver, SERVER_ID
+	// for the server and ALL_ID for all other clients. The server replaces it with
+	// the id of the sender before the package is passed on.
+	//
+	// Snapshots, and the acks of the clients, use SNAPSHOT_ID as CLIENT_ID. The
+	// data is the sequence, the baseline and the delta, see snapshot.h.
 	Server::Server(Network* network) {
 		network_ = network;
+		tick_ = 0;
 	}
 
 	Server::~Server() {
 	}
 
 	std::shared_ptr<Client> Server::pullReceiveData(Packet& packet) {
-		std::lock_guard<std::mutex> lock(network_->mutex_);
-		if (receiveBuffer_.size() > 2) {
-			int size = receiveBuffer_[0];
-			int id = receiveBuffer_[1];
-			packet = Packet(receiveBuffer_.data() + 2, size - 2);
-			receiveBuffer_.erase(receiveBuffer_.begin(), receiveBuffer_.begin() + size);
-			return network_->getClient(id);
+		Message message;
+		if (receiveBuffer_.pop(message)) {
+			packet = std::move(message.packet_);
+			return message.sender_;
 		}
 		return nullptr;
 	}
 
+	bool Server::pullSlowClientEvent(SlowClientEvent& event) {
+		return eventBuffer_.pop(event);
+	}
+
 	void Server::sendToAll(const Packet& packet) {
-		network_->sendToAll(SERVER_ID, packet);
+		network_->sendToAll(SERVER_ID, packet, STREAM, 0);
 	}
 
 	void Server::sendTo(std::shared_ptr<Client> receiver, const Packet& packet) {
-		network_->sendToClient(SERVER_ID, receiver, packet);
+		network_->sendToClient(SERVER_ID, receiver, packet, STREAM, 0);
+	}
+
+	void Server::sendToAllUnreliable(const Packet& packet) {
+		network_->sendToAll(SERVER_ID, packet, UNRELIABLE, 0);
+	}
+
+	void Server::sendToUnreliable(std::shared_ptr<Client> receiver, const Packet& packet) {
+		network_->sendToClient(SERVER_ID, receiver, packet, UNRELIABLE, 0);
+	}
+
+	void Server::sendToAll(const Packet& packet, Delivery delivery, int channel) {
+		network_->sendToAll(SERVER_ID, packet, delivery, channel);
+	}
+
+	void Server::sendTo(std::shared_ptr<Client> receiver, const Packet& packet, Delivery delivery, int channel) {
+		network_->sendToClient(SERVER_ID, receiver, packet, delivery, channel);
+	}
+
+	void Server::setInterest(std::shared_ptr<Client> client, float x, float y, float radius) {
+		network_->setInterest(client, x, y, radius);
+	}
+
+	void Server::sendToArea(const Packet& packet, float x, float y) {
+		network_->sendToArea(SERVER_ID, packet, x, y, STREAM, 0);
+	}
+
+	void Server::sendToArea(const Packet& packet, float x, float y, Delivery delivery, int channel) {
+		network_->sendToArea(SERVER_ID, packet, x, y, delivery, channel);
+	}
+
+	int Server::createGroup() {
+		return network_->createGroup();
+	}
+
+	void Server::removeGroup(int group) {
+		network_->setMember(group, nullptr, false);
+	}
+
+	void Server::joinGroup(int group, std::shared_ptr<Client> client) {
+		network_->setMember(group, client, true);
+	}
+
+	void Server::leaveGroup(int group, std::shared_ptr<Client> client) {
+		network_->setMember(group, client, false);
+	}
+
+	void Server::sendToGroup(int group, const Packet& packet) {
+		network_->sendToGroup(SERVER_ID, group, packet, STREAM, 0);
+	}
+
+	void Server::sendToGroup(int group, const Packet& packet, Delivery delivery, int channel) {
+		network_->sendToGroup(SERVER_ID, group, packet, delivery, channel);
+	}
+
+	void Server::sendSnapshot(const Packet& snapshot) {
+		network_->sendSnapshot(snapshot);
+	}
+
+	long long Server::waitForTick(int timeout) {
+		long long tick = network_->waitForTick(tick_, timeout);
+		if (tick > 0) {
+			tick_ = tick;
+		}
+		return tick;
 	}
 
 } // Namespace net.
@@ -2,14 +2,38 @@
 #define NET_SERVER_H
 
 #include "client.h"
+#include "message.h"
+#include "mpscqueue.h"
+#include "delivery.h"
 
-#include <vector>
 #include <memory>
 
 namespace net {
 
 	class Network;
 
+	// Reported by the server when the send queue of a remote client exceeds the
+	// high watermark and the slow client policy is applied, or when the queue is
+	// back below the low watermark.
+	class SlowClientEvent {
+	public:
+		enum Type {
+			DROPPED,		// Queued packages were removed.
+			DISCONNECTED,	// The client was disconnected.
+			RECOVERED		// The queue is below the low watermark again.
+		};
+
+		SlowClientEvent() : type_(DROPPED), size_(0) {
+		}
+
+		SlowClientEvent(const std::shared_ptr<Client>& client, Type type, int size) : client_(client), type_(type), size_(size) {
+		}
+
+		std::shared_ptr<Client> client_;
+		Type type_;
+		int size_; // The number of bytes removed from the queue.
+	};
+
 	class Server {
 	public:
 		friend class Network;
@@ -19,19 +43,90 @@ namespace net {
 		
 		std::shared_ptr<Client> pullReceiveData(Packet& packet);
 
+		// Call the function, i.e. function(sender, packet), for each received packet.
+		// The packet is not copied and is only valid during the call. Return the
+		// number of packets.
+		template <class Function>
+		int pullAll(Function&& function) {
+			return receiveBuffer_.popAll([&](Message& message) {
+				function(message.sender_, message.packet_);
+			});
+		}
+
+		// Pull the next slow client event. Return false if there are none.
+		bool pullSlowClientEvent(SlowClientEvent& event);
+
 		// Send the current data to all clients.
 		void sendToAll(const Packet& packet);
 
 		// Send the current data to the receiver.
 		void sendTo(std::shared_ptr<Client> receiver, const Packet& packet);
 
+		// Send the packet as a datagram, i.e. it may be lost or arrive out of order
+		// but is never delayed by lost packets. Dropped for a client whose datagram
+		// address is not yet known. Packets too big for a datagram are streamed but
+		// received with their delivery and channel.
+		void sendToAllUnreliable(const Packet& packet);
+
+		void sendToUnreliable(std::shared_ptr<Client> receiver, const Packet& packet);
+
+		// Send the packet with the delivery on the channel, in [0, DatagramConnection::MAX_CHANNELS).
+		// Reliable datagrams to a client whose address is not yet known wait for it.
+		void sendToAll(const Packet& packet, Delivery delivery, int channel = 0);
+
+		void sendTo(std::shared_ptr<Client> receiver, const Packet& packet, Delivery delivery, int channel = 0);
+
+		// Set the area the remote client is interested in, a circle around its
+		// position, see sendToArea(). Called again when the client moves. A radius
+		// below 0 removes the area.
+		void setInterest(std::shared_ptr<Client> client, float x, float y, float radius);
+
+		// Send the packet to the remote clients whose area holds the location, i.e.
+		// only the clients near it are visited. Clients without an area get nothing.
+		void sendToArea(const Packet& packet, float x, float y);
+
+		void sendToArea(const Packet& packet, float x, float y, Delivery delivery, int channel = 0);
+
+		// Create an empty group of clients, see sendToGroup(). Return the id of the
+		// group, ids are never reused.
+		int createGroup();
+
+		// Remove the group, i.e. all members leave it.
+		void removeGroup(int group);
+
+		// The client joins the group, a client may be a member of many groups. A
+		// disconnected client leaves all its groups.
+		void joinGroup(int group, std::shared_ptr<Client> client);
+
+		void leaveGroup(int group, std::shared_ptr<Client> client);
+
+		// Send the packet to all members of the group. The packet is serialized
+		// once, the members share the same package.
+		void sendToGroup(int group, const Packet& packet);
+
+		void sendToGroup(int group, const Packet& packet, Delivery delivery, int channel = 0);
+
+		// Send the state to all clients, pulled by Local::pullSnapshot(). Each client
+		// gets the delta against the latest snapshot it acked, i.e. only the changed
+		// bytes are sent. Snapshots are unreliable, a lost one is covered by the next.
+		void sendSnapshot(const Packet& snapshot);
+
+		// Tick mode, see Network::setTickRate(). Block until a tick after the one
+		// last returned is done, i.e. all packets received until then can be pulled,
+		// or until the timeout in milliseconds expires. The packets sent until the
+		// next tick are written to each client at once. Return the tick, 0 on timeout
+		// or if not in tick mode. Skipped ticks are not returned, their packets are
+		// pulled with the next tick.
+		long long waitForTick(int timeout = 1000);
+
 	private:
-		const int SERVER_ID = 0;
+		static const int SERVER_ID = 0;
 
-		// Only full packages.
-		std::vector<char> sendBuffer_;
-		std::vector<char> receiveBuffer_;
+		// Pushed by the network threads, i.e. one merged stream.
+		MpscQueue<Message> receiveBuffer_;
+		MpscQueue<SlowClientEvent> eventBuffer_;
 		Network* network_;
+		long long tick_; // The latest tick returned by waitForTick().
 	};
 
 } // Namespace net.
@@ -0,0 +1,137 @@
+#include "simulatortransport.h"
+
+#include <algorithm>
+
+namespace net {
+
+	SimulatorTransport::SimulatorTransport(std::unique_ptr<Transport> transport, double loss, int latency, int jitter)
+		: transport_(std::move(transport)), random_(std::random_device()()) {
+
+		loss_ = loss;
+		latency_ = latency;
+		jitter_ = jitter;
+		lost_ = 0;
+	}
+
+	bool SimulatorTransport::init() {
+		return transport_->init();
+	}
+
+	Socket SimulatorTransport::listen(int port) {
+		return transport_->listen(port);
+	}
+
+	Socket SimulatorTransport::connect(const std::string& ip, int port) {
+		return transport_->connect(ip, port);
+	}
+
+	Socket SimulatorTransport::accept(Socket listenSocket) {
+		return transport_->accept(listenSocket);
+	}
+
+	void SimulatorTransport::close(Socket socket) {
+		// The socket handle may be reused.
+		for (auto it = delayed_.begin(); it != delayed_.end();) {
+			if (it->second.socket_ == socket) {
+				it = delayed_.erase(it);
+			} else {
+				++it;
+			}
+		}
+		transport_->close(socket);
+	}
+
+	int SimulatorTransport::receive(Socket socket, char* data, int size) {
+		return transport_->receive(socket, data, size);
+	}
+
+	int SimulatorTransport::send(Socket socket, const char* data, int size) {
+		return transport_->send(socket, data, size);
+	}
+
+	int SimulatorTransport::send(Socket socket, const Segment* segments, int nbr) {
+		return transport_->send(socket, segments, nbr);
+	}
+
+	Socket SimulatorTransport::openDatagram(int port) {
+		return transport_->openDatagram(port);
+	}
+
+	int SimulatorTransport::getPort(Socket socket) {
+		return transport_->getPort(socket);
+	}
+
+	Address SimulatorTransport::getPeerAddress(Socket socket) {
+		return transport_->getPeerAddress(socket);
+	}
+
+	int SimulatorTransport::sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) {
+		sendDue();
+		std::uniform_real_distribution<double> loss(0, 1);
+		std::uniform_int_distribution<int> jitter(0, jitter_);
+		auto time = Clock::now();
+		for (int i = 0; i < nbr; ++i) {
+			if (loss(random_) < loss_) {
+				++lost_;
+				continue;
+			}
+			Delayed delayed;
+			delayed.socket_ = socket;
+			delayed.address_ = datagrams[i].address_;
+			delayed.data_.assign(datagrams[i].data_, datagrams[i].data_ + datagrams[i].size_);
+			delayed_.insert(std::make_pair(time + std::chrono::milliseconds(latency_ + jitter(random_)), std::move(delayed)));
+		}
+		sendDue();
+		// All datagrams are taken care of.
+		return nbr;
+	}
+
+	int SimulatorTransport::receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) {
+		return transport_->receiveDatagrams(socket, datagrams, nbr);
+	}
+
+	void SimulatorTransport::setWriteInterest(Socket socket, bool interest) {
+		transport_->setWriteInterest(socket, interest);
+	}
+
+	void SimulatorTransport::wait(int timeout) {
+		if (!delayed_.empty()) {
+			// Wake up in time to send the next delayed datagram.
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(delayed_.begin()->first - Clock::now()).count();
+			timeout = std::max(0, std::min(timeout, (int) left + 1));
+		}
+		transport_->wait(timeout);
+		sendDue();
+	}
+
+	bool SimulatorTransport::isReadable(Socket socket) const {
+		return transport_->isReadable(socket);
+	}
+
+	bool SimulatorTransport::isWritable(Socket socket) const {
+		return transport_->isWritable(socket);
+	}
+
+	void SimulatorTransport::wakeUp() {
+		transport_->wakeUp();
+	}
+
+	long long SimulatorTransport::getLost() const {
+		return lost_;
+	}
+
+	void SimulatorTransport::sendDue() {
+		auto time = Clock::now();
+		while (!delayed_.empty() && delayed_.begin()->first <= time) {
+			Delayed& delayed = delayed_.begin()->second;
+			Datagram datagram;
+			datagram.address_ = delayed.address_;
+			datagram.data_ = delayed.data_.data();
+			datagram.size_ = delayed.data_.size();
+			// Lost if the socket buffer is full.
+			transport_->sendDatagrams(delayed.socket_, &datagram, 1);
+			delayed_.erase(delayed_.begin());
+		}
+	}
+
+} // Namespace net.
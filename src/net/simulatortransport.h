@@ -0,0 +1,88 @@
+#ifndef NET_SIMULATORTRANSPORT_H
+#define NET_SIMULATORTRANSPORT_H
+
+#include "transport.h"
+
+#include <memory>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <random>
+#include <atomic>
+
+namespace net {
+
+	// Wraps a transport and simulates a bad network for the datagrams sent, i.e.
+	// some are lost and the rest are delayed. Used to test the reliable datagram
+	// channels on one machine. The stream sockets are not affected.
+	class SimulatorTransport : public Transport {
+	public:
+		// Each datagram is lost with the probability loss, in [0, 1], and the rest
+		// are delayed by latency plus a random jitter in milliseconds, i.e. they
+		// may arrive out of order.
+		SimulatorTransport(std::unique_ptr<Transport> transport, double loss, int latency, int jitter = 0);
+
+		bool init() override;
+
+		Socket listen(int port) override;
+
+		Socket connect(const std::string& ip, int port) override;
+
+		Socket accept(Socket listenSocket) override;
+
+		void close(Socket socket) override;
+
+		int receive(Socket socket, char* data, int size) override;
+
+		int send(Socket socket, const char* data, int size) override;
+
+		int send(Socket socket, const Segment* segments, int nbr) override;
+
+		Socket openDatagram(int port) override;
+
+		int getPort(Socket socket) override;
+
+		Address getPeerAddress(Socket socket) override;
+
+		int sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) override;
+
+		int receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) override;
+
+		void setWriteInterest(Socket socket, bool interest) override;
+
+		void wait(int timeout) override;
+
+		bool isReadable(Socket socket) const override;
+
+		bool isWritable(Socket socket) const override;
+
+		void wakeUp() override;
+
+		// The number of datagrams lost on purpose. Thread safe.
+		long long getLost() const;
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		class Delayed {
+		public:
+			Socket socket_;
+			Address address_;
+			std::vector<char> data_;
+		};
+
+		// Send the delayed datagrams whose time has come.
+		void sendDue();
+
+		std::unique_ptr<Transport> transport_;
+		double loss_;
+		int latency_;
+		int jitter_;
+		std::mt19937 random_;
+		std::multimap<Clock::time_point, Delayed> delayed_; // Sorted by the time to be sent.
+		std::atomic<long long> lost_;
+	};
+
+} // Namespace net.
+
+#endif // NET_SIMULATORTRANSPORT_H
@@ -0,0 +1,135 @@
+#ifndef NET_SLOTMAP_H
+#define NET_SLOTMAP_H
+
+#include <vector>
+#include <cassert>
+
+namespace net {
+
+	// A table of values indexed by generation tagged ids. The values are stored
+	// contiguously in memory, insert, find and erase are O(1). A slot is reused
+	// when its value is erased, but with a new generation, i.e. an old id never
+	// finds a new value.
+	//
+	// Id: bits 0 -> 15 the slot index, bits 16 -> 30 the generation (never 0).
+	// I.e. an id is always greater than 0xffff and never negative.
+	// The slot indexes of many tables can be interleaved, slot i of the table
+	// gets the index i * stride + offset.
+	template <class T>
+	class SlotMap {
+	public:
+		static const int INDEX_BITS = 16;
+		static const int INDEX_MASK = (1 << INDEX_BITS) - 1;
+		static const int MAX_GENERATION = 0x7fff;
+
+		SlotMap(int stride = 1, int offset = 0) {
+			stride_ = stride;
+			offset_ = offset;
+		}
+
+		// Insert the value. Return the id or 0 if the table is full.
+		int insert(T&& value) {
+			int slot;
+			if (!free_.empty()) {
+				slot = free_.back();
+				free_.pop_back();
+			} else {
+				slot = slots_.size();
+				if (slot * stride_ + offset_ > INDEX_MASK) {
+					return 0;
+				}
+				slots_.push_back(Slot());
+			}
+			int id = (slots_[slot].generation_ << INDEX_BITS) | (slot * stride_ + offset_);
+			slots_[slot].position_ = values_.size();
+			values_.push_back(std::move(value));
+			ids_.push_back(id);
+			return id;
+		}
+
+		// Return the value or nullptr if the id is not in the table.
+		T* find(int id) {
+			int slot = getSlot(id);
+			if (slot < 0) {
+				return nullptr;
+			}
+			return &values_[slots_[slot].position_];
+		}
+
+		// Erase the value, the last value is moved to its place.
+		void erase(int id) {
+			int slot = getSlot(id);
+			assert(slot >= 0);
+			int position = slots_[slot].position_;
+			if (position != (int) values_.size() - 1) {
+				values_[position] = std::move(values_.back());
+				ids_[position] = ids_.back();
+				slots_[getSlot(ids_[position])].position_ = position;
+			}
+			values_.pop_back();
+			ids_.pop_back();
+			slots_[slot].position_ = -1;
+			slots_[slot].generation_ = slots_[slot].generation_ == MAX_GENERATION ? 1 : slots_[slot].generation_ + 1;
+			free_.push_back(slot);
+		}
+
+		int size() const {
+			return values_.size();
+		}
+
+		bool empty() const {
+			return values_.empty();
+		}
+
+		// The value at the position in memory, in the interval [0, size()).
+		T& operator[](int position) {
+			return values_[position];
+		}
+
+		// The id of the value at the position in memory.
+		int getId(int position) const {
+			return ids_[position];
+		}
+
+		typename std::vector<T>::iterator begin() {
+			return values_.begin();
+		}
+
+		typename std::vector<T>::iterator end() {
+			return values_.end();
+		}
+
+	private:
+		class Slot {
+		public:
+			Slot() : generation_(1), position_(-1) {
+			}
+
+			int generation_;
+			int position_; // In values_, -1 if free.
+		};
+
+		// Return the slot of the id, -1 if the id is not in the table.
+		int getSlot(int id) const {
+			int index = (id & INDEX_MASK) - offset_;
+			if (id < 0 || index < 0 || index % stride_ != 0) {
+				return -1;
+			}
+			int slot = index / stride_;
+			if (slot >= (int) slots_.size() || slots_[slot].position_ < 0 || slots_[slot].generation_ != id >> INDEX_BITS) {
+				return -1;
+			}
+			return slot;
+		}
+
+		std::vector<Slot> slots_;
+		std::vector<T> values_;
+		std::vector<int> ids_; // The id of each value.
+		std::vector<int> free_; // Free slots.
+		int stride_;
+		int offset_;
+	};
+
+} // Namespace net.
+
+#endif // NET_SLOTMAP_H
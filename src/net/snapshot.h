@@ -0,0 +1,134 @@
+#ifndef NET_SNAPSHOT_H
+#define NET_SNAPSHOT_H
+
+#include "packet.h"
+#include "payload.h"
+
+#include <vector>
+
+namespace net {
+
+	// A snapshot of the state sent by the server, stored to be used as the
+	// baseline of later snapshots.
+	class Snapshot {
+	public:
+		Snapshot() : sequence_(0), offset_(0) {
+		}
+
+		Snapshot(int sequence, const Payload& payload, int offset) : sequence_(sequence), payload_(payload), offset_(offset) {
+		}
+
+		// The snapshot data, starting at the offset of the payload.
+		const char* data() const {
+			return payload_.data() + offset_;
+		}
+
+		int size() const {
+			return payload_.size() - offset_;
+		}
+
+		int sequence_; // 0 if none.
+		Payload payload_;
+		int offset_;
+	};
+
+	// Delta format, the snapshot XOR the baseline, which is zero beyond its size:
+	// SIZE, the size of the snapshot as a varint (LEB128)
+	// Followed by runs until the snapshot size is reached:
+	// ZEROS, the number of unchanged bytes as a varint
+	// LITERALS, the number of bytes following as a varint
+	// The LITERALS bytes XOR the baseline.
+	namespace delta {
+
+		// Zero runs shorter than this are stored as literals.
+		const int MIN_ZERO_RUN = 3;
+
+		inline void writeVarint(std::vector<char>& destination, unsigned int value) {
+			while (value >= 0x80) {
+				destination.push_back((char) (value | 0x80));
+				value >>= 7;
+			}
+			destination.push_back((char) value);
+		}
+
+		// Read the varint at the index. Return false if the data ends first.
+		inline bool readVarint(const char* data, int size, int& index, unsigned int& value) {
+			value = 0;
+			for (int i = 0; i < 5 && index < size; ++i) {
+				unsigned char byte = data[index++];
+				value |= (unsigned int) (byte & 0x7f) << (7 * i);
+				if ((byte & 0x80) == 0) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		inline char baselineByte(const char* baseline, int baselineSize, int index) {
+			return index < baselineSize ? baseline[index] : 0;
+		}
+
+	}
+
+	// Append the delta of the snapshot against the baseline to the destination.
+	// Without a baseline, i.e. baselineSize 0, the delta holds the whole snapshot.
+	inline void encodeDelta(const char* snapshot, int size, const char* baseline, int baselineSize, std::vector<char>& destination) {
+		delta::writeVarint(destination, size);
+		int index = 0;
+		while (index < size) {
+			int start = index;
+			while (index < size && snapshot[index] == delta::baselineByte(baseline, baselineSize, index)) {
+				++index;
+			}
+			int zeros = index - start;
+			// The literals end at the first zero run long enough or at the end.
+			start = index;
+			int run = 0;
+			while (index < size && run < delta::MIN_ZERO_RUN) {
+				run = snapshot[index] == delta::baselineByte(baseline, baselineSize, index) ? run + 1 : 0;
+				++index;
+			}
+			if (run == delta::MIN_ZERO_RUN) {
+				index -= run;
+			}
+			delta::writeVarint(destination, zeros);
+			delta::writeVarint(destination, index - start);
+			for (int i = start; i < index; ++i) {
+				destination.push_back(snapshot[i] ^ delta::baselineByte(baseline, baselineSize, i));
+			}
+		}
+	}
+
+	// Reconstruct the snapshot from the delta and the baseline it was encoded
+	// against. Return false if the delta is invalid or the snapshot is larger
+	// than maxSize.
+	inline bool decodeDelta(const char* data, int size, const char* baseline, int baselineSize, int maxSize, Packet& snapshot) {
+		int index = 0;
+		unsigned int snapshotSize;
+		if (!delta::readVarint(data, size, index, snapshotSize) || snapshotSize > (unsigned int) maxSize) {
+			return false;
+		}
+		snapshot.clear();
+		snapshot.resize(snapshotSize);
+		char* destination = snapshot.getData();
+		unsigned int position = 0;
+		while (position < snapshotSize) {
+			unsigned int zeros, literals;
+			if (!delta::readVarint(data, size, index, zeros) || !delta::readVarint(data, size, index, literals)
+				|| zeros > snapshotSize - position || literals > snapshotSize - position - zeros
+				|| literals > (unsigned int) (size - index) || zeros + literals == 0) {
+				return false;
+			}
+			for (unsigned int i = 0; i < zeros; ++i, ++position) {
+				destination[position] = delta::baselineByte(baseline, baselineSize, position);
+			}
+			for (unsigned int i = 0; i < literals; ++i, ++position) {
+				destination[position] = data[index++] ^ delta::baselineByte(baseline, baselineSize, position);
+			}
+		}
+		return index == size;
+	}
+
+} // Namespace net.
+
+#endif // NET_SNAPSHOT_H
@@ -0,0 +1,107 @@
+#include "stats.h"
+
+#include <sstream>
+
+namespace net {
+
+	namespace {
+
+		void writeMetric(std::ostringstream& stream, const std::string& name, const char* type, long long value) {
+			stream << "# TYPE " << name << " " << type << "\n" << name << " " << value << "\n";
+		}
+
+		void writeHistogram(std::ostringstream& stream, const std::string& name, const LatencyHistogram& histogram) {
+			// The buckets are cumulative in the text format.
+			stream << "# TYPE " << name << " histogram\n";
+			long long count = 0;
+			for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+				count += histogram.buckets_[i];
+				long long bound = LatencyHistogram::getUpperBound(i);
+				stream << name << "_bucket{le=\"";
+				if (bound < 0) {
+					stream << "+Inf";
+				} else {
+					stream << bound;
+				}
+				stream << "\"} " << count << "\n";
+			}
+			stream << name << "_sum " << histogram.sum_ / 1000.0 << "\n";
+			stream << name << "_count " << histogram.count_ << "\n";
+		}
+
+	}
+
+	LatencyHistogram LatencyRecorder::get() const {
+		LatencyHistogram histogram;
+		for (int i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+			histogram.buckets_[i] = buckets_[i].get();
+		}
+		histogram.count_ = count_.get();
+		histogram.sum_ = sum_.get();
+		return histogram;
+	}
+
+	void LatencyRecorder::reset() {
+		for (Counter& bucket : buckets_) {
+			bucket.take();
+		}
+		count_.take();
+		sum_.take();
+	}
+
+	TrafficStats TrafficCounters::get() const {
+		TrafficStats stats;
+		stats.bytesSent_ = bytesSent_.get();
+		stats.bytesReceived_ = bytesReceived_.get();
+		stats.packagesSent_ = packagesSent_.get();
+		stats.packagesReceived_ = packagesReceived_.get();
+		stats.sendCalls_ = sendCalls_.get();
+		stats.receiveCalls_ = receiveCalls_.get();
+		stats.datagramsSent_ = datagramsSent_.get();
+		stats.datagramsReceived_ = datagramsReceived_.get();
+		stats.resends_ = resends_.get();
+		return stats;
+	}
+
+	void TrafficCounters::reset() {
+		bytesSent_.take();
+		bytesReceived_.take();
+		packagesSent_.take();
+		packagesReceived_.take();
+		sendCalls_.take();
+		receiveCalls_.take();
+		datagramsSent_.take();
+		datagramsReceived_.take();
+		resends_.take();
+	}
+
+	std::string NetworkStats::toText(const std::string& prefix) const {
+		std::ostringstream stream;
+		writeMetric(stream, prefix + "bytes_sent_total", "counter", bytesSent_);
+		writeMetric(stream, prefix + "bytes_received_total", "counter", bytesReceived_);
+		writeMetric(stream, prefix + "packages_sent_total", "counter", packagesSent_);
+		writeMetric(stream, prefix + "packages_received_total", "counter", packagesReceived_);
+		writeMetric(stream, prefix + "send_calls_total", "counter", sendCalls_);
+		writeMetric(stream, prefix + "saved_send_calls_total", "counter", savedSendCalls_);
+		writeMetric(stream, prefix + "receive_calls_total", "counter", receiveCalls_);
+		writeMetric(stream, prefix + "datagrams_sent_total", "counter", datagramsSent_);
+		writeMetric(stream, prefix + "datagrams_received_total", "counter", datagramsReceived_);
+		writeMetric(stream, prefix + "resends_total", "counter", resends_);
+		writeMetric(stream, prefix + "accepted_total", "counter", accepted_);
+		writeMetric(stream, prefix + "disconnected_total", "counter", disconnected_);
+		writeMetric(stream, prefix + "connections", "gauge", connections_);
+		writeMetric(stream, prefix + "send_queue_bytes", "gauge", sendQueueSize_);
+		writeMetric(stream, prefix + "mailbox_packages", "gauge", mailboxSize_);
+		writeHistogram(stream, prefix + "send_latency_microseconds", sendLatency_);
+		writeMetric(stream, prefix + "ticks_total", "counter", ticks_);
+		writeMetric(stream, prefix + "tick_overruns_total", "counter", tickOverruns_);
+		writeHistogram(stream, prefix + "tick_jitter_microseconds", tickJitter_);
+		writeHistogram(stream, prefix + "tick_duration_microseconds", tickDuration_);
+		writeMetric(stream, prefix + "pool_reserved_bytes", "gauge", pool_.reserved_);
+		writeMetric(stream, prefix + "pool_cache_misses_total", "counter", pool_.cacheMisses_);
+		writeMetric(stream, prefix + "pool_misses_total", "counter", pool_.poolMisses_);
+		writeMetric(stream, prefix + "pool_oversized_total", "counter", pool_.oversized_);
+		return stream.str();
+	}
+
+} // Namespace net.
@@ -0,0 +1,201 @@
+#ifndef NET_STATS_H
+#define NET_STATS_H
+
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace net {
+
+	// A value updated by many threads without locks, e.g. by the network threads
+	// while the application reads it.
+	class Counter {
+	public:
+		Counter() : value_(0) {
+		}
+
+		void add(long long value) {
+			value_.fetch_add(value, std::memory_order_relaxed);
+		}
+
+		void set(long long value) {
+			value_.store(value, std::memory_order_relaxed);
+		}
+
+		long long get() const {
+			return value_.load(std::memory_order_relaxed);
+		}
+
+		// Return the value and set it to zero.
+		long long take() {
+			return value_.exchange(0, std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<long long> value_;
+	};
+
+	// A histogram of durations. Bucket 0 holds the durations below 1 microsecond,
+	// bucket i the durations in [2^(i - 1), 2^i) microseconds and the last bucket
+	// all longer ones.
+	class LatencyHistogram {
+	public:
+		static const int BUCKETS = 24;
+
+		LatencyHistogram() : count_(0), sum_(0) {
+			buckets_.fill(0);
+		}
+
+		// The bucket of the duration.
+		static int getBucket(long long nanoseconds) {
+			long long microseconds = nanoseconds / 1000;
+			int bucket = 0;
+			while (microseconds > 0 && bucket < BUCKETS - 1) {
+				microseconds >>= 1;
+				++bucket;
+			}
+			return bucket;
+		}
+
+		// The upper bound of the bucket in microseconds, -1 for the last one, i.e. unbounded.
+		static long long getUpperBound(int bucket) {
+			return bucket < BUCKETS - 1 ? 1LL << bucket : -1;
+		}
+
+		// The upper bound in microseconds of the bucket holding the fraction, in
+		// [0, 1], of the durations. 0 if empty, -1 if in the last bucket.
+		long long getPercentile(double fraction) const {
+			long long sum = 0;
+			for (int i = 0; i < BUCKETS; ++i) {
+				sum += buckets_[i];
+				if (sum > 0 && sum >= fraction * count_) {
+					return getUpperBound(i);
+				}
+			}
+			return 0;
+		}
+
+		// The mean duration in microseconds.
+		double getMean() const {
+			return count_ == 0 ? 0.0 : sum_ / 1000.0 / count_;
+		}
+
+		std::array<long long, BUCKETS> buckets_;
+		long long count_;
+		long long sum_; // In nanoseconds.
+	};
+
+	// Records durations into a histogram without locks.
+	class LatencyRecorder {
+	public:
+		void record(long long nanoseconds) {
+			buckets_[LatencyHistogram::getBucket(nanoseconds)].add(1);
+			count_.add(1);
+			sum_.add(nanoseconds);
+		}
+
+		LatencyHistogram get() const;
+
+		void reset();
+
+	private:
+		std::array<Counter, LatencyHistogram::BUCKETS> buckets_;
+		Counter count_;
+		Counter sum_;
+	};
+
+	// The data sent and received through the sockets, by a connection or by all
+	// connections. Bytes include the package headers and the datagrams.
+	class TrafficStats {
+	public:
+		TrafficStats() : bytesSent_(0), bytesReceived_(0), packagesSent_(0), packagesReceived_(0), sendCalls_(0),
+			receiveCalls_(0), datagramsSent_(0), datagramsReceived_(0), resends_(0) {
+		}
+
+		long long bytesSent_;
+		long long bytesReceived_;
+		long long packagesSent_; // Streamed packages written to the socket, datagram packages queued.
+		long long packagesReceived_;
+		long long sendCalls_; // Stream send calls to the transport.
+		long long receiveCalls_;
+		long long datagramsSent_; // Written by the network thread, the socket may drop some.
+		long long datagramsReceived_;
+		long long resends_; // Reliable datagram packages sent again.
+	};
+
+	class TrafficCounters {
+	public:
+		TrafficStats get() const;
+
+		void reset();
+
+		Counter bytesSent_;
+		Counter bytesReceived_;
+		Counter packagesSent_;
+		Counter packagesReceived_;
+		Counter sendCalls_;
+		Counter receiveCalls_;
+		Counter datagramsSent_;
+		Counter datagramsReceived_;
+		Counter resends_;
+	};
+
+	// The stats of one connection, i.e. of a remote client seen by the server or
+	// of the connection to the server seen by a client.
+	class ConnectionStats : public TrafficStats {
+	public:
+		ConnectionStats() : sendQueueSize_(0), rtt_(0) {
+		}
+
+		int sendQueueSize_; // Bytes waiting to be sent on the stream, or to be acked as reliable datagrams.
+		// The smoothed datagram round trip time in milliseconds, 0 before any datagram
+		// is sent and an estimate until the first ack.
+		double rtt_;
+	};
+
+	// The stats of the buffer pool, see BufferPool.
+	class PoolStats {
+	public:
+		PoolStats() : reserved_(0), cacheMisses_(0), poolMisses_(0), oversized_(0) {
+		}
+
+		long long reserved_; // Bytes allocated from the heap, i.e. the high-water mark.
+		long long cacheMisses_; // Refills of an empty thread cache.
+		long long poolMisses_; // Refills not served by the shared free lists, i.e. a new slab.
+		long long oversized_; // Allocations too big for a chunk, served by the heap.
+	};
+
+	// The stats of a network, i.e. the sum of all connections, including the
+	// ones closed.
+	class NetworkStats : public TrafficStats {
+	public:
+		NetworkStats() : savedSendCalls_(0), accepted_(0), disconnected_(0), connections_(0), sendQueueSize_(0), mailboxSize_(0),
+			ticks_(0), tickOverruns_(0) {
+		}
+
+		// The stats in the Prometheus text format, each name starts with the prefix.
+		std::string toText(const std::string& prefix = "net_") const;
+
+		long long savedSendCalls_; // See Network::getSavedSendCalls().
+		long long accepted_;
+		long long disconnected_;
+		int connections_; // Remote clients connected.
+		long long sendQueueSize_; // Bytes waiting to be sent on all streams, or to be acked as reliable datagrams.
+		long long mailboxSize_; // Packages waiting for the network threads.
+		// The time from the send call until the package is written to the socket,
+		// or for a datagram until it is queued by the network thread, per connection.
+		LatencyHistogram sendLatency_;
+
+		// Tick mode, see Network::setTickRate(). The ticks are counted by the first
+		// network thread, the rest by each network thread.
+		long long ticks_;
+		long long tickOverruns_; // Ticks skipped, i.e. a network thread was more than a period late.
+		LatencyHistogram tickJitter_; // The time from when a tick is due until it starts.
+		LatencyHistogram tickDuration_; // The time to send the output of a tick.
+
+		PoolStats pool_; // Shared by all networks.
+	};
+
+} // Namespace net.
+
+#endif // NET_STATS_H
@@ -0,0 +1,118 @@
+#ifndef NET_TRANSPORT_H
+#define NET_TRANSPORT_H
+
+#include <string>
+#include <cstdint>
+
+namespace net {
+
+	// Handle to a socket created by a transport.
+	typedef int Socket;
+
+	// A contiguous piece of memory to be sent.
+	class Segment {
+	public:
+		const char* data_;
+		int size_;
+	};
+
+	// An IPv4 address and port, both in network byte order.
+	class Address {
+	public:
+		Address() : host_(0), port_(0) {
+		}
+
+		bool operator==(const Address& address) const {
+			return host_ == address.host_ && port_ == address.port_;
+		}
+
+		uint32_t host_;
+		uint16_t port_;
+	};
+
+	// A datagram and the address it is sent to or received from.
+	class Datagram {
+	public:
+		Address address_;
+		char* data_;
+		int size_;
+	};
+
+	// The socket layer used by the network thread. The sockets created by the
+	// transport are part of the event loop, i.e. wait() returns when any of them
+	// is ready. All functions, except wakeUp(), are only called from the network thread.
+	class Transport {
+	public:
+		static const Socket NO_SOCKET = -1;
+
+		virtual ~Transport() {
+		}
+
+		// Init the event loop. Return false on error.
+		virtual bool init() = 0;
+
+		// Open a socket listening on the port. Return NO_SOCKET on error.
+		virtual Socket listen(int port) = 0;
+
+		// Connect to the server. Blocks until connected. Return NO_SOCKET on error.
+		virtual Socket connect(const std::string& ip, int port) = 0;
+
+		// Accept a new connection. Return NO_SOCKET when there is no connection to accept.
+		virtual Socket accept(Socket listenSocket) = 0;
+
+		// Close the socket.
+		virtual void close(Socket socket) = 0;
+
+		// Receive data. Return the number of bytes received, 0 if no data is
+		// available and -1 if the connection is closed.
+		virtual int receive(Socket socket, char* data, int size) = 0;
+
+		// Send data. Return the number of bytes sent, which may be less than size
+		// when the socket buffer is full, and -1 on error.
+		virtual int send(Socket socket, const char* data, int size) = 0;
+
+		// Send the segments in order with one system call, i.e. a gather write.
+		// Return the total number of bytes sent, which may be less than the size
+		// of all segments when the socket buffer is full, and -1 on error.
+		virtual int send(Socket socket, const Segment* segments, int nbr) = 0;
+
+		// Open a datagram (udp) socket bound to the port, 0 for any free port.
+		// Return NO_SOCKET on error.
+		virtual Socket openDatagram(int port) = 0;
+
+		// Return the local port of the socket.
+		virtual int getPort(Socket socket) = 0;
+
+		// Return the address of the peer of a connected stream socket.
+		virtual Address getPeerAddress(Socket socket) = 0;
+
+		// Send the datagrams, with one system call when supported. Return the
+		// number of datagrams sent and -1 on error.
+		virtual int sendDatagrams(Socket socket, const Datagram* datagrams, int nbr) = 0;
+
+		// Receive datagrams. Each datagram's data_ and size_ is the buffer to
+		// receive to, size_ and address_ are set to the datagram received. A
+		// datagram not fitting the buffer gets a size_ of -1. Return the number of
+		// datagrams received, 0 if none is available.
+		virtual int receiveDatagrams(Socket socket, Datagram* datagrams, int nbr) = 0;
+
+		// Make wait() return when the socket is writable. Used when not all data was sent.
+		virtual void setWriteInterest(Socket socket, bool interest) = 0;
+
+		// Block until any socket is ready, until wakeUp() is called or until the
+		// timeout in milliseconds expires.
+		virtual void wait(int timeout) = 0;
+
+		// Return true if the socket was readable when wait() returned.
+		virtual bool isReadable(Socket socket) const = 0;
+
+		// Return true if the socket was writable when wait() returned.
+		virtual bool isWritable(Socket socket) const = 0;
+
+		// Make the thread blocking in wait() to return. Thread safe.
+		virtual void wakeUp() = 0;
+	};
+
+} // Namespace net.
+
+#endif // NET_TRANSPORT_H
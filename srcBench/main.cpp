@@ -0,0 +1,477 @@
+#include "net/network.h"
+#include "net/server.h"
+#include "net/client.h"
+#include "net/local.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+// Benchmark of the throughput and the end-to-end latency of the library. A server
+// and the clients run in this process, each with its own network thread, i.e. the
+// data passes through the loopback interface when the server is remote.
+//
+// Usage: NetworkBench [--clients N] [--messages N] [--sizes 8,64,...] [--modes all,to,relay]
+//                     [--servers local,remote] [--workers N] [--port N] [--format table|csv|json]
+
+namespace {
+
+	// Counts all allocations made in the process, including by the network threads.
+	std::atomic<long long> allocations(0);
+
+	typedef std::chrono::steady_clock Clock;
+
+	// The first bytes of each message, i.e. when it was sent.
+	const int TIMESTAMP_SIZE = sizeof(long long);
+
+	// Max number of bytes in flight to each receiver, well below the send queue
+	// limit of the server, see Network::setSendQueueLimit().
+	const int WINDOW_BYTES = 512 * 1024;
+	const int MAX_WINDOW = 1024;
+
+	// A run is aborted when no message is received for this long.
+	const int TIMEOUT_MS = 10000;
+
+	enum Mode {
+		ALL,	// Server::sendToAll, received by all clients.
+		TO,		// Server::sendTo, each client in turn.
+		RELAY	// Local::sendToAll of the first client, relayed by the server to the others.
+	};
+
+	const char* modeName(Mode mode) {
+		switch (mode) {
+			case ALL:
+				return "all";
+			case TO:
+				return "to";
+			default:
+				return "relay";
+		}
+	}
+
+	class Options {
+	public:
+		Options() : clients_(4), messages_(20000), workers_(1), port_(12600), format_("table") {
+			sizes_ = {8, 64, 512, 4096, 32768, 65536};
+			modes_ = {ALL, TO, RELAY};
+			remote_ = {false, true};
+		}
+
+		int clients_;
+		int messages_;
+		int workers_;
+		int port_;
+		std::string format_;
+		std::vector<int> sizes_;
+		std::vector<Mode> modes_;
+		std::vector<bool> remote_; // Server created by createServer(), else createLocalServer().
+	};
+
+	class Result {
+	public:
+		Result() : remote_(false), mode_(ALL), size_(0), clients_(0), messages_(0), deliveries_(0),
+			seconds_(0), p50_(0), p99_(0), p999_(0), cpuSeconds_(0), allocations_(0), complete_(false) {
+		}
+
+		bool remote_;
+		Mode mode_;
+		int size_;
+		int clients_;
+		long long messages_; // Sent.
+		long long deliveries_; // Received, by all receivers.
+		double seconds_;
+		double p50_, p99_, p999_; // Latency in microseconds.
+		double cpuSeconds_; // Of the process, i.e. all threads.
+		long long allocations_;
+		bool complete_;
+	};
+
+	// The server and its clients, the network objects own the threads.
+	class Setup {
+	public:
+		std::unique_ptr<net::Network> serverNetwork_;
+		std::shared_ptr<net::Server> server_;
+		std::vector<std::unique_ptr<net::Network>> clientNetworks_;
+		std::vector<std::shared_ptr<net::Local>> locals_; // The receivers.
+		std::vector<std::shared_ptr<net::Client>> clients_; // The receivers as seen by the server.
+	};
+
+	long long nanoseconds() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+	}
+
+	bool waitFor(const std::function<bool()>& condition) {
+		auto start = Clock::now();
+		while (!condition()) {
+			if (Clock::now() - start > std::chrono::milliseconds(TIMEOUT_MS)) {
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	bool createSetup(const Options& options, bool remote, Setup& setup) {
+		if (!remote) {
+			setup.serverNetwork_.reset(new net::Network());
+			setup.server_ = setup.serverNetwork_->createLocalServer();
+			setup.locals_.push_back(setup.serverNetwork_->getLocal());
+			setup.clients_.push_back(setup.locals_.back());
+			return true;
+		}
+		setup.serverNetwork_.reset(new net::Network(options.workers_));
+		setup.server_ = setup.serverNetwork_->createServer(options.port_);
+		if (setup.server_ == nullptr) {
+			std::fprintf(stderr, "Failed to create a server on port %d\n", options.port_);
+			return false;
+		}
+		for (int i = 0; i < options.clients_; ++i) {
+			setup.clientNetworks_.push_back(std::unique_ptr<net::Network>(new net::Network()));
+			setup.clientNetworks_.back()->connectToServer(options.port_, "localhost");
+			setup.locals_.push_back(setup.clientNetworks_.back()->getLocal());
+		}
+		setup.clients_.resize(options.clients_);
+		for (int i = 0; i < options.clients_; ++i) {
+			std::shared_ptr<net::Local> local = setup.locals_[i];
+			if (!waitFor([&]() { return local->getId() != 0; })) {
+				std::fprintf(stderr, "Client %d failed to connect\n", i);
+				return false;
+			}
+			// Tells the server which client is which.
+			net::Packet hello;
+			hello.write(i);
+			local->sendToServer(hello);
+		}
+		int connected = 0;
+		bool valid = waitFor([&]() {
+			net::Packet packet;
+			while (std::shared_ptr<net::Client> client = setup.server_->pullReceiveData(packet)) {
+				int index;
+				if (packet.read(index) && index >= 0 && index < options.clients_ && !setup.clients_[index]) {
+					setup.clients_[index] = client;
+					++connected;
+				}
+			}
+			return connected == options.clients_;
+		});
+		if (!valid) {
+			std::fprintf(stderr, "The server did not receive all clients\n");
+		}
+		return valid;
+	}
+
+	double percentile(const std::vector<long long>& sorted, double fraction) {
+		if (sorted.empty()) {
+			return 0;
+		}
+		size_t index = std::min(sorted.size() - 1, (size_t) (fraction * sorted.size()));
+		return sorted[index] / 1000.0;
+	}
+
+	// Send the messages and wait until all are received. The receivers are polled
+	// by a thread of their own.
+	Result run(Setup& setup, bool remote, Mode mode, int size, int messages) {
+		// The first client sends when relaying.
+		int firstReceiver = mode == RELAY ? 1 : 0;
+		int receivers = (int) setup.locals_.size() - firstReceiver;
+		int window = std::max(1, std::min(MAX_WINDOW, WINDOW_BYTES / size));
+
+		std::vector<long long> sent(receivers, 0);
+		std::vector<std::atomic<long long>> received(receivers);
+		for (auto& count : received) {
+			count = 0;
+		}
+		long long expected = mode == TO ? messages : (long long) messages * receivers;
+		std::vector<long long> latencies;
+		latencies.reserve(expected);
+		std::atomic<bool> done(false);
+		std::atomic<bool> timeout(false);
+
+		std::thread receiver([&]() {
+			long long total = 0;
+			auto progress = Clock::now();
+			auto record = [&](int index, const net::Packet& packet) {
+				long long time;
+				std::memcpy(&time, packet.getData(), TIMESTAMP_SIZE);
+				latencies.push_back(nanoseconds() - time);
+				received[index].store(received[index] + 1, std::memory_order_release);
+				++total;
+			};
+			while (total < expected) {
+				int count = 0;
+				for (int i = 0; i < receivers; ++i) {
+					net::Local& local = *setup.locals_[firstReceiver + i];
+					if (mode == RELAY) {
+						count += local.pullAll([&](const net::Packet& packet) {
+							record(i, packet);
+						});
+					} else {
+						count += local.pullAllFromServer([&](const net::Packet& packet) {
+							record(i, packet);
+						});
+					}
+				}
+				if (remote) {
+					// Copies to the local client of the server, not measured.
+					net::Local& local = *setup.serverNetwork_->getLocal();
+					local.pullAll([](const net::Packet&) {});
+					local.pullAllFromServer([](const net::Packet&) {});
+				}
+				if (count > 0) {
+					progress = Clock::now();
+				} else if (Clock::now() - progress > std::chrono::milliseconds(TIMEOUT_MS)) {
+					timeout = true;
+					break;
+				} else {
+					std::this_thread::yield();
+				}
+			}
+			done = true;
+		});
+
+		long long startAllocations = allocations;
+		std::clock_t startCpu = std::clock();
+		auto start = Clock::now();
+
+		net::Packet packet;
+		packet.resize(size);
+		std::fill(packet.getData(), packet.getData() + size, 'x');
+		for (int i = 0; i < messages && !timeout; ++i) {
+			int target = mode == TO ? i % receivers : -1;
+			// Wait for the receivers to be within the window.
+			for (int j = 0; j < receivers && !timeout; ++j) {
+				if (target < 0 || target == j) {
+					while (sent[j] - received[j].load(std::memory_order_acquire) >= window && !timeout) {
+						std::this_thread::yield();
+					}
+					++sent[j];
+				}
+			}
+			long long time = nanoseconds();
+			std::memcpy(packet.getData(), &time, TIMESTAMP_SIZE);
+			switch (mode) {
+				case ALL:
+					setup.server_->sendToAll(packet);
+					break;
+				case TO:
+					setup.server_->sendTo(setup.clients_[target], packet);
+					break;
+				case RELAY:
+					setup.locals_[0]->sendToAll(packet);
+					break;
+			}
+		}
+		receiver.join();
+
+		Result result;
+		result.seconds_ = std::chrono::duration<double>(Clock::now() - start).count();
+		result.cpuSeconds_ = (double) (std::clock() - startCpu) / CLOCKS_PER_SEC;
+		result.allocations_ = allocations - startAllocations;
+		result.remote_ = remote;
+		result.mode_ = mode;
+		result.size_ = size;
+		result.clients_ = receivers;
+		result.messages_ = messages;
+		result.deliveries_ = latencies.size();
+		result.complete_ = !timeout;
+		std::sort(latencies.begin(), latencies.end());
+		result.p50_ = percentile(latencies, 0.5);
+		result.p99_ = percentile(latencies, 0.99);
+		result.p999_ = percentile(latencies, 0.999);
+		return result;
+	}
+
+	void printHeader(const std::string& format) {
+		if (format == "csv") {
+			std::printf("server,mode,size,clients,messages,deliveries,seconds,messages_per_s,mb_per_s,"
+				"p50_us,p99_us,p999_us,cpu_us_per_message,allocations_per_message,complete\n");
+		} else if (format == "table") {
+			std::printf("%-7s %-6s %6s %7s %12s %10s %9s %9s %9s %12s %12s\n", "server", "mode", "size", "clients",
+				"messages/s", "MB/s", "p50 us", "p99 us", "p999 us", "cpu us/msg", "allocs/msg");
+		}
+	}
+
+	void print(const std::string& format, const Result& result) {
+		double deliveries = std::max(1LL, result.deliveries_);
+		double messagesPerSecond = result.deliveries_ / result.seconds_;
+		double mbPerSecond = result.deliveries_ * (double) result.size_ / result.seconds_ / (1024 * 1024);
+		double cpuPerMessage = result.cpuSeconds_ * 1e6 / deliveries;
+		double allocationsPerMessage = result.allocations_ / deliveries;
+		const char* server = result.remote_ ? "remote" : "local";
+		if (format == "csv") {
+			std::printf("%s,%s,%d,%d,%lld,%lld,%.6f,%.1f,%.3f,%.2f,%.2f,%.2f,%.3f,%.3f,%d\n", server, modeName(result.mode_),
+				result.size_, result.clients_, result.messages_, result.deliveries_, result.seconds_, messagesPerSecond,
+				mbPerSecond, result.p50_, result.p99_, result.p999_, cpuPerMessage, allocationsPerMessage, result.complete_ ? 1 : 0);
+		} else if (format == "json") {
+			// One object per line.
+			std::printf("{\"server\":\"%s\",\"mode\":\"%s\",\"size\":%d,\"clients\":%d,\"messages\":%lld,\"deliveries\":%lld,"
+				"\"seconds\":%.6f,\"messages_per_s\":%.1f,\"mb_per_s\":%.3f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,"
+				"\"cpu_us_per_message\":%.3f,\"allocations_per_message\":%.3f,\"complete\":%s}\n", server, modeName(result.mode_),
+				result.size_, result.clients_, result.messages_, result.deliveries_, result.seconds_, messagesPerSecond,
+				mbPerSecond, result.p50_, result.p99_, result.p999_, cpuPerMessage, allocationsPerMessage, result.complete_ ? "true" : "false");
+		} else {
+			std::printf("%-7s %-6s %6d %7d %12.0f %10.2f %9.1f %9.1f %9.1f %12.2f %12.2f%s\n", server, modeName(result.mode_),
+				result.size_, result.clients_, messagesPerSecond, mbPerSecond, result.p50_, result.p99_, result.p999_,
+				cpuPerMessage, allocationsPerMessage, result.complete_ ? "" : " (timeout)");
+		}
+		std::fflush(stdout);
+	}
+
+	std::vector<std::string> split(const std::string& text) {
+		std::vector<std::string> parts;
+		std::stringstream stream(text);
+		std::string part;
+		while (std::getline(stream, part, ',')) {
+			parts.push_back(part);
+		}
+		return parts;
+	}
+
+	bool parse(int argc, char** argv, Options& options) {
+		for (int i = 1; i < argc; ++i) {
+			std::string name = argv[i];
+			if (i + 1 >= argc) {
+				std::fprintf(stderr, "Missing value of %s\n", name.c_str());
+				return false;
+			}
+			std::string value = argv[++i];
+			if (name == "--clients") {
+				options.clients_ = std::atoi(value.c_str());
+			} else if (name == "--messages") {
+				options.messages_ = std::atoi(value.c_str());
+			} else if (name == "--workers") {
+				options.workers_ = std::atoi(value.c_str());
+			} else if (name == "--port") {
+				options.port_ = std::atoi(value.c_str());
+			} else if (name == "--format") {
+				options.format_ = value;
+			} else if (name == "--sizes") {
+				options.sizes_.clear();
+				for (const std::string& size : split(value)) {
+					options.sizes_.push_back(std::atoi(size.c_str()));
+				}
+			} else if (name == "--modes") {
+				options.modes_.clear();
+				for (const std::string& mode : split(value)) {
+					if (mode == "all") {
+						options.modes_.push_back(ALL);
+					} else if (mode == "to") {
+						options.modes_.push_back(TO);
+					} else if (mode == "relay") {
+						options.modes_.push_back(RELAY);
+					} else {
+						std::fprintf(stderr, "Unknown mode %s\n", mode.c_str());
+						return false;
+					}
+				}
+			} else if (name == "--servers") {
+				options.remote_.clear();
+				for (const std::string& server : split(value)) {
+					if (server == "local" || server == "remote") {
+						options.remote_.push_back(server == "remote");
+					} else {
+						std::fprintf(stderr, "Unknown server %s\n", server.c_str());
+						return false;
+					}
+				}
+			} else {
+				std::fprintf(stderr, "Unknown option %s\n", name.c_str());
+				return false;
+			}
+		}
+		if (options.clients_ < 1 || options.messages_ < 1 || options.workers_ < 1) {
+			std::fprintf(stderr, "The clients, messages and workers must be positive\n");
+			return false;
+		}
+		if (options.format_ != "table" && options.format_ != "csv" && options.format_ != "json") {
+			std::fprintf(stderr, "Unknown format %s\n", options.format_.c_str());
+			return false;
+		}
+		for (int size : options.sizes_) {
+			if (size < TIMESTAMP_SIZE) {
+				std::fprintf(stderr, "The size %d is smaller than the timestamp, %d bytes\n", size, TIMESTAMP_SIZE);
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+void* operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& nothrow) noexcept {
+	return operator new(size, nothrow);
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+	std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+	std::free(memory);
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parse(argc, argv, options)) {
+		return 1;
+	}
+	printHeader(options.format_);
+	bool complete = true;
+	for (bool remote : options.remote_) {
+		Setup setup;
+		if (!createSetup(options, remote, setup)) {
+			return 1;
+		}
+		for (Mode mode : options.modes_) {
+			if (mode == RELAY && setup.locals_.size() < 2) {
+				// A local server has no other clients to relay to.
+				continue;
+			}
+			for (int size : options.sizes_) {
+				// Warm up, i.e. the buffers grow to their final size.
+				run(setup, remote, mode, size, std::max(1, options.messages_ / 10));
+				Result result = run(setup, remote, mode, size, options.messages_);
+				print(options.format_, result);
+				complete = complete && result.complete_;
+			}
+		}
+	}
+	return complete ? 0 : 1;
+}
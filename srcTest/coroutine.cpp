@@ -0,0 +1,250 @@
+#include "net/coroutine.h"
+
+#ifdef NET_POSIX
+#include "net/posixtransport.h"
+#endif
+
+#include <string>
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <set>
+#include <functional>
+#include <initializer_list>
+#include <thread>
+#include <chrono>
+
+// Poll the schedulers until the condition is true. Return false on timeout.
+bool run(std::initializer_list<net::Scheduler*> schedulers, const std::function<bool()>& condition) {
+	for (int i = 0; i < 5000; ++i) {
+		if (condition()) {
+			return true;
+		}
+		for (net::Scheduler* scheduler : schedulers) {
+			scheduler->poll(1);
+		}
+	}
+	return false;
+}
+
+// Wait until the condition is true. Return false on timeout.
+bool waitFor(const std::function<bool()>& condition) {
+	for (int i = 0; i < 5000; ++i) {
+		if (condition()) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+// Send each packet back to the client until it disconnects.
+net::Task echo(net::Scheduler& scheduler, net::Server& server, std::shared_ptr<net::Client> client, int& closed) {
+	while (std::optional<net::Packet> packet = co_await scheduler.receive(client)) {
+		server.sendTo(client, *packet);
+	}
+	++closed;
+}
+
+// Serve the clients, each by its own coroutine.
+net::Task serve(net::Scheduler& scheduler, net::Server& server, int clients, int& accepted, int& closed) {
+	for (int i = 0; i < clients; ++i) {
+		std::shared_ptr<net::Client> client = co_await scheduler.accept();
+		++accepted;
+		echo(scheduler, server, client, closed);
+	}
+}
+
+net::Task talk(net::Scheduler& scheduler, int port, int& echoed) {
+	std::shared_ptr<net::Local> local = co_await scheduler.connect(port, "localhost");
+	assert(local && local->getId() != 0);
+	for (int i = 0; i < 3; ++i) {
+		net::Packet packet;
+		packet << (char) i;
+		local->sendToServer(packet, net::RELIABLE_ORDERED);
+	}
+	for (int i = 0; i < 3; ++i) {
+		std::optional<net::Packet> packet = co_await scheduler.receiveFromServer();
+		assert(packet);
+		char value;
+		*packet >> value;
+		assert(value == i);
+		++echoed;
+	}
+}
+
+void test1() {
+	net::Network network1;
+	net::Scheduler scheduler1(network1);
+	std::shared_ptr<net::Server> server = network1.createServer(12475);
+	assert(server);
+	int accepted = 0, closed = 0;
+	serve(scheduler1, *server, 1, accepted, closed);
+	{
+		net::Network network2;
+		net::Scheduler scheduler2(network2);
+		int echoed = 0;
+		talk(scheduler2, 12475, echoed);
+		assert(run({&scheduler1, &scheduler2}, [&]() {
+			return echoed == 3;
+		}));
+		assert(accepted == 1 && closed == 0);
+	}
+	assert(run({&scheduler1}, [&]() {
+		return closed == 1;
+	}));
+	std::cout << "Test 1 succeeded, i.e. an echo server and client written as coroutines.\n";
+}
+
+net::Task collect(net::Scheduler& scheduler, int count, std::set<int>& senders) {
+	for (int i = 0; i < count; ++i) {
+		net::Message message = co_await scheduler.receive();
+		assert(message.sender_ && message.packet_.size() == 1);
+		senders.insert(message.sender_->getId());
+	}
+}
+
+void test2() {
+	net::Network network1;
+	net::Scheduler scheduler1(network1);
+	std::shared_ptr<net::Server> server = network1.createServer(12476);
+	assert(server);
+	std::set<int> senders;
+	collect(scheduler1, 2, senders);
+
+	// Clients not using coroutines.
+	net::Network network2, network3;
+	network2.connectToServer(12476, "localhost");
+	network3.connectToServer(12476, "localhost");
+	assert(run({&scheduler1}, [&]() {
+		return network2.getLocal()->getId() != 0 && network3.getLocal()->getId() != 0;
+	}));
+	char data[] = {'a'};
+	network2.getLocal()->sendToServer(net::Packet(data, sizeof(data)));
+	network3.getLocal()->sendToServer(net::Packet(data, sizeof(data)));
+	assert(run({&scheduler1}, [&]() {
+		return senders.size() == 2;
+	}));
+	assert(senders.count(network2.getLocal()->getId()) == 1 && senders.count(network3.getLocal()->getId()) == 1);
+	std::cout << "Test 2 succeeded, i.e. packets from any client awaited in the order received.\n";
+}
+
+net::Task connect(net::Scheduler& scheduler, int port, bool& failed) {
+	std::shared_ptr<net::Local> local = co_await scheduler.connect(port, "localhost");
+	failed = local == nullptr;
+}
+
+void test3() {
+	// No server on the port.
+	net::Network network;
+	net::Scheduler scheduler(network);
+	bool failed = false;
+	connect(scheduler, 12477, failed);
+	assert(run({&scheduler}, [&]() {
+		return failed;
+	}));
+	std::cout << "Test 3 succeeded, i.e. a failed connection resumed with null.\n";
+}
+
+net::Task first(net::Scheduler& scheduler, std::shared_ptr<net::Client>& sender) {
+	net::Message message = co_await scheduler.receive();
+	sender = message.sender_;
+}
+
+net::Task closing(net::Scheduler& scheduler, std::shared_ptr<net::Client> client, bool& closed) {
+	std::optional<net::Packet> packet = co_await scheduler.receive(client);
+	closed = !packet;
+}
+
+void test4() {
+	net::Network network1;
+	net::Scheduler scheduler1(network1);
+	std::shared_ptr<net::Server> server = network1.createServer(12478);
+	assert(server);
+	std::shared_ptr<net::Client> sender;
+	first(scheduler1, sender);
+	{
+		net::Network network2;
+		network2.connectToServer(12478, "localhost");
+		assert(run({&scheduler1}, [&]() {
+			return network2.getLocal()->getId() != 0;
+		}));
+		network2.getLocal()->sendToServer(net::Packet());
+		assert(run({&scheduler1}, [&]() {
+			return sender != nullptr;
+		}));
+	}
+	assert(run({&scheduler1}, [&]() {
+		return network1.getStats().connections_ == 0;
+	}));
+	scheduler1.poll(50);
+
+	// The disconnect is kept when awaiting any client.
+	std::shared_ptr<net::Client> other;
+	first(scheduler1, other);
+	bool closed = false;
+	closing(scheduler1, sender, closed);
+	assert(closed && !other);
+	std::cout << "Test 4 succeeded, i.e. a disconnect awaited after it happened.\n";
+}
+
+void test5() {
+	net::Network network1;
+	std::shared_ptr<net::Server> server;
+	int accepted = 0, closed = 0;
+	{
+		net::Network network2;
+		{
+			net::Scheduler scheduler1(network1);
+			server = network1.createServer(12479);
+			assert(server);
+			serve(scheduler1, *server, 2, accepted, closed);
+			network2.connectToServer(12479, "localhost");
+			assert(run({&scheduler1}, [&]() {
+				return accepted == 1;
+			}));
+		}
+		// The waiting coroutines are destroyed with the scheduler.
+	}
+	assert(waitFor([&]() {
+		network1.dispatchEvents();
+		return network1.getStats().connections_ == 0;
+	}));
+	network1.dispatchEvents();
+	assert(closed == 0);
+	std::cout << "Test 5 succeeded, i.e. a scheduler destroyed before its network.\n";
+}
+
+#ifdef NET_POSIX
+// A transport failing to start.
+class FailingTransport : public net::PosixTransport {
+public:
+	bool init() override {
+		return false;
+	}
+};
+#endif
+
+void test6() {
+#ifdef NET_POSIX
+	net::Network network(std::unique_ptr<net::Transport>(new FailingTransport()));
+	net::Scheduler scheduler(network);
+	bool failed = false;
+	// Resumed without polling.
+	connect(scheduler, 12480, failed);
+	assert(failed);
+#endif
+	std::cout << "Test 6 succeeded, i.e. a connection failing to start resumed with null.\n";
+}
+
+int main() {
+	test1();
+	test2();
+	test3();
+	test4();
+	test5();
+	test6();
+
+	std::cout << "All test succeeded!\n";
+	return 0;
+}
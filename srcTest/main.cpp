@@ -2,11 +2,48 @@
 #include "net/server.h"
 #include "net/client.h"
 #include "net/local.h"
+#include "net/ringbuffer.h"
+#include "net/sendqueue.h"
+#include "net/mpscqueue.h"
+#include "net/slotmap.h"
+#include "net/datagramqueue.h"
+#include "net/datagramconnection.h"
+#include "net/snapshot.h"
+#include "net/compressor.h"
+#include "net/interestgrid.h"
+#include "net/bufferpool.h"
+#include "net/messageregistry.h"
+#include "net/package.h"
+
+#include "net/simulatortransport.h"
+
+#ifdef NET_POSIX
+#include "net/posixtransport.h"
+#endif
 
 #include <string>
 #include <sstream>
 #include <cassert>
 #include <iostream>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <set>
+#include <cmath>
+#include <mutex>
+#include <atomic>
+
+// Wait until the condition is true. Return false on timeout.
+bool waitFor(const std::function<bool()>& condition) {
+	for (int i = 0; i < 5000; ++i) {
+		if (condition()) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
 
 
 void test1() {
@@ -133,7 +170,6 @@ void test3() {
 
 // Test the network server without remote connections.
 void test4() {
-	SDLNet_Init();
 	net::Network network;
 	std::shared_ptr<net::Server> server = network.createServer(12457);
 	
@@ -143,13 +179,11 @@ void test4() {
 	sendDataToServer(server, network);
 	receiveDataFromServer(server, network);
 	
-	SDLNet_Quit();
 	std::cout << "Test 4 succeeded, i.e. to send/receive data to/from a network server without remote connections.\n";
 }
 
 // Test the network server with remote connections.
 void test5() {
-	SDLNet_Init();
 	net::Network network1;
 	std::shared_ptr<net::Server> server = network1.createServer(12457);
 
@@ -159,16 +193,1529 @@ void test5() {
 	// Server valid.
 	assert(server);
 
-	SDLNet_Quit();
+	std::shared_ptr<net::Local> local = network2.getLocal();
+	assert(local);
+	// The id is assigned by the server.
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+
+	char data[] = {'a', 'b', 'c'};
+	local->sendToServer(net::Packet(data, sizeof(data)));
+
+	// Receives from the remote client.
+	net::Packet packet;
+	std::shared_ptr<net::Client> client;
+	assert(waitFor([&]() {
+		client = server->pullReceiveData(packet);
+		return client != nullptr;
+	}));
+	assert(client->getId() == local->getId());
+	assert(packet.size() == sizeof(data));
+	for (int i = 0; i < packet.size(); ++i) {
+		assert(packet[i] == data[i]);
+	}
+
+	char data2[] = {'d', 'e'};
+	server->sendToAll(net::Packet(data2, sizeof(data2)));
+
+	// Receives from the server.
+	packet = net::Packet();
+	assert(waitFor([&]() {
+		return local->pullReceiveDataFromServer(packet);
+	}));
+	assert(packet.size() == sizeof(data2));
+	for (int i = 0; i < packet.size(); ++i) {
+		assert(packet[i] == data2[i]);
+	}
+
+	// Data sent from the local client on the server side to all other clients.
+	network1.getLocal()->sendToAll(net::Packet(data, sizeof(data)));
+	packet = net::Packet();
+	assert(waitFor([&]() {
+		return local->pullReceiveData(packet);
+	}));
+	assert(packet.size() == sizeof(data));
+
 	std::cout << "Test 5 succeeded, i.e. to send/receive data to/from a network server with remote connections.\n";
 }
 
+// Test the ring buffer used for all package queues.
+void test6() {
+	net::RingBuffer buffer;
+	char data[] = {'a', 'b', 'c', 'd', 'e'};
+	buffer.append(data, sizeof(data));
+	int capacity = buffer.capacity();
+
+	// Push and pop many times, the data must wrap around without allocating more memory.
+	for (int i = 0; i < 1000; ++i) {
+		buffer.append(data, sizeof(data));
+		assert(buffer.size() == 2 * sizeof(data));
+		char copy[sizeof(data)];
+		buffer.copy(sizeof(data), copy, sizeof(data));
+		for (int j = 0; j < (int) sizeof(data); ++j) {
+			assert(buffer[j] == data[j]);
+			assert(copy[j] == data[j]);
+		}
+		buffer.pop_front(sizeof(data));
+	}
+	assert(buffer.capacity() == capacity);
+
+	// Grows when full, the data must be the same.
+	net::RingBuffer other;
+	other.append(buffer, 0, buffer.size());
+	for (int i = 0; i < 100; ++i) {
+		other.push_back(i);
+	}
+	assert(other.size() == sizeof(data) + 100);
+	assert(other.capacity() > capacity);
+	for (int i = 0; i < 100; ++i) {
+		assert(other[sizeof(data) + i] == i);
+	}
+	std::cout << "Test 6 succeeded, i.e. the ring buffer wraps around and grows.\n";
+}
+
+// Test to send packets bigger than the inline packet size.
+void test7() {
+	net::Packet packet;
+	for (int i = 0; i < 1000; ++i) {
+		packet << (char) i;
+	}
+	assert(packet.size() == 1000);
+	assert(packet.capacity() >= 1000);
+	for (int i = 0; i < 1000; ++i) {
+		assert(packet[i] == (char) i);
+	}
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12458);
+	assert(server);
+	net::Network network2;
+	network2.connectToServer(12458, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+
+	// Packets bigger than the max packet size would disconnect the client.
+	net::Packet big;
+	for (int i = 0; i < 20000; ++i) {
+		big << (char) (i * 7);
+	}
+	local->sendToServer(big);
+	server->sendToAll(big);
+
+	net::Packet received;
+	assert(waitFor([&]() {
+		return server->pullReceiveData(received) != nullptr;
+	}));
+	assert(received.size() == big.size());
+	for (int i = 0; i < big.size(); ++i) {
+		assert(received[i] == big[i]);
+	}
+
+	received = net::Packet();
+	assert(waitFor([&]() {
+		return local->pullReceiveDataFromServer(received);
+	}));
+	assert(received.size() == big.size());
+	for (int i = 0; i < big.size(); ++i) {
+		assert(received[i] == big[i]);
+	}
+	std::cout << "Test 7 succeeded, i.e. to send/receive packets bigger than 127 bytes.\n";
+}
+
+// Test that a payload queued to many send queues is shared and released when sent.
+void test8() {
+	net::Payload payload(std::vector<char>{'a', 'b', 'c'});
+	net::SendQueue queue1;
+	net::SendQueue queue2;
+	queue1.push(payload);
+	queue2.push(payload);
+	assert(payload.useCount() == 3);
+	assert(queue1.data() == queue2.data());
+
+	// Partially sent.
+	queue1.pop(1);
+	assert(queue1.size() == 2 && queue1.contiguousSize() == 2);
+	assert(*queue1.data() == 'b');
+	assert(payload.useCount() == 3);
+
+	// Released when all is sent.
+	queue1.pop(2);
+	assert(queue1.empty());
+	assert(payload.useCount() == 2);
+	queue2.clear();
+	assert(payload.useCount() == 1);
+	std::cout << "Test 8 succeeded, i.e. a payload is shared between send queues.\n";
+}
+
+// Test the lock-free queue between the game thread and the network threads.
+void test9() {
+	const int SIZE = 100000;
+	net::MpscQueue<int> mpsc;
+	std::thread producer1([&]() {
+		for (int i = 0; i < SIZE; ++i) {
+			mpsc.push(i * 2);
+		}
+	});
+	std::thread producer2([&]() {
+		for (int i = 0; i < SIZE; ++i) {
+			mpsc.push(i * 2 + 1);
+		}
+	});
+	// Values from each producer must arrive in order.
+	int next[2] = {0, 1};
+	for (int i = 0; i < 2 * SIZE;) {
+		int value;
+		if (mpsc.pop(value)) {
+			assert(value == next[value % 2]);
+			next[value % 2] += 2;
+			++i;
+		}
+	}
+	producer1.join();
+	producer2.join();
+	int value;
+	assert(!mpsc.pop(value));
+	std::cout << "Test 9 succeeded, i.e. the lock-free queue between threads.\n";
+}
+
+void test10() {
+	const int SIZE = 100000;
+	net::MpscQueue<int> queue;
+	std::thread producer([&]() {
+		for (int i = 0; i < SIZE; ++i) {
+			queue.push(std::move(i));
+		}
+	});
+	// Values must arrive in order, in batches.
+	int next = 0;
+	while (next < SIZE) {
+		int before = next;
+		int nbr = queue.popAll([&](int value) {
+			assert(value == next);
+			++next;
+		});
+		assert(nbr == next - before);
+	}
+	producer.join();
+	assert(queue.popAll([](int) {}) == 0);
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12459);
+	net::Network network2;
+	network2.connectToServer(12459, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+
+	const int PACKETS = 500;
+	for (int i = 0; i < PACKETS; ++i) {
+		net::Packet packet;
+		packet << (char) i;
+		local->sendToServer(packet);
+	}
+	int nbr = 0;
+	assert(waitFor([&]() {
+		server->pullAll([&](const std::shared_ptr<net::Client>& client, net::Packet& packet) {
+			assert(client->getId() == local->getId());
+			assert(packet.size() == 1 && packet[0] == (char) nbr);
+			++nbr;
+		});
+		return nbr == PACKETS;
+	}));
+
+	for (int i = 0; i < PACKETS; ++i) {
+		net::Packet packet;
+		packet << (char) i;
+		server->sendToAll(packet);
+	}
+	nbr = 0;
+	assert(waitFor([&]() {
+		local->pullAllFromServer([&](net::Packet& packet) {
+			assert(packet.size() == 1 && packet[0] == (char) nbr);
+			++nbr;
+		});
+		return nbr == PACKETS;
+	}));
+
+	std::cout << "Test 10 succeeded, i.e. to pull all received packets in one call.\n";
+}
+
+void test11() {
+	net::SendQueue queue;
+	queue.push(net::Payload(std::vector<char>{'a', 'b', 'c'}));
+	queue.push(net::Payload(std::vector<char>{'d', 'e'}));
+	queue.pop(1);
+	// One segment per payload, starting at the first byte not sent.
+	net::Segment segments[4];
+	assert(queue.segments(segments, 4) == 2);
+	assert(segments[0].size_ == 2 && *segments[0].data_ == 'b');
+	assert(segments[1].size_ == 2 && *segments[1].data_ == 'd');
+	assert(queue.segments(segments, 1) == 1);
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12460);
+	net::Network network2;
+	network2.connectToServer(12460, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+
+	const int PACKETS = 1000;
+	for (int i = 0; i < PACKETS; ++i) {
+		net::Packet packet;
+		packet << (char) i;
+		local->sendToServer(packet);
+	}
+	int nbr = 0;
+	assert(waitFor([&]() {
+		nbr += server->pullAll([](const std::shared_ptr<net::Client>&, net::Packet&) {});
+		return nbr == PACKETS;
+	}));
+	// Every package is either sent by its own call or coalesced with others.
+	assert(network2.getSendCalls() <= PACKETS);
+	assert(network2.getSendCalls() + network2.getSavedSendCalls() >= PACKETS);
+
+	std::cout << "Test 11 succeeded, i.e. queued packages are sent with one call, " << network2.getSavedSendCalls() << " calls saved.\n";
+}
+
+void test12() {
+	net::SendQueue queue;
+	for (char c = 'a'; c < 'f'; ++c) {
+		queue.push(net::Payload(std::vector<char>(10, c)));
+	}
+	queue.pop(5);
+	// The partially sent payload is kept.
+	assert(queue.dropOldest(25) == 20 && queue.size() == 25);
+	assert(*queue.data() == 'a');
+	assert(queue.keepLatest() == 10 && queue.size() == 15);
+	queue.pop(5);
+	assert(*queue.data() == 'e');
+
+#ifdef NET_POSIX
+	const int PACKET_SIZE = 60000;
+	const int PACKETS = 200;
+	net::Packet packet;
+	packet.resize(PACKET_SIZE);
+
+	net::Network::SlowClientPolicy policies[] = {net::Network::DROP_OLDEST, net::Network::DISCONNECT};
+	for (net::Network::SlowClientPolicy policy : policies) {
+		net::Network network;
+		network.setSendQueueLimit(256 * 1024, 64 * 1024, policy);
+		std::shared_ptr<net::Server> server = network.createServer(12461);
+
+		// A client never reading any data.
+		net::PosixTransport transport;
+		assert(transport.init());
+		net::Socket socket = transport.connect("localhost", 12461);
+		assert(socket != net::Transport::NO_SOCKET);
+
+		for (int i = 0; i < PACKETS; ++i) {
+			server->sendToAll(packet);
+		}
+		net::SlowClientEvent event;
+		assert(waitFor([&]() {
+			return server->pullSlowClientEvent(event);
+		}));
+		assert(event.client_ && event.size_ > 0);
+		if (policy == net::Network::DROP_OLDEST) {
+			assert(event.type_ == net::SlowClientEvent::DROPPED);
+		} else {
+			assert(event.type_ == net::SlowClientEvent::DISCONNECTED);
+		}
+	}
+#endif
+
+	std::cout << "Test 12 succeeded, i.e. the send queue of a slow client is limited.\n";
+}
+
+void test13() {
+	const int CLIENTS = 6;
+	// Four threads sharing the connections.
+	net::Network network(4);
+	std::shared_ptr<net::Server> server = network.createServer(12462);
+	assert(server);
+
+	std::vector<std::unique_ptr<net::Network>> networks;
+	for (int i = 0; i < CLIENTS; ++i) {
+		networks.push_back(std::unique_ptr<net::Network>(new net::Network()));
+		networks.back()->connectToServer(12462, "localhost");
+	}
+	for (auto& client : networks) {
+		std::shared_ptr<net::Local> local = client->getLocal();
+		assert(waitFor([&]() {
+			return local->getId() != 0;
+		}));
+		local->sendToServer(net::Packet());
+	}
+
+	// One merged stream from all threads.
+	std::set<int> ids;
+	assert(waitFor([&]() {
+		net::Packet packet;
+		while (std::shared_ptr<net::Client> client = server->pullReceiveData(packet)) {
+			assert(ids.insert(client->getId()).second);
+		}
+		return ids.size() == CLIENTS;
+	}));
+	for (auto& client : networks) {
+		assert(ids.count(client->getLocal()->getId()) == 1);
+	}
+
+	// Relayed to the clients owned by the other threads.
+	net::Packet packet;
+	packet << 'r';
+	networks[0]->getLocal()->sendToAll(packet);
+	server->sendToAll(packet);
+	for (int i = 1; i < CLIENTS; ++i) {
+		std::shared_ptr<net::Local> local = networks[i]->getLocal();
+		assert(waitFor([&]() {
+			return local->pullReceiveData(packet);
+		}));
+		assert(waitFor([&]() {
+			return local->pullReceiveDataFromServer(packet);
+		}));
+	}
+
+	std::cout << "Test 13 succeeded, i.e. a server with many network threads.\n";
+}
+
+void test14() {
+	net::SlotMap<int> map;
+	int id1 = map.insert(1);
+	int id2 = map.insert(2);
+	int id3 = map.insert(3);
+	assert(id1 > 0xffff && id1 != id2 && id2 != id3);
+	assert(*map.find(id2) == 2);
+
+	// The last value takes the place of the erased one.
+	map.erase(id1);
+	assert(map.size() == 2 && map[0] == 3 && map.getId(0) == id3);
+	assert(map.find(id1) == nullptr && *map.find(id3) == 3);
+
+	// The slot is reused with a new id.
+	int id4 = map.insert(4);
+	assert(id4 != id1 && (id4 & 0xffff) == (id1 & 0xffff));
+	assert(map.find(id1) == nullptr && *map.find(id4) == 4);
+
+	// Interleaved slots.
+	net::SlotMap<int> map1(2, 1);
+	assert((map1.insert(1) & 0xffff) == 1 && (map1.insert(2) & 0xffff) == 3);
+	assert(map1.find(id1) == nullptr);
+
+	// More clients than the old limit of 8.
+	const int CLIENTS = 50;
+	net::Network network;
+	std::shared_ptr<net::Server> server = network.createServer(12463);
+	std::vector<std::unique_ptr<net::Network>> networks;
+	for (int i = 0; i < CLIENTS; ++i) {
+		networks.push_back(std::unique_ptr<net::Network>(new net::Network()));
+		networks.back()->connectToServer(12463, "localhost");
+	}
+	std::set<int> ids;
+	for (auto& client : networks) {
+		std::shared_ptr<net::Local> local = client->getLocal();
+		assert(waitFor([&]() {
+			return local->getId() != 0;
+		}));
+		ids.insert(local->getId());
+	}
+	assert(ids.size() == CLIENTS);
+
+	// A reconnecting client gets a new id.
+	int id = networks[0]->getLocal()->getId();
+	networks[0].reset(new net::Network());
+	networks[0]->connectToServer(12463, "localhost");
+	std::shared_ptr<net::Local> local = networks[0]->getLocal();
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+	assert(local->getId() != id && ids.count(local->getId()) == 0);
+
+	// Sent to the receiver found by id.
+	server->sendToAll(net::Packet());
+	local->sendToServer(net::Packet());
+	std::shared_ptr<net::Client> client;
+	net::Packet packet;
+	assert(waitFor([&]() {
+		client = server->pullReceiveData(packet);
+		return client != nullptr;
+	}));
+	assert(client->getId() == local->getId());
+	server->sendTo(client, packet);
+	assert(waitFor([&]() {
+		return local->pullReceiveDataFromServer(packet);
+	}));
+	assert(waitFor([&]() {
+		return local->pullReceiveDataFromServer(packet);
+	}));
+
+	std::cout << "Test 14 succeeded, i.e. the client table with recycled ids.\n";
+}
+
+void test15() {
+	net::DatagramQueue queue(20);
+	char header[] = {'h', 'h'};
+	queue.setHeader(header, sizeof(header));
+	char data[10] = {};
+	// Packages are batched until the datagram is full.
+	assert(queue.push(data, 8) && queue.push(data, 8) && queue.size() == 1);
+	assert(queue.push(data, 8) && queue.size() == 2);
+	assert(!queue.push(data, 19));
+	net::Datagram datagrams[2];
+	queue.fill(datagrams, net::Address());
+	assert(datagrams[0].size_ == 18 && datagrams[1].size_ == 10);
+	assert(datagrams[1].data_[0] == 'h' && datagrams[1].data_ == datagrams[0].data_ + 18);
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12464);
+	net::Network network2;
+	network2.connectToServer(12464, "localhost");
+	net::Network network3;
+	network3.connectToServer(12464, "localhost");
+	std::shared_ptr<net::Local> local2 = network2.getLocal();
+	std::shared_ptr<net::Local> local3 = network3.getLocal();
+	// The packets sent before the handshake are streamed.
+	assert(waitFor([&]() {
+		return local2->getId() != 0;
+	}));
+
+	// Sent until received, datagrams may be lost.
+	net::Packet packet;
+	packet << 'u';
+	std::shared_ptr<net::Client> client;
+	assert(waitFor([&]() {
+		local2->sendToServerUnreliable(packet);
+		client = server->pullReceiveData(packet);
+		return client != nullptr;
+	}));
+	assert(client->getId() == local2->getId() && packet.size() == 1 && packet[0] == 'u');
+	assert(waitFor([&]() {
+		server->sendToUnreliable(client, packet);
+		return local2->pullReceiveDataFromServer(packet);
+	}));
+	assert(waitFor([&]() {
+		server->sendToAllUnreliable(packet);
+		return local3->pullReceiveDataFromServer(packet);
+	}));
+
+	// Relayed to the other clients.
+	assert(waitFor([&]() {
+		local2->sendToAllUnreliable(packet);
+		return local3->pullReceiveData(packet);
+	}));
+
+	// Too big for a datagram, sent reliable.
+	net::Packet big;
+	big.resize(10000);
+	big.getData()[9999] = 'b';
+	local3->sendToServerUnreliable(big);
+	assert(waitFor([&]() {
+		return server->pullReceiveData(packet) != nullptr && packet.size() == 10000;
+	}));
+	assert(packet[9999] == 'b');
+
+	std::cout << "Test 15 succeeded, i.e. to send/receive unreliable datagrams.\n";
+}
+
+// Write the datagrams of the sender and read them by the receiver. Return false if any is invalid.
+bool transfer(net::DatagramConnection& sender, net::DatagramConnection& receiver, const net::DatagramConnection::Receiver& function) {
+	auto time = std::chrono::steady_clock::now();
+	net::DatagramQueue datagrams(1200);
+	sender.write(datagrams, time);
+	std::vector<net::Datagram> sent(datagrams.size());
+	datagrams.fill(sent.data(), net::Address());
+	bool valid = true;
+	for (const net::Datagram& datagram : sent) {
+		net::RingBuffer buffer;
+		buffer.append(datagram.data_, datagram.size_);
+		valid = receiver.read(buffer, time, function) && valid;
+	}
+	return valid;
+}
+
+void test16() {
+#ifdef NET_POSIX
+	// A fifth of the datagrams are lost, the rest are reordered.
+	net::Network network1(std::unique_ptr<net::Transport>(new net::SimulatorTransport(std::unique_ptr<net::Transport>(new net::PosixTransport()), 0.2, 5, 10)));
+	std::shared_ptr<net::Server> server = network1.createServer(12465);
+	net::Network network2(std::unique_ptr<net::Transport>(new net::SimulatorTransport(std::unique_ptr<net::Transport>(new net::PosixTransport()), 0.2, 5, 10)));
+	network2.connectToServer(12465, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+
+	// Wait for the datagram address to be known, earlier packets are streamed.
+	net::Packet packet;
+	std::shared_ptr<net::Client> client;
+	assert(waitFor([&]() {
+		packet.clear();
+		packet << 'u';
+		local->sendToServerUnreliable(packet);
+		client = server->pullReceiveData(packet);
+		return client != nullptr;
+	}));
+	while (server->pullReceiveData(packet) != nullptr);
+
+	// Channel 0 is ordered, channel 1 is not and both are reliable.
+	const int nbr = 300;
+	for (int i = 0; i < nbr; ++i) {
+		packet.clear();
+		packet << 'o' << (char) (i & 0xff) << (char) (i >> 8);
+		local->sendToServer(packet, net::RELIABLE_ORDERED, 0);
+		packet.clear();
+		packet << 'r' << (char) (i & 0xff) << (char) (i >> 8);
+		local->sendToServer(packet, net::RELIABLE, 1);
+	}
+	int ordered = 0;
+	std::set<int> unordered;
+	assert(waitFor([&]() {
+		server->pullAll([&](const std::shared_ptr<net::Client>&, net::Packet& packet) {
+			if (packet.size() != 3) {
+				// A late unreliable packet.
+				return;
+			}
+			int i = (unsigned char) packet[1] | (unsigned char) packet[2] << 8;
+			if (packet[0] == 'o') {
+				assert(i == ordered);
+				++ordered;
+			} else {
+				assert(packet[0] == 'r' && unordered.count(i) == 0);
+				unordered.insert(i);
+			}
+		});
+		return ordered == nbr && (int) unordered.size() == nbr;
+	}));
+
+	// From the server to the client.
+	for (int i = 0; i < nbr; ++i) {
+		packet.clear();
+		packet << (char) (i & 0xff) << (char) (i >> 8);
+		server->sendTo(client, packet, net::RELIABLE_ORDERED, 2);
+	}
+	ordered = 0;
+	assert(waitFor([&]() {
+		local->pullAllFromServer([&](net::Packet& packet) {
+			if (packet.size() == 2) {
+				assert(((unsigned char) packet[0] | (unsigned char) packet[1] << 8) == ordered);
+				++ordered;
+			}
+		});
+		return ordered == nbr;
+	}));
+
+	// Too big for a datagram, sent as fragments in order with the small packets.
+	for (int i = 0; i < 10; ++i) {
+		packet.clear();
+		packet.resize(i % 2 == 0 ? 3 : 5000);
+		packet.getData()[0] = 'f';
+		packet.getData()[1] = (char) i;
+		local->sendToServer(packet, net::RELIABLE_ORDERED, 3);
+	}
+	ordered = 0;
+	assert(waitFor([&]() {
+		server->pullAll([&](const std::shared_ptr<net::Client>&, net::Packet& packet) {
+			if (packet.size() > 1 && packet[0] == 'f') {
+				assert(packet[1] == ordered && packet.size() == (ordered % 2 == 0 ? 3 : 5000));
+				++ordered;
+			}
+		});
+		return ordered == 10;
+	}));
+
+	// The reliable packages not acked are limited on each channel, later ones wait.
+	net::DatagramConnection connection(100), remote(100);
+	const char data[] = {'s', 's', 's', 's', 's'};
+	net::Payload small = net::createPackage(1, data, sizeof(data));
+	for (int i = 0; i <= net::DatagramConnection::MAX_MESSAGES; ++i) {
+		assert(connection.push(small, net::RELIABLE_ORDERED, 0));
+	}
+	assert(connection.getQueuedSize() == (net::DatagramConnection::MAX_MESSAGES + 1) * 10);
+	int received = 0;
+	for (int i = 0; i < 100 && connection.hasUnacked(); ++i) {
+		assert(transfer(connection, remote, [&](const char*, int size, net::Delivery, int) {
+			++received;
+			return size == small.size();
+		}));
+		assert(transfer(remote, connection, [](const char*, int, net::Delivery, int) {
+			return false;
+		}));
+	}
+	assert(received == net::DatagramConnection::MAX_MESSAGES + 1 && connection.getQueuedSize() == 0);
+
+	// The fragments are assembled on the channel, up to the max size.
+	std::vector<char> bigData(500, 'b');
+	net::Payload big = net::createPackage(1, bigData.data(), bigData.size());
+	assert(connection.push(big, net::RELIABLE_ORDERED, 5) && !connection.push(big, net::RELIABLE, 5));
+	remote.setMaxFragmentedSize(big.size());
+	received = 0;
+	assert(transfer(connection, remote, [&](const char* data, int size, net::Delivery delivery, int channel) {
+		assert(size == big.size() && std::equal(data, data + size, big.data()));
+		assert(delivery == net::RELIABLE_ORDERED && channel == 5);
+		++received;
+		return true;
+	}) && received == 1);
+	remote.setMaxFragmentedSize(big.size() - 1);
+	assert(connection.push(big, net::RELIABLE_ORDERED, 5));
+	assert(!transfer(connection, remote, [](const char*, int, net::Delivery, int) {
+		return true;
+	}));
+
+	// A package rejected by the receiver makes the datagram invalid.
+	net::DatagramConnection sender(100), receiver(100);
+	assert(sender.push(net::createPackage(1, small.data(), small.size()), net::RELIABLE, 0));
+	assert(!transfer(sender, receiver, [](const char*, int, net::Delivery, int) {
+		return false;
+	}));
+
+	// A client never acking, i.e. without a datagram socket, exceeds the send
+	// queue limit. The reliable packages are not dropped.
+	net::Network network3;
+	network3.setSendQueueLimit(64 * 1024, 16 * 1024, net::Network::DROP_OLDEST);
+	std::shared_ptr<net::Server> server3 = network3.createServer(12481);
+	net::PosixTransport transport;
+	assert(transport.init());
+	net::Socket socket = transport.connect("localhost", 12481);
+	assert(socket != net::Transport::NO_SOCKET);
+	packet.resize(1000);
+	net::SlowClientEvent event;
+	assert(waitFor([&]() {
+		server3->sendToAll(packet, net::RELIABLE);
+		return server3->pullSlowClientEvent(event);
+	}));
+	assert(event.type_ == net::SlowClientEvent::DISCONNECTED && event.size_ > 64 * 1024);
+
+	std::cout << "Test 16 succeeded, i.e. reliable datagrams over a lossy network.\n";
+#endif
+}
+
+void test17() {
+	std::vector<char> baseline(1000, 'a');
+	std::vector<char> state = baseline;
+	state[10] = 'b';
+	state[500] = 'c';
+	state.push_back('d');
+	std::vector<char> delta;
+	net::encodeDelta(state.data(), state.size(), baseline.data(), baseline.size(), delta);
+	assert(delta.size() < 20);
+	net::Packet packet;
+	assert(net::decodeDelta(delta.data(), delta.size(), baseline.data(), baseline.size(), 2000, packet));
+	assert(packet.size() == (int) state.size() && std::equal(state.begin(), state.end(), packet.getData()));
+	// Without a baseline.
+	delta.clear();
+	net::encodeDelta(state.data(), state.size(), nullptr, 0, delta);
+	assert(net::decodeDelta(delta.data(), delta.size(), nullptr, 0, 2000, packet));
+	assert(std::equal(state.begin(), state.end(), packet.getData()));
+	assert(!net::decodeDelta(delta.data(), delta.size() - 1, nullptr, 0, 2000, packet));
+	assert(!net::decodeDelta(delta.data(), delta.size(), nullptr, 0, 100, packet));
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12466);
+	net::Network network2;
+	network2.connectToServer(12466, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+
+	// Sent each tick until received, the state changes a little every time.
+	net::Packet snapshot;
+	snapshot.append(state.data(), state.size());
+	int received = 0;
+	assert(waitFor([&]() {
+		snapshot.getData()[received % 1000] = (char) received;
+		server->sendSnapshot(snapshot);
+		if (local->pullSnapshot(packet)) {
+			assert(packet.size() == snapshot.size());
+			++received;
+		}
+		return received == 20;
+	}));
+	// The latest state is reconstructed.
+	assert(waitFor([&]() {
+		server->sendSnapshot(snapshot);
+		return local->pullSnapshot(packet) && std::equal(packet.getData(), packet.getData() + packet.size(), snapshot.getData());
+	}));
+
+	// The local client of the server gets the whole snapshot.
+	assert(network1.getLocal()->pullSnapshot(packet) && packet.size() == snapshot.size());
+
+	std::cout << "Test 17 succeeded, i.e. delta compressed snapshots.\n";
+}
+
+void test18() {
+	std::string text;
+	for (int i = 0; i < 50; ++i) {
+		text += "chat message number " + std::to_string(i) + ", ";
+	}
+	net::Compressor compressor(64);
+	std::vector<char> frame;
+	compressor.compress(text.data(), text.size(), frame);
+	assert(frame[0] == net::Compressor::COMPRESSED && (int) frame.size() < (int) text.size() / 2);
+	net::Packet packet;
+	assert(compressor.decompress(frame.data(), frame.size(), 10000, packet));
+	assert(std::string(packet.getData(), packet.size()) == text);
+	assert(!compressor.decompress(frame.data(), frame.size(), 100, packet));
+	assert(!compressor.decompress(frame.data(), frame.size() - 1, 10000, packet));
+
+	// Below the threshold.
+	frame.clear();
+	compressor.compress(text.data(), 63, frame);
+	assert(frame[0] == 0 && frame.size() == 64);
+	assert(compressor.decompress(frame.data(), frame.size(), 10000, packet) && std::string(packet.getData(), packet.size()) == text.substr(0, 63));
+	assert(compressor.getStats().packets_ == 2 && compressor.getStats().compressed_ == 1);
+
+	// A short message only gets smaller with the dictionary.
+	std::string message = "{\"type\": \"position\", \"x\": 1, \"y\": 2}";
+	std::string common = "{\"type\": \"position\", \"x\": , \"y\": }";
+	net::Compressor dictionaryCompressor(0, std::vector<char>(common.begin(), common.end()));
+	frame.clear();
+	dictionaryCompressor.compress(message.data(), message.size(), frame);
+	assert(frame[0] == (net::Compressor::COMPRESSED | net::Compressor::DICTIONARY) && frame.size() < message.size() / 2);
+	assert(dictionaryCompressor.decompress(frame.data(), frame.size(), 1000, packet));
+	assert(std::string(packet.getData(), packet.size()) == message);
+	assert(!compressor.decompress(frame.data(), frame.size(), 1000, packet));
+
+	net::Network network1;
+	network1.setCompression(64);
+	network1.setCompressed(net::STREAM, 0, true);
+	std::shared_ptr<net::Server> server = network1.createServer(12467);
+	net::Network network2;
+	network2.setCompression(64);
+	network2.setCompressed(net::STREAM, 0, true);
+	network2.connectToServer(12467, "localhost");
+	net::Network network3;
+	network3.setCompression(64);
+	network3.connectToServer(12467, "localhost");
+	std::shared_ptr<net::Local> local2 = network2.getLocal();
+	std::shared_ptr<net::Local> local3 = network3.getLocal();
+	assert(waitFor([&]() {
+		return local2->getId() != 0 && local3->getId() != 0;
+	}));
+
+	net::Packet big(text.data(), text.size());
+	local2->sendToServer(big);
+	local2->sendToAll(big);
+	assert(waitFor([&]() {
+		return server->pullReceiveData(packet) != nullptr;
+	}));
+	assert(std::string(packet.getData(), packet.size()) == text);
+	// Relayed still compressed, decompressed by the receiver.
+	assert(waitFor([&]() {
+		return local3->pullReceiveData(packet);
+	}));
+	assert(std::string(packet.getData(), packet.size()) == text);
+	server->sendToAll(big);
+	assert(waitFor([&]() {
+		return local3->pullReceiveDataFromServer(packet);
+	}));
+	assert(std::string(packet.getData(), packet.size()) == text);
+
+	net::CompressionStats stats = network2.getCompressionStats();
+	assert(stats.compressed_ == 2 && stats.getRatio() < 0.5 && stats.compressTime_ > 0);
+	assert(network3.getCompressionStats().decompressTime_ > 0);
+
+	// Not the same setting as the server.
+	net::Network network4;
+	network4.connectToServer(12467, "localhost");
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	assert(network4.getLocal()->getId() == 0);
+
+	std::cout << "Test 18 succeeded, i.e. compressed packets.\n";
+}
+
+enum class Weapon : uint16_t {
+	SWORD = 1,
+	BOW = 0x0102
+};
+
+struct Position {
+	float x_;
+	float y_;
+};
+
+void test19() {
+	net::Packet packet;
+	packet.write((int32_t) -2).write((uint16_t) 0x0102).write(1.5).write(Weapon::BOW);
+	// Little-endian.
+	assert(packet.size() == 16 && packet[0] == (char) 0xfe && packet[4] == 0x02 && packet[5] == 0x01);
+	std::array<int32_t, 3> array = {{1, 2, 3}};
+	int16_t values[2] = {-1, 7};
+	Position position = {1.f, -2.f};
+	packet.write(array).write(values).write(position);
+
+	int32_t i = 0;
+	uint16_t u = 0;
+	double d = 0;
+	Weapon weapon = Weapon::SWORD;
+	assert(packet.read(i) && i == -2 && packet.read(u) && u == 0x0102);
+	assert(packet.read(d) && d == 1.5 && packet.read(weapon) && weapon == Weapon::BOW);
+	std::array<int32_t, 3> readArray;
+	int16_t readValues[2];
+	Position readPosition;
+	assert(packet.read(readArray) && readArray == array);
+	assert(packet.read(readValues) && readValues[0] == -1 && readValues[1] == 7);
+	assert(packet.read(readPosition) && readPosition.x_ == 1.f && readPosition.y_ == -2.f);
+	assert(packet.dataLeftToRead() == 0 && !packet.failed());
+
+	// Never reads past the end.
+	assert(!packet.read(i) && i == -2 && packet.failed());
+	char byte = 'x';
+	packet >> byte;
+	assert(byte == 'x');
+	packet.clear();
+	assert(!packet.failed());
+	packet.write((char) 1);
+	assert(!packet.read(u) && packet.dataLeftToRead() == 1);
+
+	packet.clear();
+	packet.writeVarint(127).writeVarint(300).writeSignedVarint(-1).writeSignedVarint(-1000000000000ll);
+	assert(packet.size() == 1 + 2 + 1 + 6);
+	uint64_t varint;
+	int64_t signedVarint;
+	assert(packet.readVarint(varint) && varint == 127 && packet.readVarint(varint) && varint == 300);
+	assert(packet.readSignedVarint(signedVarint) && signedVarint == -1);
+	assert(packet.readSignedVarint(signedVarint) && signedVarint == -1000000000000ll);
+	packet.clear();
+	packet << (char) 0x80;
+	assert(!packet.readVarint(varint) && packet.dataLeftToRead() == 1);
+
+	packet.clear();
+	packet.writeQuantized(0.3f, -1.f, 1.f, 12).writeQuantized(5.f, 0.f, 1.f, 8);
+	assert(packet.size() == 3);
+	float f;
+	assert(packet.readQuantized(f, -1.f, 1.f, 12) && std::abs(f - 0.3f) <= 1.f / 4095);
+	assert(packet.readQuantized(f, 0.f, 1.f, 8) && f == 1.f);
+
+	std::cout << "Test 19 succeeded, i.e. typed packet serialization.\n";
+}
+
+void test20() {
+	assert(net::LatencyHistogram::getBucket(500) == 0 && net::LatencyHistogram::getBucket(1000) == 1);
+	assert(net::LatencyHistogram::getBucket(3999) == 2 && net::LatencyHistogram::getBucket(4000) == 3);
+	assert(net::LatencyHistogram::getBucket(1LL << 50) == net::LatencyHistogram::BUCKETS - 1);
+
+	net::Network network1;
+	std::mutex mutex;
+	std::string dump;
+	network1.setStatsDump(10, [&](const std::string& text) {
+		std::lock_guard<std::mutex> lock(mutex);
+		dump = text;
+	});
+	std::shared_ptr<net::Server> server = network1.createServer(12468);
+	assert(server);
+	std::shared_ptr<net::Client> remote;
+	{
+		net::Network network2;
+		network2.connectToServer(12468, "localhost");
+		std::shared_ptr<net::Local> local = network2.getLocal();
+		assert(waitFor([&]() {
+			return local->getId() != 0;
+		}));
+
+		const int nbr = 100;
+		char data[] = {'a', 'b', 'c'};
+		for (int i = 0; i < nbr; ++i) {
+			local->sendToServer(net::Packet(data, sizeof(data)));
+		}
+		int received = 0;
+		net::Packet packet;
+		assert(waitFor([&]() {
+			while (std::shared_ptr<net::Client> sender = server->pullReceiveData(packet)) {
+				remote = sender;
+				++received;
+			}
+			return received == nbr;
+		}));
+		for (int i = 0; i < nbr; ++i) {
+			server->sendTo(remote, net::Packet(data, sizeof(data)));
+		}
+		received = 0;
+		assert(waitFor([&]() {
+			while (local->pullReceiveDataFromServer(packet)) {
+				++received;
+			}
+			return received == nbr;
+		}));
+
+		// Counted by the network threads after the send calls.
+		assert(waitFor([&]() {
+			return remote->getStats().packagesSent_ == nbr + 1 && local->getStats().packagesSent_ == nbr;
+		}));
+		// Each package is the size varint, the id and the data, the bytes include the datagrams.
+		net::ConnectionStats remoteStats = remote->getStats();
+		assert(remoteStats.packagesReceived_ == nbr && remoteStats.bytesReceived_ >= nbr * 8);
+		assert(remoteStats.packagesSent_ == nbr + 1 && remoteStats.sendQueueSize_ == 0);
+		net::ConnectionStats localStats = local->getStats();
+		assert(localStats.packagesSent_ == nbr && localStats.bytesSent_ >= nbr * 8);
+		assert(localStats.packagesReceived_ == nbr && localStats.receiveCalls_ > 0);
+
+		net::NetworkStats stats = network1.getStats();
+		assert(stats.accepted_ == 1 && stats.connections_ == 1 && stats.disconnected_ == 0);
+		assert(stats.packagesReceived_ == nbr && stats.packagesSent_ == nbr + 1 && stats.sendCalls_ > 0);
+		// Including the handshake.
+		assert(stats.sendLatency_.count_ == nbr + 1 && stats.sendLatency_.getPercentile(0.99) != 0);
+		assert(waitFor([&]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return dump.find("net_connections 1\n") != std::string::npos;
+		}));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			assert(dump.find("# TYPE net_send_latency_microseconds histogram\n") != std::string::npos);
+			assert(dump.find("net_send_latency_microseconds_bucket{le=\"+Inf\"}") != std::string::npos);
+		}
+
+		// The gauges are kept.
+		network1.resetStats();
+		remote->resetStats();
+		stats = network1.getStats();
+		assert(stats.accepted_ == 0 && stats.packagesSent_ == 0 && stats.sendLatency_.count_ == 0 && stats.connections_ == 1);
+		assert(remote->getStats().packagesReceived_ == 0);
+	}
+	assert(waitFor([&]() {
+		net::NetworkStats stats = network1.getStats();
+		return stats.disconnected_ == 1 && stats.connections_ == 0;
+	}));
+	std::cout << "Test 20 succeeded, i.e. network and connection stats.\n";
+}
+
+void test21() {
+	net::Network network1;
+	network1.setTickRate(50);
+	std::shared_ptr<net::Server> server = network1.createServer(12469);
+	assert(server);
+	long long tick = server->waitForTick();
+	assert(tick > 0 && server->waitForTick() > tick);
+
+	net::Network network2;
+	network2.connectToServer(12469, "localhost");
+	std::shared_ptr<net::Local> local = network2.getLocal();
+	assert(waitFor([&]() {
+		return local->getId() != 0;
+	}));
+
+	// Sent at once, received within a tick or two.
+	const int nbr = 50;
+	char data[] = {'a', 'b', 'c'};
+	for (int i = 0; i < nbr; ++i) {
+		local->sendToServer(net::Packet(data, sizeof(data)));
+	}
+	std::shared_ptr<net::Client> remote;
+	int received = 0;
+	int batches = 0;
+	while (received < nbr) {
+		assert(server->waitForTick() > 0);
+		int count = server->pullAll([&](const std::shared_ptr<net::Client>& sender, const net::Packet&) {
+			remote = sender;
+		});
+		received += count;
+		batches += count > 0 ? 1 : 0;
+	}
+	assert(received == nbr && batches <= 2);
+
+	// The input of the local client on the server side is pulled by a tick.
+	std::shared_ptr<net::Local> host = network1.getLocal();
+	tick = server->waitForTick();
+	host->sendToServer(net::Packet(data, sizeof(data)));
+	net::Packet input;
+	assert(!server->pullReceiveData(input));
+	assert(server->waitForTick() > tick && server->pullReceiveData(input) == host && input.size() == sizeof(data));
+
+	// The packets sent during a tick are written at once.
+	server->waitForTick();
+	long long sendCalls = remote->getStats().sendCalls_;
+	for (int i = 0; i < nbr; ++i) {
+		server->sendTo(remote, net::Packet(data, sizeof(data)));
+	}
+	net::Packet packet;
+	received = 0;
+	assert(waitFor([&]() {
+		while (local->pullReceiveDataFromServer(packet)) {
+			++received;
+		}
+		return received == nbr;
+	}));
+	assert(remote->getStats().sendCalls_ - sendCalls <= 2);
+
+	net::NetworkStats stats = network1.getStats();
+	assert(stats.ticks_ > 0 && stats.tickJitter_.count_ > 0 && stats.tickDuration_.count_ > 0);
+
+	// No ticks without tick mode.
+	net::Network network3;
+	std::shared_ptr<net::Server> server3 = network3.createServer(12470);
+	assert(server3 && server3->waitForTick(10) == 0);
+	std::cout << "Test 21 succeeded, i.e. fixed rate server ticks.\n";
+}
+
+void test22() {
+	net::InterestGrid grid(10);
+	grid.set(1, 5, 5, 3);
+	grid.set(2, -25, 0, 20);
+	std::vector<int> ids;
+	auto query = [&](float x, float y) {
+		ids.clear();
+		grid.query(x, y, [&](int id) {
+			ids.push_back(id);
+		});
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	};
+	assert(query(6, 6) == std::vector<int>({1}));
+	assert(query(9, 9).empty()); // Same cell, outside the circle.
+	assert(query(-10, 5) == std::vector<int>({2}));
+
+	// Moved across cells, into the area of client 2.
+	grid.set(1, -30, 2, 3);
+	assert(query(6, 6).empty());
+	assert(query(-31, 1) == std::vector<int>({1, 2}));
+	grid.remove(2);
+	assert(query(-31, 1) == std::vector<int>({1}));
+	grid.set(1, 0, 0, -1);
+	assert(query(-31, 1).empty() && grid.size() == 0);
+
+	// Too many cells, i.e. checked by every query.
+	grid.set(3, 0, 0, 1e6f);
+	grid.set(4, 0, 0, INFINITY);
+	grid.set(5, 0, 0, NAN);
+	assert(query(1e5f, -1e5f) == std::vector<int>({3, 4}));
+	assert(query(1e7f, 0) == std::vector<int>({4}) && query(INFINITY, 0) == std::vector<int>({4}));
+	grid.set(3, 5, 5, 3);
+	assert(query(1e5f, 0) == std::vector<int>({4}) && query(6, 6) == std::vector<int>({3, 4}));
+	grid.remove(4);
+	grid.remove(5);
+	grid.set(3, 0, 0, -1);
+	assert(query(6, 6).empty() && grid.size() == 0);
+
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12471);
+	assert(server);
+	net::Network network2;
+	net::Network network3;
+	network2.connectToServer(12471, "localhost");
+	network3.connectToServer(12471, "localhost");
+	std::shared_ptr<net::Local> local2 = network2.getLocal();
+	std::shared_ptr<net::Local> local3 = network3.getLocal();
+	assert(waitFor([&]() {
+		return local2->getId() != 0 && local3->getId() != 0;
+	}));
+
+	char data[] = {'a', 'b', 'c'};
+	local2->sendToServer(net::Packet(data, sizeof(data)));
+	local3->sendToServer(net::Packet(data, sizeof(data)));
+	std::shared_ptr<net::Client> remote2, remote3;
+	assert(waitFor([&]() {
+		server->pullAll([&](const std::shared_ptr<net::Client>& sender, const net::Packet&) {
+			(sender->getId() == local2->getId() ? remote2 : remote3) = sender;
+		});
+		return remote2 && remote3;
+	}));
+	server->setInterest(remote2, 0, 0, 100);
+	server->setInterest(remote3, 1000, 1000, 100);
+
+	// Only the client near the location receives it.
+	server->sendToArea(net::Packet(data, sizeof(data)), 50, 50);
+	server->sendToArea(net::Packet(data, 2), 1000, 1050);
+	net::Packet packet;
+	assert(waitFor([&]() {
+		return local2->pullReceiveDataFromServer(packet);
+	}));
+	assert(packet.size() == 3);
+	assert(waitFor([&]() {
+		return local3->pullReceiveDataFromServer(packet);
+	}));
+	assert(packet.size() == 2);
+
+	// Removed, i.e. nothing is received.
+	server->setInterest(remote2, 0, 0, -1);
+	server->sendToArea(net::Packet(data, sizeof(data)), 50, 50);
+	server->sendToArea(net::Packet(data, 1), 1000, 1000);
+	assert(waitFor([&]() {
+		return local3->pullReceiveDataFromServer(packet);
+	}));
+	assert(packet.size() == 1 && !local2->pullReceiveDataFromServer(packet));
+	std::cout << "Test 22 succeeded, i.e. packets sent only to the clients interested in the area.\n";
+}
+
+void test23() {
+	net::Network network1;
+	std::shared_ptr<net::Server> server = network1.createServer(12472);
+	assert(server);
+	std::shared_ptr<net::Local> local1 = network1.getLocal();
+	const int nbr = 3;
+	net::Network networks[nbr];
+	std::shared_ptr<net::Local> locals[nbr];
+	for (int i = 0; i < nbr; ++i) {
+		networks[i].connectToServer(12472, "localhost");
+		locals[i] = networks[i].getLocal();
+	}
+	assert(waitFor([&]() {
+		return locals[0]->getId() != 0 && locals[1]->getId() != 0 && locals[2]->getId() != 0;
+	}));
+
+	char data[] = {'a', 'b', 'c'};
+	for (auto& local : locals) {
+		local->sendToServer(net::Packet(data, sizeof(data)));
+	}
+	std::shared_ptr<net::Client> remotes[nbr];
+	int received = 0;
+	assert(waitFor([&]() {
+		server->pullAll([&](const std::shared_ptr<net::Client>& sender, const net::Packet&) {
+			for (int i = 0; i < nbr; ++i) {
+				if (locals[i]->getId() == sender->getId()) {
+					remotes[i] = sender;
+				}
+			}
+			++received;
+		});
+		return received == nbr;
+	}));
+
+	// Pull the packets until the expected number is received, return their sizes.
+	net::Packet packet;
+	auto receive = [&](int i, int expected) {
+		std::vector<int> sizes;
+		assert(waitFor([&]() {
+			while (locals[i]->pullReceiveDataFromServer(packet)) {
+				sizes.push_back(packet.size());
+			}
+			return (int) sizes.size() >= expected;
+		}));
+		return sizes;
+	};
+
+	int group = server->createGroup();
+	assert(group != server->createGroup());
+	server->joinGroup(group, remotes[0]);
+	server->joinGroup(group, remotes[1]);
+	server->joinGroup(group, remotes[1]); // Already a member.
+	server->joinGroup(group, local1);
+
+	// Only the members receive it, once.
+	server->sendToGroup(group, net::Packet(data, sizeof(data)));
+	server->sendToAll(net::Packet(data, 1));
+	assert(receive(0, 2) == std::vector<int>({3, 1}));
+	assert(receive(1, 2) == std::vector<int>({3, 1}));
+	assert(receive(2, 1) == std::vector<int>({1}));
+	assert(local1->pullReceiveDataFromServer(packet) && packet.size() == 3);
+	assert(local1->pullReceiveDataFromServer(packet) && packet.size() == 1);
+
+	server->leaveGroup(group, remotes[0]);
+	server->sendToGroup(group, net::Packet(data, 2), net::RELIABLE_ORDERED);
+	server->sendToAll(net::Packet(data, 1), net::RELIABLE_ORDERED);
+	assert(receive(0, 1) == std::vector<int>({1}));
+	assert(receive(1, 2) == std::vector<int>({2, 1}));
+	assert(receive(2, 1) == std::vector<int>({1}));
+
+	// Removed, i.e. nothing is received.
+	server->removeGroup(group);
+	server->sendToGroup(group, net::Packet(data, 2));
+	server->sendToAll(net::Packet(data, 1));
+	for (int i = 0; i < nbr; ++i) {
+		assert(receive(i, 1) == std::vector<int>({1}));
+	}
+	std::cout << "Test 23 succeeded, i.e. packets sent to the members of a group.\n";
+}
+
+void test24() {
+	assert(net::BufferPool::getCapacity(1) == net::BufferPool::MIN_SIZE);
+	assert(net::BufferPool::getCapacity(65) == 128 && net::BufferPool::getCapacity(1000) == 1024);
+	assert(net::BufferPool::getCapacity(net::BufferPool::MAX_SIZE + 1) == net::BufferPool::MAX_SIZE + 1);
+
+	// A freed chunk is reused by the same thread.
+	void* chunk = net::BufferPool::allocate(300);
+	net::BufferPool::deallocate(chunk, 300);
+	assert(net::BufferPool::allocate(500) == chunk);
+	net::BufferPool::deallocate(chunk, 500);
+
+	net::BufferPool::resetStats();
+	void* big = net::BufferPool::allocate(net::BufferPool::MAX_SIZE + 1);
+	net::BufferPool::deallocate(big, net::BufferPool::MAX_SIZE + 1);
+	net::PoolStats stats = net::BufferPool::getStats();
+	assert(stats.oversized_ == 1 && stats.reserved_ > 0);
+
+	// Allocated by one thread and freed by another, flows back through the shared lists.
+	const int nbr = 20000;
+	net::MpscQueue<net::Packet> queue;
+	std::thread producer([&]() {
+		std::vector<char> data(200, 'a');
+		for (int i = 0; i < nbr; ++i) {
+			queue.push(net::Packet(data.data(), 1 + i % data.size()));
+		}
+	});
+	int received = 0;
+	net::Packet packet;
+	while (received < nbr) {
+		while (queue.pop(packet)) {
+			assert(packet.size() == 1 + received % 200 && packet[0] == 'a');
+			++received;
+		}
+	}
+	producer.join();
+
+	// Freed by this thread, reused by another one.
+	std::vector<void*> chunks(nbr);
+	std::thread allocator([&]() {
+		for (void*& chunk : chunks) {
+			chunk = net::BufferPool::allocate(256);
+		}
+	});
+	allocator.join();
+	for (void* chunk : chunks) {
+		net::BufferPool::deallocate(chunk, 256);
+	}
+	long long reserved = net::BufferPool::getStats().reserved_;
+	std::thread allocator2([&]() {
+		for (void*& chunk : chunks) {
+			chunk = net::BufferPool::allocate(256);
+		}
+	});
+	allocator2.join();
+	for (void* chunk : chunks) {
+		net::BufferPool::deallocate(chunk, 256);
+	}
+	assert(net::BufferPool::getStats().reserved_ - reserved < nbr * 256 / 4);
+
+	// Copied and moved packets stored in the pool.
+	std::vector<char> data(1000, 'b');
+	net::Packet packet1(data.data(), data.size());
+	net::Packet packet2 = packet1;
+	assert(packet2.size() == 1000 && packet2.capacity() >= 1000 && packet2[999] == 'b');
+	net::Packet packet3 = std::move(packet2);
+	assert(packet3.size() == 1000 && packet2.size() == 0);
+	packet1 = net::Packet("c", 1);
+	assert(packet1.size() == 1 && packet1[0] == 'c');
+
+	net::Payload payload("abc", 3, "de", 2);
+	net::Payload copy = payload;
+	assert(payload.size() == 5 && copy.data()[4] == 'e' && payload.useCount() == 2);
+	std::cout << "Test 24 succeeded, i.e. the buffer pool.\n";
+}
+
+void test25() {
+	// Handlers called by the network thread.
+	net::Network network1;
+	std::atomic<int> connects(0), disconnects(0), messages(0), channelMessages(0), bigMessages(0);
+	network1.onConnect([&](const std::shared_ptr<net::Client>&) {
+		++connects;
+	});
+	network1.onDisconnect([&](const std::shared_ptr<net::Client>&) {
+		++disconnects;
+	});
+	network1.onMessage([&](const std::shared_ptr<net::Client>& sender, const net::Packet& packet) {
+		assert(sender && packet.size() == 3);
+		++messages;
+	});
+	network1.onMessage(net::RELIABLE, 1, [&](const std::shared_ptr<net::Client>& sender, const net::Packet& packet) {
+		assert(sender && packet.size() == 2);
+		++channelMessages;
+	});
+	network1.onMessage(net::UNRELIABLE, 2, [&](const std::shared_ptr<net::Client>& sender, const net::Packet& packet) {
+		assert(sender && packet.size() == 10000);
+		++bigMessages;
+	});
+	std::shared_ptr<net::Server> server = network1.createServer(12473);
+	assert(server);
+	char data[] = {'a', 'b', 'c'};
+	{
+		net::Network network2;
+		network2.connectToServer(12473, "localhost");
+		std::shared_ptr<net::Local> local = network2.getLocal();
+		assert(waitFor([&]() {
+			return connects == 1 && local->getId() != 0;
+		}));
+		local->sendToServer(net::Packet(data, 3));
+		local->sendToServer(net::Packet(data, 3), net::RELIABLE, 0);
+		local->sendToServer(net::Packet(data, 2), net::RELIABLE, 1);
+		// Too big for a datagram, streamed with its delivery and channel.
+		net::Packet big;
+		big.resize(10000);
+		local->sendToServer(big, net::UNRELIABLE, 2);
+		assert(waitFor([&]() {
+			return messages == 2 && channelMessages == 1 && bigMessages == 1;
+		}));
+	}
+	assert(waitFor([&]() {
+		return disconnects == 1;
+	}));
+	net::Packet packet;
+	assert(!server->pullReceiveData(packet) && !network1.pullNewConnections());
+
+	// Connections pulled without a handler.
+	net::Network network3;
+	std::shared_ptr<net::Server> server3 = network3.createServer(12474);
+	assert(server3);
+	net::Network network4;
+	network4.connectToServer(12474, "localhost");
+	std::shared_ptr<net::Client> connection;
+	assert(waitFor([&]() {
+		connection = network3.pullNewConnections();
+		return connection != nullptr;
+	}));
+	assert(waitFor([&]() {
+		return network4.getLocal()->getId() == connection->getId();
+	}));
+	assert(!network3.pullNewConnections());
+
+	// Handlers called by the application.
+	net::Network network5;
+	std::atomic<int> notified(0);
+	network5.setDispatch(net::Network::QUEUED, [&]() {
+		++notified;
+	});
+	std::thread::id thread = std::this_thread::get_id();
+	int connected = 0;
+	std::vector<int> sizes;
+	network5.onConnect([&](const std::shared_ptr<net::Client>&) {
+		assert(std::this_thread::get_id() == thread);
+		++connected;
+	});
+	network5.onMessage([&](const std::shared_ptr<net::Client>& sender, const net::Packet& packet) {
+		assert(std::this_thread::get_id() == thread && !sender);
+		sizes.push_back(packet.size());
+	});
+	network5.connectToServer(12474, "localhost");
+	assert(waitFor([&]() {
+		network5.dispatchEvents();
+		return connected == 1;
+	}));
+	std::shared_ptr<net::Client> connection5;
+	assert(waitFor([&]() {
+		connection5 = network3.pullNewConnections();
+		return connection5 != nullptr;
+	}));
+	server3->sendTo(connection5, net::Packet(data, 1));
+	server3->sendTo(connection5, net::Packet(data, 2));
+	assert(waitFor([&]() {
+		network5.dispatchEvents();
+		return sizes.size() == 2;
+	}));
+	assert(sizes == std::vector<int>({1, 2}) && notified == 3);
+	assert(!network5.getLocal()->pullReceiveDataFromServer(packet));
+	std::cout << "Test 25 succeeded, i.e. connect, disconnect and message handlers.\n";
+}
+
+class MoveMessage {
+public:
+	static const int ID = 1;
+
+	int id_;
+	float x_, y_;
+
+	NET_FIELDS(id_, x_, y_)
+};
+
+class ChatMessage {
+public:
+	static const int ID = 5;
+
+	std::string text_;
+	std::vector<short> recipients_;
+
+	NET_FIELDS(text_, recipients_)
+};
+
+class PingMessage {
+public:
+	static const int ID = 3;
+
+	NET_FIELDS()
+};
+
+typedef net::MessageRegistry<MoveMessage, ChatMessage, PingMessage> Messages;
+
+// Handles the move and chat messages, ping messages are skipped.
+class MessageHandler {
+public:
+	MessageHandler() : moves_(0) {
+	}
+
+	void operator()(const MoveMessage& message) {
+		moves_ += message.id_;
+	}
+
+	void operator()(const ChatMessage& message) {
+		chat_ = message.text_;
+		recipients_ = message.recipients_;
+	}
+
+	void operator()(const MoveMessage& message, const std::shared_ptr<net::Client>& sender) {
+		assert(sender);
+		moves_ += message.id_;
+	}
+
+	int moves_;
+	std::string chat_;
+	std::vector<short> recipients_;
+};
+
+void test26() {
+	static_assert(Messages::SIZE == 6, "The dispatch table is indexed by id");
+	MoveMessage move;
+	move.id_ = 7;
+	move.x_ = 1.5f;
+	move.y_ = -2;
+	net::Packet packet = Messages::encode(move);
+	assert(packet.size() == 1 + 3 * 4 && packet[0] == MoveMessage::ID);
+	MessageHandler handler;
+	assert(Messages::dispatch(packet, handler) && handler.moves_ == 7);
+
+	ChatMessage chat;
+	chat.text_ = "hello";
+	chat.recipients_ = {1, 2, 3};
+	packet = Messages::encode(chat);
+	net::Packet copy = packet;
+	assert(Messages::dispatch(packet, handler) && handler.chat_ == "hello" && handler.recipients_ == chat.recipients_);
+
+	// Not handled, unknown id, truncated data and a too long length.
+	packet = Messages::encode(PingMessage());
+	assert(!Messages::dispatch(packet, handler));
+	char data[] = {4, 0};
+	packet = net::Packet(data, sizeof(data));
+	assert(!Messages::dispatch(packet, handler));
+	packet = net::Packet(copy.getData(), copy.size() - 1);
+	assert(!Messages::dispatch(packet, handler) && packet.failed());
+	char length[] = {ChatMessage::ID, 127, 'a'};
+	packet = net::Packet(length, sizeof(length));
+	assert(!Messages::dispatch(packet, handler) && packet.failed());
+
+	// The receive path, with the sender.
+	net::Network network;
+	std::shared_ptr<net::Server> server = network.createLocalServer();
+	std::shared_ptr<net::Local> local = network.getLocal();
+	handler.moves_ = 0;
+	local->sendToServer(Messages::encode(move));
+	local->sendToServer(Messages::encode(chat));
+	local->sendToServer(Messages::encode(move));
+	assert(Messages::pullAll(*server, handler) == 3 && handler.moves_ == 14);
+	std::cout << "Test 26 succeeded, i.e. typed messages dispatched by id.\n";
+}
+
 int main(int argc, char** argv) {
 	test1();
 	test2();
 	test3();
 	test4();
 	test5();
+	test6();
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
 
 	std::cout << "All test succeeded!\n";
 	return 0;